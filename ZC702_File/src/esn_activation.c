@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * File: esn_activation.c
+ *
+ *   Description:
+ *     Reservoir activation functions for update_state(). Three tiers of
+ *     tanh are provided so speed can be traded against accuracy per model:
+ *     exact tanhf(), a rational approximation and an interpolated table.
+ *     Each tier works on a whole array with a branch-free loop body so the
+ *     compiler can vectorize it.
+ *
+ ******************************************************************************/
+
+#include "esn_activation.h"
+#include <math.h>
+
+/* Currently selected activation (default: exact) */
+static esn_activation_t activation = ESN_ACT_TANH_EXACT;
+
+/* tanh(x) sampled at ESN_TANH_LUT_SIZE + 1 evenly spaced points */
+static float tanh_lut[ESN_TANH_LUT_SIZE + 1];
+static int tanh_lut_ready = 0;
+
+/* Fill the table once; tanh() in double so each entry is correctly rounded */
+static void build_tanh_lut(void)
+{
+    const double step = 2.0 * ESN_TANH_LUT_RANGE / ESN_TANH_LUT_SIZE;
+
+    for (int i = 0; i <= ESN_TANH_LUT_SIZE; i++) {
+        tanh_lut[i] = (float)tanh(-ESN_TANH_LUT_RANGE + i * step);
+    }
+    tanh_lut_ready = 1;
+}
+
+void esn_set_activation(esn_activation_t act)
+{
+    if (act == ESN_ACT_TANH_LUT && !tanh_lut_ready) {
+        build_tanh_lut();
+    }
+    activation = act;
+}
+
+esn_activation_t esn_get_activation(void)
+{
+    return activation;
+}
+
+const char *esn_activation_name(esn_activation_t act)
+{
+    switch (act) {
+    case ESN_ACT_TANH_RATIONAL:
+        return "rational";
+    case ESN_ACT_TANH_LUT:
+        return "lut";
+    default:
+        return "tanhf";
+    }
+}
+
+void esn_tanh_exact(const float *in, float *out, int n)
+{
+    for (int i = 0; i < n; i++) {
+        out[i] = tanhf(in[i]);
+    }
+}
+
+/*
+ * Odd 13/6 rational minimax fit of tanh on [-7.9053, 7.9053]; outside that
+ * range tanh(x) rounds to +-1 in single precision, so the input is clamped.
+ *   tanh(x) ~ x * P(x^2) / Q(x^2)
+ */
+void esn_tanh_rational(const float *in, float *out, int n)
+{
+    const float clamp = 7.90531110763549805f;
+    const float a1  =  4.89352455891786e-03f;
+    const float a3  =  6.37261928875436e-04f;
+    const float a5  =  1.48572235717979e-05f;
+    const float a7  =  5.12229709037114e-08f;
+    const float a9  = -8.60467152213735e-11f;
+    const float a11 =  2.00018790482477e-13f;
+    const float a13 = -2.76076847742355e-16f;
+    const float b0  =  4.89352518554385e-03f;
+    const float b2  =  2.26843463243900e-03f;
+    const float b4  =  1.18534705686654e-04f;
+    const float b6  =  1.19825839466702e-06f;
+
+    for (int i = 0; i < n; i++) {
+        float x = in[i];
+        x = (x < -clamp) ? -clamp : x;
+        x = (x > clamp) ? clamp : x;
+        float x2 = x * x;
+
+        float p = a13;
+        p = p * x2 + a11;
+        p = p * x2 + a9;
+        p = p * x2 + a7;
+        p = p * x2 + a5;
+        p = p * x2 + a3;
+        p = p * x2 + a1;
+        p = p * x;
+
+        float q = b6;
+        q = q * x2 + b4;
+        q = q * x2 + b2;
+        q = q * x2 + b0;
+
+        out[i] = p / q;
+    }
+}
+
+/*
+ * Table lookup with linear interpolation between the two nearest entries.
+ * Inputs outside [-RANGE, RANGE] are clamped, where tanh is within 1e-6
+ * of +-1.
+ */
+void esn_tanh_lut(const float *in, float *out, int n)
+{
+    const float scale = ESN_TANH_LUT_SIZE / (2.0f * ESN_TANH_LUT_RANGE);
+
+    if (!tanh_lut_ready) {
+        build_tanh_lut();
+    }
+
+    for (int i = 0; i < n; i++) {
+        /* Position in table units; the last interval also covers pos == SIZE */
+        float pos = (in[i] + ESN_TANH_LUT_RANGE) * scale;
+        pos = (pos < 0.0f) ? 0.0f : pos;
+        pos = (pos > (float)ESN_TANH_LUT_SIZE) ? (float)ESN_TANH_LUT_SIZE : pos;
+
+        int idx = (int)pos;
+        idx = (idx < ESN_TANH_LUT_SIZE - 1) ? idx : ESN_TANH_LUT_SIZE - 1;
+        float frac = pos - (float)idx;
+        out[i] = tanh_lut[idx] + frac * (tanh_lut[idx + 1] - tanh_lut[idx]);
+    }
+}
+
+const float *esn_tanh_lut_table(void)
+{
+    if (!tanh_lut_ready) {
+        build_tanh_lut();
+    }
+    return tanh_lut;
+}
+
+void esn_activate(const float *in, float *out, int n)
+{
+    switch (activation) {
+    case ESN_ACT_TANH_RATIONAL:
+        esn_tanh_rational(in, out, n);
+        break;
+    case ESN_ACT_TANH_LUT:
+        esn_tanh_lut(in, out, n);
+        break;
+    default:
+        esn_tanh_exact(in, out, n);
+        break;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef ESN_ACTIVATION_H
+#define ESN_ACTIVATION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reservoir activation tiers (speed vs. accuracy):
+ *   - ESN_ACT_TANH_EXACT:    tanhf() from libm
+ *   - ESN_ACT_TANH_RATIONAL: rational minimax fit, |err| < 4e-7 (a few ulp)
+ *   - ESN_ACT_TANH_LUT:      table over [-ESN_TANH_LUT_RANGE, +RANGE] with
+ *                            linear interpolation, |err| < 3e-5
+ */
+typedef enum {
+    ESN_ACT_TANH_EXACT = 0,
+    ESN_ACT_TANH_RATIONAL,
+    ESN_ACT_TANH_LUT
+} esn_activation_t;
+
+/* Lookup table size: ESN_TANH_LUT_SIZE intervals over [-RANGE, +RANGE] */
+#define ESN_TANH_LUT_RANGE  8.0f
+#define ESN_TANH_LUT_SIZE   1024
+
+/*
+ * esn_set_activation() / esn_get_activation()
+ *   Select the activation used by update_state(). Selecting the LUT tier
+ *   builds the table on first use.
+ */
+void esn_set_activation(esn_activation_t act);
+esn_activation_t esn_get_activation(void);
+
+/* Returns "tanhf", "rational" or "lut" */
+const char *esn_activation_name(esn_activation_t act);
+
+/*
+ * esn_activate()
+ *   out[i] = act(in[i]) for i = 0 .. n-1, using the selected tier.
+ *   in and out may be the same array.
+ */
+void esn_activate(const float *in, float *out, int n);
+
+/* Single tiers, for callers that want one explicitly */
+void esn_tanh_exact(const float *in, float *out, int n);
+void esn_tanh_rational(const float *in, float *out, int n);
+void esn_tanh_lut(const float *in, float *out, int n);
+
+/*
+ * esn_tanh_lut_table()
+ *   The LUT tier's ESN_TANH_LUT_SIZE + 1 entries (built on first use), for
+ *   kernels that inline the lookup.
+ */
+const float *esn_tanh_lut_table(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_ACTIVATION_H */
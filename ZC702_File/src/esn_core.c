@@ -22,41 +22,1195 @@
  ******************************************************************************/
 
 #include "esn_core.h"
+#include "esn_activation.h"
 #include <string.h>
 
+/*
+ * Thin vector layer so each kernel below is written once for every ISA.
+ *   vec_zero()          all-zero vector
+ *   vec_load(p)         unaligned load of VEC_WIDTH floats
+ *   vec_store(p, v)     unaligned store of VEC_WIDTH floats
+ *   vec_set1(f)         f in every lane
+ *   vec_load_f16(p)     VEC_WIDTH fp16 values widened to float
+ *   vec_load_bf16(p)    VEC_WIDTH bf16 values widened to float
+ *   vec_mla(acc, a, b)  acc + a * b
+ *   vec_add/sub/mul/min/max/div element-wise
+ *   vec_pow2i(k)        2^k for whole-number lanes k, |k| < 127
+ *   vec_reduce4()       horizontal sums of four accumulators
+ * fp16 uses the hardware conversion where the build has one (-mfpu=neon-fp16
+ * on the A9, -mf16c on x86), otherwise the integer widening further down.
+ */
+#if defined(ESN_KERNEL_NEON)
+#include <arm_neon.h>
+typedef float32x4_t vec_t;
+#define VEC_WIDTH           4
+#define vec_zero()          vdupq_n_f32(0.0f)
+#define vec_load(p)         vld1q_f32(p)
+#define vec_store(p, v)     vst1q_f32((p), (v))
+#define vec_set1(f)         vdupq_n_f32(f)
+#define vec_mla(acc, a, b)  vmlaq_f32((acc), (a), (b))
+#define vec_add(a, b)       vaddq_f32((a), (b))
+#define vec_sub(a, b)       vsubq_f32((a), (b))
+#define vec_mul(a, b)       vmulq_f32((a), (b))
+#define vec_min(a, b)       vminq_f32((a), (b))
+#define vec_max(a, b)       vmaxq_f32((a), (b))
+#define vec_pow2i(k)        vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32( \
+                                vcvtq_s32_f32(k), vdupq_n_s32(127)), 23))
+#define vec_load_bf16(p)    vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(p), 16))
+#if defined(__ARM_FP16_FORMAT_IEEE) && defined(__ARM_FP) && (__ARM_FP & 2)
+#define vec_load_f16(p)     vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(p)))
+#endif
+
+static inline void vec_reduce4(vec_t a0, vec_t a1, vec_t a2, vec_t a3,
+                               float *out)
+{
+    /* Pairwise-add the four accumulators down to one vector of row sums */
+    float32x2_t s01 = vpadd_f32(vadd_f32(vget_low_f32(a0), vget_high_f32(a0)),
+                                vadd_f32(vget_low_f32(a1), vget_high_f32(a1)));
+    float32x2_t s23 = vpadd_f32(vadd_f32(vget_low_f32(a2), vget_high_f32(a2)),
+                                vadd_f32(vget_low_f32(a3), vget_high_f32(a3)));
+    vst1q_f32(out, vcombine_f32(s01, s23));
+}
+
+/* ARMv7 NEON has no divide: reciprocal estimate plus two Newton steps */
+static inline vec_t vec_div(vec_t a, vec_t b)
+{
+    float32x4_t r = vrecpeq_f32(b);
+
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, r);
+}
+#elif defined(ESN_KERNEL_AVX)
+#include <immintrin.h>
+typedef __m256 vec_t;
+#define VEC_WIDTH           8
+#define vec_zero()          _mm256_setzero_ps()
+#define vec_load(p)         _mm256_loadu_ps(p)
+#define vec_store(p, v)     _mm256_storeu_ps((p), (v))
+#define vec_set1(f)         _mm256_set1_ps(f)
+#define vec_mla(acc, a, b)  _mm256_add_ps((acc), _mm256_mul_ps((a), (b)))
+#define vec_add(a, b)       _mm256_add_ps((a), (b))
+#define vec_sub(a, b)       _mm256_sub_ps((a), (b))
+#define vec_mul(a, b)       _mm256_mul_ps((a), (b))
+#define vec_min(a, b)       _mm256_min_ps((a), (b))
+#define vec_max(a, b)       _mm256_max_ps((a), (b))
+#define vec_div(a, b)       _mm256_div_ps((a), (b))
+#if defined(__F16C__)
+#define vec_load_f16(p)     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(p)))
+#endif
+
+static inline vec_t vec_load_bf16(const uint16_t *p)
+{
+    /* bf16 is the top half of a float: interleave below 16 zero bits */
+    __m128i h = _mm_loadu_si128((const __m128i *)p);
+    __m128i z = _mm_setzero_si128();
+    __m256 lo = _mm256_castps128_ps256(_mm_castsi128_ps(_mm_unpacklo_epi16(z, h)));
+    return _mm256_insertf128_ps(lo, _mm_castsi128_ps(_mm_unpackhi_epi16(z, h)), 1);
+}
+
+static inline vec_t vec_pow2i(vec_t k)
+{
+    __m256i e = _mm256_cvttps_epi32(k);
+#if defined(__AVX2__)
+    e = _mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23);
+    return _mm256_castsi256_ps(e);
+#else
+    /* No 256-bit integer ops before AVX2: each half with SSE2 */
+    const __m128i bias = _mm_set1_epi32(127);
+    __m128i lo = _mm_slli_epi32(_mm_add_epi32(_mm256_castsi256_si128(e),
+                                              bias), 23);
+    __m128i hi = _mm_slli_epi32(_mm_add_epi32(_mm256_extractf128_si256(e, 1),
+                                              bias), 23);
+    return _mm256_castsi256_ps(
+        _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+#endif
+}
+
+static inline void vec_reduce4(vec_t a0, vec_t a1, vec_t a2, vec_t a3,
+                               float *out)
+{
+    /* hadd twice leaves each row's total split over the two 128-bit lanes */
+    __m256 h = _mm256_hadd_ps(_mm256_hadd_ps(a0, a1),
+                              _mm256_hadd_ps(a2, a3));
+    _mm_storeu_ps(out, _mm_add_ps(_mm256_castps256_ps128(h),
+                                  _mm256_extractf128_ps(h, 1)));
+}
+#elif defined(ESN_KERNEL_SSE)
+#include <immintrin.h>
+typedef __m128 vec_t;
+#define VEC_WIDTH           4
+#define vec_zero()          _mm_setzero_ps()
+#define vec_load(p)         _mm_loadu_ps(p)
+#define vec_store(p, v)     _mm_storeu_ps((p), (v))
+#define vec_set1(f)         _mm_set1_ps(f)
+#define vec_mla(acc, a, b)  _mm_add_ps((acc), _mm_mul_ps((a), (b)))
+#define vec_add(a, b)       _mm_add_ps((a), (b))
+#define vec_sub(a, b)       _mm_sub_ps((a), (b))
+#define vec_mul(a, b)       _mm_mul_ps((a), (b))
+#define vec_min(a, b)       _mm_min_ps((a), (b))
+#define vec_max(a, b)       _mm_max_ps((a), (b))
+#define vec_div(a, b)       _mm_div_ps((a), (b))
+#define vec_pow2i(k)        _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32( \
+                                _mm_cvttps_epi32(k), _mm_set1_epi32(127)), 23))
+#define vec_load_bf16(p)    _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), \
+                                _mm_loadl_epi64((const __m128i *)(p))))
+#if defined(__F16C__)
+#define vec_load_f16(p)     _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(p)))
+#endif
+
+static inline void vec_reduce4(vec_t a0, vec_t a1, vec_t a2, vec_t a3,
+                               float *out)
+{
+    /* 4x4 transpose, then add the columns to get one total per row */
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+}
+#endif
+
+#if (defined(ESN_KERNEL_AVX) || defined(ESN_KERNEL_SSE)) && !defined(__F16C__)
+/*
+ * x86 without F16C: widen four fp16 values (zero-extended to 32 bits) with
+ * SSE2 integer ops. Exponent and mantissa are moved into fp32 position and
+ * rebiased by one multiply by 2^112, which is exact for normals and
+ * subnormals alike; inf/NaN get the all-ones exponent ORed back in.
+ */
+static inline __m128 f16x4_to_ps(__m128i h)
+{
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i em = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 13);
+    __m128i inf_nan = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x0F7FFFFF));
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(em),
+                          _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+
+    f = _mm_or_ps(f, _mm_castsi128_ps(_mm_and_si128(inf_nan,
+                                      _mm_set1_epi32(0x7F800000))));
+    return _mm_or_ps(f, _mm_castsi128_ps(sign));
+}
+
+#if defined(ESN_KERNEL_AVX)
+static inline vec_t vec_load_f16(const uint16_t *p)
+{
+    __m128i h = _mm_loadu_si128((const __m128i *)p);
+    __m128i z = _mm_setzero_si128();
+    __m256 lo = _mm256_castps128_ps256(f16x4_to_ps(_mm_unpacklo_epi16(h, z)));
+    return _mm256_insertf128_ps(lo, f16x4_to_ps(_mm_unpackhi_epi16(h, z)), 1);
+}
+#else
+#define vec_load_f16(p)     f16x4_to_ps(_mm_unpacklo_epi16( \
+                                _mm_loadl_epi64((const __m128i *)(p)), _mm_setzero_si128()))
+#endif
+#endif
+
+#if !defined(ESN_KERNEL_SCALAR) && !defined(ESN_KERNEL_AVX) && \
+    !defined(ESN_KERNEL_SSE) && !defined(vec_load_f16)
+/* NEON built without fp16 conversion support: one lane at a time */
+static inline vec_t vec_load_f16(const uint16_t *p)
+{
+    float t[VEC_WIDTH];
+
+    for (int i = 0; i < VEC_WIDTH; i++) {
+        t[i] = esn_fp16_to_float(p[i]);
+    }
+    return vec_load(t);
+}
+#endif
+
+/*
+ * Number of B columns (samples) per GEMM panel. 32 extended states are
+ * 17 KB, which stays in the A9's 32 KB L1 next to a 4-row strip of W_out.
+ */
+#define ESN_GEMM_PANEL 32
+
+/*
+ * Force inlining of the kernel bodies into the size-specialized steps below,
+ * so their loop bounds are compile-time constants there.
+ */
+#define ESN_INLINE static inline __attribute__((always_inline))
+
+/*
+ * Weight element access for each storage format (esn_half.h). fmt is a
+ * compile-time constant wherever these are inlined, so the branches fold.
+ */
+ESN_INLINE const void *w_at(const void *A, int fmt, int idx)
+{
+    if (fmt == ESN_WEIGHTS_FP32) {
+        return (const float *)A + idx;
+    }
+    return (const uint16_t *)A + idx;
+}
+
+ESN_INLINE float load_w(const void *A, int fmt, int idx)
+{
+    if (fmt == ESN_WEIGHTS_FP16) {
+        return esn_fp16_to_float(((const uint16_t *)A)[idx]);
+    }
+    if (fmt == ESN_WEIGHTS_BF16) {
+        return esn_bf16_to_float(((const uint16_t *)A)[idx]);
+    }
+    return ((const float *)A)[idx];
+}
+
+#if !defined(ESN_KERNEL_SCALAR)
+ESN_INLINE vec_t load_wv(const void *A, int fmt, int idx)
+{
+    if (fmt == ESN_WEIGHTS_FP16) {
+        return vec_load_f16((const uint16_t *)A + idx);
+    }
+    if (fmt == ESN_WEIGHTS_BF16) {
+        return vec_load_bf16((const uint16_t *)A + idx);
+    }
+    return vec_load((const float *)A + idx);
+}
+#endif
+
+/*
+ * Scalar reference GEMV:
+ *   y[i] = sum_j( A[i * lda + j] * x[j] )
+ *
+ * This is the original nested loop from update_state()/compute_output().
+ * It is always built so the vector kernels can be checked against it.
+ */
+void esn_gemv_ref(const float *A, int lda, const float *x,
+                  int rows, int cols, float *y)
+{
+    for (int i = 0; i < rows; i++) {
+        y[i] = 0.0f;
+        for (int j = 0; j < cols; j++) {
+            y[i] += A[i * lda + j] * x[j];
+        }
+    }
+}
+
+#if !defined(ESN_KERNEL_SCALAR)
+/*
+ * 4x1 register tile: four rows of A against one vector, so every load of
+ * the vector is shared by four rows. The vector may be given in two
+ * segments, x0 (n0 floats) followed by x1 (n1 floats), which lets the
+ * output layer read [state | input] in place. Leftover columns (a segment
+ * not a multiple of the vector width) are finished in scalar code.
+ * A is stored in format fmt and widened to float as it is loaded.
+ */
+ESN_INLINE void kernel_4x1_fmt(const void *A, int fmt, int lda,
+                               const float *x0, int n0,
+                               const float *x1, int n1, float *y)
+{
+    const void *a0 = A;
+    const void *a1 = w_at(A, fmt, lda);
+    const void *a2 = w_at(A, fmt, 2 * lda);
+    const void *a3 = w_at(A, fmt, 3 * lda);
+    vec_t acc0 = vec_zero();
+    vec_t acc1 = vec_zero();
+    vec_t acc2 = vec_zero();
+    vec_t acc3 = vec_zero();
+    float tail[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const float *x = x0;
+    int n = n0;
+
+    for (int seg = 0; seg < 2; seg++) {
+        int j = 0;
+        for (; j + VEC_WIDTH <= n; j += VEC_WIDTH) {
+            vec_t xv = vec_load(&x[j]);
+            acc0 = vec_mla(acc0, load_wv(a0, fmt, j), xv);
+            acc1 = vec_mla(acc1, load_wv(a1, fmt, j), xv);
+            acc2 = vec_mla(acc2, load_wv(a2, fmt, j), xv);
+            acc3 = vec_mla(acc3, load_wv(a3, fmt, j), xv);
+        }
+        for (; j < n; j++) {
+            tail[0] += load_w(a0, fmt, j) * x[j];
+            tail[1] += load_w(a1, fmt, j) * x[j];
+            tail[2] += load_w(a2, fmt, j) * x[j];
+            tail[3] += load_w(a3, fmt, j) * x[j];
+        }
+
+        /* Move on to the second segment of x and of each row */
+        a0 = w_at(a0, fmt, n);
+        a1 = w_at(a1, fmt, n);
+        a2 = w_at(a2, fmt, n);
+        a3 = w_at(a3, fmt, n);
+        x = x1;
+        n = n1;
+    }
+    vec_reduce4(acc0, acc1, acc2, acc3, y);
+
+    y[0] += tail[0];
+    y[1] += tail[1];
+    y[2] += tail[2];
+    y[3] += tail[3];
+}
+
+/*
+ * 4x2 register tile: four rows of A against two vectors (two samples), so
+ * every load of A is also shared by two samples. Used by esn_gemm().
+ * A is stored in format fmt.
+ */
+ESN_INLINE void kernel_4x2_fmt(const void *A, int fmt, int lda,
+                               const float *x0, const float *x1,
+                               int cols, float *y0, float *y1)
+{
+    const void *a0 = A;
+    const void *a1 = w_at(A, fmt, lda);
+    const void *a2 = w_at(A, fmt, 2 * lda);
+    const void *a3 = w_at(A, fmt, 3 * lda);
+    vec_t acc00 = vec_zero(), acc01 = vec_zero();
+    vec_t acc10 = vec_zero(), acc11 = vec_zero();
+    vec_t acc20 = vec_zero(), acc21 = vec_zero();
+    vec_t acc30 = vec_zero(), acc31 = vec_zero();
+    int j = 0;
+
+    for (; j + VEC_WIDTH <= cols; j += VEC_WIDTH) {
+        vec_t xv0 = vec_load(&x0[j]);
+        vec_t xv1 = vec_load(&x1[j]);
+        vec_t av;
+
+        av = load_wv(a0, fmt, j);
+        acc00 = vec_mla(acc00, av, xv0);
+        acc01 = vec_mla(acc01, av, xv1);
+        av = load_wv(a1, fmt, j);
+        acc10 = vec_mla(acc10, av, xv0);
+        acc11 = vec_mla(acc11, av, xv1);
+        av = load_wv(a2, fmt, j);
+        acc20 = vec_mla(acc20, av, xv0);
+        acc21 = vec_mla(acc21, av, xv1);
+        av = load_wv(a3, fmt, j);
+        acc30 = vec_mla(acc30, av, xv0);
+        acc31 = vec_mla(acc31, av, xv1);
+    }
+    vec_reduce4(acc00, acc10, acc20, acc30, y0);
+    vec_reduce4(acc01, acc11, acc21, acc31, y1);
+
+    for (; j < cols; j++) {
+        y0[0] += load_w(a0, fmt, j) * x0[j];
+        y0[1] += load_w(a1, fmt, j) * x0[j];
+        y0[2] += load_w(a2, fmt, j) * x0[j];
+        y0[3] += load_w(a3, fmt, j) * x0[j];
+        y1[0] += load_w(a0, fmt, j) * x1[j];
+        y1[1] += load_w(a1, fmt, j) * x1[j];
+        y1[2] += load_w(a2, fmt, j) * x1[j];
+        y1[3] += load_w(a3, fmt, j) * x1[j];
+    }
+}
+#endif
+
+/*
+ * GEMV with the vector in two pieces:
+ *   y[i] = sum_j( A[i * lda + j] * x0[j] ) + sum_j( A[i * lda + n0 + j] * x1[j] )
+ *
+ * Same result as a GEMV on the concatenation [x0; x1], without building
+ * it. The scalar path accumulates in the same order as esn_gemv_ref().
+ * A is stored in format fmt (ESN_WEIGHTS_FP32 for the float matrices).
+ */
+ESN_INLINE void gemv_split_body(const void *A, int fmt, int lda,
+                                const float *x0, int n0,
+                                const float *x1, int n1,
+                                int rows, float *y)
+{
+#if !defined(ESN_KERNEL_SCALAR)
+    int vec_rows = rows & ~3;
+
+    for (int i = 0; i < vec_rows; i += 4) {
+        kernel_4x1_fmt(w_at(A, fmt, i * lda), fmt, lda, x0, n0, x1, n1, &y[i]);
+    }
+#else
+    int vec_rows = 0;
+#endif
+    /* Scalar build, or leftover rows (rows not a multiple of 4) */
+    for (int i = vec_rows; i < rows; i++) {
+        const void *a = w_at(A, fmt, i * lda);
+        y[i] = 0.0f;
+        for (int j = 0; j < n0; j++) {
+            y[i] += load_w(a, fmt, j) * x0[j];
+        }
+        for (int j = 0; j < n1; j++) {
+            y[i] += load_w(a, fmt, n0 + j) * x1[j];
+        }
+    }
+}
+
+/*
+ * GEMV used by the ESN equations. Dispatches to the vector kernel picked at
+ * build time (see esn_core.h), or to the same loop as esn_gemv_ref() for
+ * scalar builds.
+ */
+void esn_gemv(const float *A, int lda, const float *x,
+              int rows, int cols, float *y)
+{
+    gemv_split_body(A, ESN_WEIGHTS_FP32, lda, x, cols, NULL, 0, rows, y);
+}
+
+void esn_gemv_split(const float *A, int lda,
+                    const float *x0, int n0,
+                    const float *x1, int n1,
+                    int rows, float *y)
+{
+    gemv_split_body(A, ESN_WEIGHTS_FP32, lda, x0, n0, x1, n1, rows, y);
+}
+
+/*
+ * Cache-blocked GEMM over a block of samples:
+ *   C(:, s) = A * B(:, s)   for s = 0 .. n-1
+ *
+ * B and C are column-major (one sample per column, column strides ldb and
+ * ldc). The samples are walked in panels of ESN_GEMM_PANEL columns so the
+ * panel stays in L1 while every 4-row strip of A is streamed through it once.
+ * A is stored in format fmt.
+ */
+ESN_INLINE void gemm_body(const void *A, int fmt, int lda,
+                          const float *B, int ldb,
+                          int rows, int cols, int n, float *C, int ldc)
+{
+#if defined(ESN_KERNEL_SCALAR)
+    for (int s = 0; s < n; s++) {
+        gemv_split_body(A, fmt, lda, &B[s * ldb], cols, NULL, 0, rows,
+                        &C[s * ldc]);
+    }
+#else
+    for (int s0 = 0; s0 < n; s0 += ESN_GEMM_PANEL) {
+        int s1 = (s0 + ESN_GEMM_PANEL < n) ? s0 + ESN_GEMM_PANEL : n;
+        int i = 0;
+
+        for (; i + 4 <= rows; i += 4) {
+            const void *A_strip = w_at(A, fmt, i * lda);
+            int s = s0;
+            for (; s + 2 <= s1; s += 2) {
+                kernel_4x2_fmt(A_strip, fmt, lda,
+                               &B[s * ldb], &B[(s + 1) * ldb], cols,
+                               &C[s * ldc + i], &C[(s + 1) * ldc + i]);
+            }
+            if (s < s1) {
+                kernel_4x1_fmt(A_strip, fmt, lda, &B[s * ldb], cols, NULL, 0,
+                               &C[s * ldc + i]);
+            }
+        }
+        /* Leftover rows (rows not a multiple of 4): the scalar loop */
+        if (i < rows) {
+            for (int s = s0; s < s1; s++) {
+                gemv_split_body(w_at(A, fmt, i * lda), fmt, lda,
+                                &B[s * ldb], cols, NULL, 0, rows - i,
+                                &C[s * ldc + i]);
+            }
+        }
+    }
+#endif
+}
+
+void esn_gemm(const float *A, int lda, const float *B, int ldb,
+              int rows, int cols, int n, float *C, int ldc)
+{
+    gemm_body(A, ESN_WEIGHTS_FP32, lda, B, ldb, rows, cols, n, C, ldc);
+}
+
+void esn_gemm_half(esn_weight_format_t fmt, const uint16_t *A, int lda,
+                   const float *B, int ldb, int rows, int cols, int n,
+                   float *C, int ldc)
+{
+    if (fmt == ESN_WEIGHTS_FP16) {
+        gemm_body(A, ESN_WEIGHTS_FP16, lda, B, ldb, rows, cols, n, C, ldc);
+    } else {
+        gemm_body(A, ESN_WEIGHTS_BF16, lda, B, ldb, rows, cols, n, C, ldc);
+    }
+}
+
+/*
+ * Level-1 kernels for RLS (rls_training.c): one vector loop each, scalar
+ * tail for the leftover elements.
+ */
+void esn_axpy(int n, float a, const float *x, float *y)
+{
+    int j = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+    vec_t av = vec_set1(a);
+
+    for (; j + VEC_WIDTH <= n; j += VEC_WIDTH) {
+        vec_store(&y[j], vec_mla(vec_load(&y[j]), av, vec_load(&x[j])));
+    }
+#endif
+    for (; j < n; j++) {
+        y[j] += a * x[j];
+    }
+}
+
+void esn_axpy_multi(int n, int k, const float *a,
+                    const float *x, int ldx, float *y)
+{
+    esn_axpy_multi_from(n, k, a, x, ldx, y, y);
+}
+
+void esn_axpy_multi_from(int n, int k, const float *a,
+                         const float *x, int ldx, const float *y0, float *y)
+{
+    const float *src = y0;  // y after the first pass
+    int c = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+    /* Four vectors per pass over y, so y is loaded and stored k/4 times */
+    for (; c + 4 <= k; c += 4) {
+        const float *x0 = &x[c * ldx];
+        const float *x1 = &x[(c + 1) * ldx];
+        const float *x2 = &x[(c + 2) * ldx];
+        const float *x3 = &x[(c + 3) * ldx];
+        vec_t a0 = vec_set1(a[c]);
+        vec_t a1 = vec_set1(a[c + 1]);
+        vec_t a2 = vec_set1(a[c + 2]);
+        vec_t a3 = vec_set1(a[c + 3]);
+        int j = 0;
+
+        for (; j + VEC_WIDTH <= n; j += VEC_WIDTH) {
+            vec_t acc = vec_load(&src[j]);
+            acc = vec_mla(acc, a0, vec_load(&x0[j]));
+            acc = vec_mla(acc, a1, vec_load(&x1[j]));
+            acc = vec_mla(acc, a2, vec_load(&x2[j]));
+            acc = vec_mla(acc, a3, vec_load(&x3[j]));
+            vec_store(&y[j], acc);
+        }
+        for (; j < n; j++) {
+            y[j] = src[j] + (a[c] * x0[j] + a[c + 1] * x1[j] +
+                             a[c + 2] * x2[j] + a[c + 3] * x3[j]);
+        }
+        src = y;
+    }
+#endif
+    if (c == k && src != y) {
+        memcpy(y, src, sizeof(float) * n);
+    }
+    for (; c < k; c++) {
+        const float *xc = &x[c * ldx];
+        int j = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+        vec_t av = vec_set1(a[c]);
+
+        for (; j + VEC_WIDTH <= n; j += VEC_WIDTH) {
+            vec_store(&y[j], vec_mla(vec_load(&src[j]), av, vec_load(&xc[j])));
+        }
+#endif
+        for (; j < n; j++) {
+            y[j] = src[j] + a[c] * xc[j];
+        }
+        src = y;
+    }
+}
+
+float esn_dot_axpy(int n, const float *row, const float *z,
+                   float a, float *p)
+{
+    float acc = 0.0f;
+    int j = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+    vec_t av = vec_set1(a);
+    vec_t acc0 = vec_zero();
+    vec_t acc1 = vec_zero();
+    vec_t acc2 = vec_zero();
+    vec_t acc3 = vec_zero();
+    float sums[4];
+
+    /* Two accumulators per row half keep the dot product's adds pipelined */
+    for (; j + 2 * VEC_WIDTH <= n; j += 2 * VEC_WIDTH) {
+        vec_t r0 = vec_load(&row[j]);
+        vec_t r1 = vec_load(&row[j + VEC_WIDTH]);
+        acc0 = vec_mla(acc0, r0, vec_load(&z[j]));
+        acc1 = vec_mla(acc1, r1, vec_load(&z[j + VEC_WIDTH]));
+        vec_store(&p[j], vec_mla(vec_load(&p[j]), av, r0));
+        vec_store(&p[j + VEC_WIDTH],
+                  vec_mla(vec_load(&p[j + VEC_WIDTH]), av, r1));
+    }
+    vec_reduce4(acc0, acc1, acc2, acc3, sums);
+    acc = sums[0] + sums[1];
+#endif
+    for (; j < n; j++) {
+        acc += row[j] * z[j];
+        p[j] += a * row[j];
+    }
+    return acc;
+}
+
+float esn_dot(int n, const float *x, const float *y)
+{
+    float acc = 0.0f;
+    int j = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+    vec_t acc0 = vec_zero();
+    vec_t acc1 = vec_zero();
+    vec_t acc2 = vec_zero();
+    vec_t acc3 = vec_zero();
+    float sums[4];
+
+    for (; j + 2 * VEC_WIDTH <= n; j += 2 * VEC_WIDTH) {
+        acc0 = vec_mla(acc0, vec_load(&x[j]), vec_load(&y[j]));
+        acc1 = vec_mla(acc1, vec_load(&x[j + VEC_WIDTH]),
+                       vec_load(&y[j + VEC_WIDTH]));
+    }
+    vec_reduce4(acc0, acc1, acc2, acc3, sums);
+    acc = sums[0] + sums[1];
+#endif
+    for (; j < n; j++) {
+        acc += x[j] * y[j];
+    }
+    return acc;
+}
+
+void esn_rotate(int n, float a, float b, float c, float d,
+                float *x, float *y)
+{
+    int j = 0;
+#if !defined(ESN_KERNEL_SCALAR)
+    vec_t av = vec_set1(a);
+    vec_t bv = vec_set1(b);
+    vec_t cv = vec_set1(c);
+    vec_t dv = vec_set1(d);
+
+    for (; j + VEC_WIDTH <= n; j += VEC_WIDTH) {
+        vec_t xv = vec_load(&x[j]);
+        vec_t yv = vec_load(&y[j]);
+        vec_store(&x[j], vec_mla(vec_mla(vec_zero(), av, xv), bv, yv));
+        vec_store(&y[j], vec_mla(vec_mla(vec_zero(), cv, xv), dv, yv));
+    }
+#endif
+    for (; j < n; j++) {
+        const float xj = x[j];
+        x[j] = a * xj + b * y[j];
+        y[j] = c * xj + d * y[j];
+    }
+}
+
+/* Name of the GEMV kernel this image was built with (for the UART log) */
+const char *esn_kernel_name(void)
+{
+#if defined(ESN_KERNEL_NEON)
+    return "NEON";
+#elif defined(ESN_KERNEL_AVX)
+    return "AVX";
+#elif defined(ESN_KERNEL_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
+
+/*
+ * Recurrent half of the state update, for n neurons:
+ *   state(i) = act( input_proj(i) + W_x(i,:)*state_pre )
+ * where act is the tanh tier set by esn_set_activation(). W_x is stored in
+ * format fmt.
+ */
+ESN_INLINE void recur_body(int n, int fmt,
+                           const float *input_proj,
+                           const void *W_x,
+                           const float *state_pre,
+                           float *state)
+{
+    float temp2[n];
+
+    /* temp2[i] = sum_j( W_x[i * n + j] * state_pre[j] ) */
+    gemv_split_body(W_x, fmt, n, state_pre, n, NULL, 0, n, temp2);
+
+    for (int i = 0; i < n; i++) {
+        temp2[i] += input_proj[i];
+    }
+
+    /* state[i] = act(temp2[i]) */
+    esn_activate(temp2, state, n);
+}
+
+/*
+ * Whole ESN step for n neurons, n_in inputs and n_out outputs: input
+ * projection, recurrent update, then the output layer read from
+ * [state | dataIn] in place. W_in and W_x are stored in format fmt and
+ * W_out in out_fmt.
+ */
+ESN_INLINE void step_body(int n, int n_in, int n_out, int fmt, int out_fmt,
+                          const void *W_in,
+                          const void *W_x,
+                          const void *W_out,
+                          const float *dataIn,
+                          const float *state_pre,
+                          float *state,
+                          float *data_out)
+{
+    float temp1[n];
+
+    /* temp1[i] = sum_j( W_in[i * n_in + j] * dataIn[j] ) */
+    gemv_split_body(W_in, fmt, n_in, dataIn, n_in, NULL, 0, n, temp1);
+    recur_body(n, fmt, temp1, W_x, state_pre, state);
+
+    gemv_split_body(W_out, out_fmt, n + n_in, state, n, dataIn, n_in, n_out, data_out);
+}
+
+/*
+ * Size-specialized kernels. N and I are constants inside each one, so the
+ * compiler fully resolves the vector loop trip counts and tails; only the
+ * number of output rows is read from the model. Each size also gets the
+ * reduced-precision steps, one per (weight, W_out) format pair so the
+ * format tests in the kernels are resolved at compile time too.
+ */
+#define ESN_DEFINE_STEP_HALF(NAME, N, I, FMT, OUT_FMT)                      \
+static void NAME(const esn_model_t *m, const void *W_in, const void *W_x,   \
+                 const void *W_out, const float *dataIn,                    \
+                 const float *state_pre, float *state, float *data_out)     \
+{                                                                           \
+    step_body(N, I, m->num_outputs, FMT, OUT_FMT,                           \
+              W_in, W_x, W_out, dataIn, state_pre, state, data_out);        \
+}
+
+#define ESN_DEFINE_STEP_HALVES(SUFFIX, N, I)                                \
+ESN_DEFINE_STEP_HALF(esn_step_f16_##SUFFIX, N, I,                           \
+                     ESN_WEIGHTS_FP16, ESN_WEIGHTS_FP16)                    \
+ESN_DEFINE_STEP_HALF(esn_step_f16_out32_##SUFFIX, N, I,                     \
+                     ESN_WEIGHTS_FP16, ESN_WEIGHTS_FP32)                    \
+ESN_DEFINE_STEP_HALF(esn_step_bf16_##SUFFIX, N, I,                          \
+                     ESN_WEIGHTS_BF16, ESN_WEIGHTS_BF16)                    \
+ESN_DEFINE_STEP_HALF(esn_step_bf16_out32_##SUFFIX, N, I,                    \
+                     ESN_WEIGHTS_BF16, ESN_WEIGHTS_FP32)
+
+#define ESN_DEFINE_STEP(N, I)                                               \
+static void esn_step_##N##x##I(const esn_model_t *m,                        \
+                               const float *W_in, const float *W_x,         \
+                               const float *W_out, const float *dataIn,     \
+                               const float *state_pre, float *state,        \
+                               float *data_out)                             \
+{                                                                           \
+    step_body(N, I, m->num_outputs, ESN_WEIGHTS_FP32, ESN_WEIGHTS_FP32,     \
+              W_in, W_x, W_out, dataIn, state_pre, state, data_out);        \
+}                                                                           \
+ESN_DEFINE_STEP_HALVES(N##x##I, N, I)
+
+#define ESN_DEFINE_RECUR_HALF(NAME, N, FMT)                                 \
+static void NAME(const esn_model_t *m, const float *input_proj,             \
+                 const void *W_x, const float *state_pre, float *state)     \
+{                                                                           \
+    (void)m;                                                                \
+    recur_body(N, FMT, input_proj, W_x, state_pre, state);                  \
+}
+
+#define ESN_DEFINE_RECUR(N)                                                 \
+static void esn_recur_##N(const esn_model_t *m, const float *input_proj,    \
+                          const float *W_x, const float *state_pre,         \
+                          float *state)                                     \
+{                                                                           \
+    (void)m;                                                                \
+    recur_body(N, ESN_WEIGHTS_FP32, input_proj, W_x, state_pre, state);     \
+}                                                                           \
+ESN_DEFINE_RECUR_HALF(esn_recur_f16_##N, N, ESN_WEIGHTS_FP16)               \
+ESN_DEFINE_RECUR_HALF(esn_recur_bf16_##N, N, ESN_WEIGHTS_BF16)
+
+ESN_DEFINE_STEP(8, 40)
+ESN_DEFINE_STEP(8, 128)
+ESN_DEFINE_STEP(16, 40)
+ESN_DEFINE_STEP(16, 128)
+ESN_DEFINE_STEP(32, 40)
+ESN_DEFINE_STEP(32, 128)
+ESN_DEFINE_STEP(64, 40)
+ESN_DEFINE_STEP(64, 128)
+
+ESN_DEFINE_RECUR(8)
+ESN_DEFINE_RECUR(16)
+ESN_DEFINE_RECUR(32)
+ESN_DEFINE_RECUR(64)
+
+#if !defined(ESN_KERNEL_SCALAR)
+/*
+ * Register-resident block recurrence. Transposed W_x takes n * n / VEC_WIDTH
+ * vector registers: with one register per column (n == VEC_WIDTH) it fills
+ * half of the 16-register file (q0-q15 on NEON, xmm/ymm on x86-64) and the
+ * accumulator, the broadcast state and the tanh temporaries fit beside it.
+ * At two registers per column (n == 2 * VEC_WIDTH, the deployed 8-neuron
+ * reservoir on NEON) W_x is held as VEC_WIDTH x VEC_WIDTH tiles and takes
+ * the whole file, so the compiler keeps part of it in the transposed copy
+ * on the stack; that is still one contiguous load per tile and no
+ * horizontal reductions, against a row-major pass per sample.
+ */
+#define ESN_REG_NEURONS_MAX (2 * VEC_WIDTH)
+
+/*
+ * esn_tanh_rational() on one vector, inlined into the block loop: the same
+ * clamp and 13/6 coefficients, with the NEON divide done by reciprocal
+ * refinement.
+ */
+ESN_INLINE vec_t vec_tanh_rational(vec_t x)
+{
+    x = vec_max(vec_set1(-7.90531110763549805f), x);
+    x = vec_min(vec_set1(7.90531110763549805f), x);
+    vec_t x2 = vec_mul(x, x);
+
+    vec_t p = vec_set1(-2.76076847742355e-16f);
+    p = vec_mla(vec_set1(2.00018790482477e-13f), p, x2);
+    p = vec_mla(vec_set1(-8.60467152213735e-11f), p, x2);
+    p = vec_mla(vec_set1(5.12229709037114e-08f), p, x2);
+    p = vec_mla(vec_set1(1.48572235717979e-05f), p, x2);
+    p = vec_mla(vec_set1(6.37261928875436e-04f), p, x2);
+    p = vec_mla(vec_set1(4.89352455891786e-03f), p, x2);
+    p = vec_mul(p, x);
+
+    vec_t q = vec_set1(1.19825839466702e-06f);
+    q = vec_mla(vec_set1(1.18534705686654e-04f), q, x2);
+    q = vec_mla(vec_set1(2.26843463243900e-03f), q, x2);
+    q = vec_mla(vec_set1(4.89352518554385e-03f), q, x2);
+
+    return vec_div(p, q);
+}
+
+/*
+ * The exact tier on one vector: tanh(x) = e / (e + 2), e = expm1(2x), with
+ * expm1 reduced to 2^k * (expm1(r) + 1) - 1, |r| <= ln2 / 2 (Cody-Waite
+ * split of ln2) and expm1(r) from its degree-8 Taylor polynomial, so small
+ * x loses nothing to cancellation. Within 3 ulp of libm tanhf(); x is
+ * clamped to +-9.02, beyond which tanhf() rounds to +-1.
+ */
+ESN_INLINE vec_t vec_tanh_exact(vec_t x)
+{
+    const vec_t round = vec_set1(12582912.0f);   // 1.5 * 2^23
+
+    x = vec_max(vec_set1(-9.02f), x);
+    x = vec_min(vec_set1(9.02f), x);
+    vec_t y = vec_add(x, x);
+
+    // k = nearest integer to y / ln2, r = y - k * ln2
+    vec_t k = vec_sub(vec_mla(round, y, vec_set1(1.44269504088896341f)),
+                      round);
+    vec_t r = vec_mla(y, k, vec_set1(-0.693359375f));
+    r = vec_mla(r, k, vec_set1(2.12194440e-4f));
+
+    vec_t p = vec_set1(1.0f / 40320.0f);
+    p = vec_mla(vec_set1(1.0f / 5040.0f), p, r);
+    p = vec_mla(vec_set1(1.0f / 720.0f), p, r);
+    p = vec_mla(vec_set1(1.0f / 120.0f), p, r);
+    p = vec_mla(vec_set1(1.0f / 24.0f), p, r);
+    p = vec_mla(vec_set1(1.0f / 6.0f), p, r);
+    p = vec_mla(vec_set1(0.5f), p, r);
+    vec_t em = vec_mla(r, vec_mul(r, r), p);
+
+    vec_t two_k = vec_pow2i(k);
+    vec_t e = vec_mla(vec_sub(two_k, vec_set1(1.0f)), two_k, em);
+
+    return vec_div(e, vec_add(e, vec_set1(2.0f)));
+}
+
+/*
+ * esn_tanh_lut() on one vector: the table position in vector registers,
+ * the lookup and interpolation lane by lane (no gather on NEON), with the
+ * same float operations, so the result matches esn_tanh_lut() exactly.
+ */
+ESN_INLINE vec_t vec_tanh_lut(vec_t x, const float *lut)
+{
+    const float scale = ESN_TANH_LUT_SIZE / (2.0f * ESN_TANH_LUT_RANGE);
+    float pos[VEC_WIDTH];
+
+    vec_t p = vec_mul(vec_add(x, vec_set1(ESN_TANH_LUT_RANGE)),
+                      vec_set1(scale));
+    p = vec_max(p, vec_zero());
+    p = vec_min(p, vec_set1((float)ESN_TANH_LUT_SIZE));
+    vec_store(pos, p);
+
+#pragma GCC unroll 8
+    for (int l = 0; l < VEC_WIDTH; l++) {
+        int idx = (int)pos[l];
+        idx = (idx < ESN_TANH_LUT_SIZE - 1) ? idx : ESN_TANH_LUT_SIZE - 1;
+        float frac = pos[l] - (float)idx;
+        pos[l] = lut[idx] + frac * (lut[idx + 1] - lut[idx]);
+    }
+    return vec_load(pos);
+}
+
+/* Tier act (a compile-time constant at every call) on one vector */
+ESN_INLINE vec_t vec_tanh_tier(vec_t x, int act, const float *lut)
+{
+    if (act == ESN_ACT_TANH_RATIONAL) {
+        return vec_tanh_rational(x);
+    }
+    if (act == ESN_ACT_TANH_LUT) {
+        return vec_tanh_lut(x, lut);
+    }
+    return vec_tanh_exact(x);
+}
+
+/*
+ * Recurrence over count consecutive samples for a reservoir of
+ * r * VEC_WIDTH neurons (r = 1 or 2) under tier act. W_x (stored in format
+ * fmt) is transposed into vector registers once per block, column j as r
+ * vectors, and each sample's pre-activation is built column by column as
+ * proj + sum_j W_x(:,j) * state_pre(j), so there are no horizontal
+ * reductions. The activation is inlined and nothing in the sample loop is
+ * a call, so the registers holding W_x are never saved around one.
+ */
+ESN_INLINE void recur_block_reg_body(int r, int act, int fmt,
+                                     const float *input_proj,
+                                     const void *W_x,
+                                     const float *state_pre,
+                                     int count,
+                                     float *states)
+{
+    const int n = r * VEC_WIDTH;
+    const float *lut = (act == ESN_ACT_TANH_LUT) ? esn_tanh_lut_table()
+                                                 : NULL;
+    vec_t wt[ESN_REG_NEURONS_MAX][2];
+    float col[ESN_REG_NEURONS_MAX];
+    const float *s_prev = state_pre;
+
+#pragma GCC unroll 16
+    for (int j = 0; j < n; j++) {
+#pragma GCC unroll 16
+        for (int i = 0; i < n; i++) {
+            col[i] = load_w(W_x, fmt, i * n + j);
+        }
+#pragma GCC unroll 2
+        for (int h = 0; h < r; h++) {
+            wt[j][h] = vec_load(&col[h * VEC_WIDTH]);
+        }
+    }
+
+    for (int s = 0; s < count; s++) {
+        vec_t acc[2];
+
+#pragma GCC unroll 2
+        for (int h = 0; h < r; h++) {
+            acc[h] = vec_load(&input_proj[s * n + h * VEC_WIDTH]);
+        }
+#pragma GCC unroll 16
+        for (int j = 0; j < n; j++) {
+            const vec_t sj = vec_set1(s_prev[j]);
+#pragma GCC unroll 2
+            for (int h = 0; h < r; h++) {
+                acc[h] = vec_mla(acc[h], wt[j][h], sj);
+            }
+        }
+#pragma GCC unroll 2
+        for (int h = 0; h < r; h++) {
+            vec_store(&states[s * n + h * VEC_WIDTH],
+                      vec_tanh_tier(acc[h], act, lut));
+        }
+        s_prev = &states[s * n];
+    }
+}
+
+/* recur_block_reg_body() for the selected tier, one copy per tier */
+ESN_INLINE void recur_block_reg(int r, int fmt, const float *input_proj,
+                                const void *W_x, const float *state_pre,
+                                int count, float *states)
+{
+    switch (esn_get_activation()) {
+    case ESN_ACT_TANH_RATIONAL:
+        recur_block_reg_body(r, ESN_ACT_TANH_RATIONAL, fmt, input_proj, W_x,
+                             state_pre, count, states);
+        break;
+    case ESN_ACT_TANH_LUT:
+        recur_block_reg_body(r, ESN_ACT_TANH_LUT, fmt, input_proj, W_x,
+                             state_pre, count, states);
+        break;
+    default:
+        recur_block_reg_body(r, ESN_ACT_TANH_EXACT, fmt, input_proj, W_x,
+                             state_pre, count, states);
+        break;
+    }
+}
+
+#define ESN_DEFINE_RECUR_BLOCK_REG(R)                                       \
+static void esn_recur_block_reg##R(const esn_model_t *m,                    \
+                                   const float *input_proj,                 \
+                                   const float *W_x,                        \
+                                   const float *state_pre,                  \
+                                   int count,                               \
+                                   float *states)                           \
+{                                                                           \
+    (void)m;                                                                \
+    recur_block_reg(R, ESN_WEIGHTS_FP32, input_proj, W_x, state_pre,        \
+                    count, states);                                         \
+}
+
+ESN_DEFINE_RECUR_BLOCK_REG(1)
+ESN_DEFINE_RECUR_BLOCK_REG(2)
+#endif
+
+/* Any other size: same bodies with the dimensions read from the model */
+static void esn_step_generic(const esn_model_t *m,
+                             const float *W_in, const float *W_x,
+                             const float *W_out, const float *dataIn,
+                             const float *state_pre, float *state,
+                             float *data_out)
+{
+    step_body(m->num_neurons, m->num_inputs, m->num_outputs,
+              ESN_WEIGHTS_FP32, ESN_WEIGHTS_FP32,
+              W_in, W_x, W_out, dataIn, state_pre, state, data_out);
+}
+
+static void esn_recur_generic(const esn_model_t *m, const float *input_proj,
+                              const float *W_x, const float *state_pre,
+                              float *state)
+{
+    recur_body(m->num_neurons, ESN_WEIGHTS_FP32, input_proj, W_x,
+               state_pre, state);
+}
+
+ESN_DEFINE_STEP_HALVES(generic, m->num_neurons, m->num_inputs)
+ESN_DEFINE_RECUR_HALF(esn_recur_f16_generic, m->num_neurons, ESN_WEIGHTS_FP16)
+ESN_DEFINE_RECUR_HALF(esn_recur_bf16_generic, m->num_neurons, ESN_WEIGHTS_BF16)
+
+/* Block recurrence for any size: one m->recur call per sample */
+static void esn_recur_block_generic(const esn_model_t *m,
+                                    const float *input_proj,
+                                    const float *W_x,
+                                    const float *state_pre, int count,
+                                    float *states)
+{
+    const int n = m->num_neurons;
+
+    for (int s = 0; s < count; s++) {
+        m->recur(m, &input_proj[s * n], W_x, state_pre, &states[s * n]);
+        state_pre = &states[s * n];
+    }
+}
+
+/* The four reduced-precision steps of one size, as m->step_half wants them */
+#define ESN_STEP_HALVES(SUFFIX)                                             \
+    { esn_step_f16_##SUFFIX, esn_step_f16_out32_##SUFFIX,                   \
+      esn_step_bf16_##SUFFIX, esn_step_bf16_out32_##SUFFIX }
+
+static const struct {
+    int num_neurons;
+    int num_inputs;
+    esn_step_fn step;
+    esn_step_half_fn step_half[4];
+    const char *name;
+} step_table[] = {
+    {  8,  40, esn_step_8x40,   ESN_STEP_HALVES(8x40),   "8x40"   },
+    {  8, 128, esn_step_8x128,  ESN_STEP_HALVES(8x128),  "8x128"  },
+    { 16,  40, esn_step_16x40,  ESN_STEP_HALVES(16x40),  "16x40"  },
+    { 16, 128, esn_step_16x128, ESN_STEP_HALVES(16x128), "16x128" },
+    { 32,  40, esn_step_32x40,  ESN_STEP_HALVES(32x40),  "32x40"  },
+    { 32, 128, esn_step_32x128, ESN_STEP_HALVES(32x128), "32x128" },
+    { 64,  40, esn_step_64x40,  ESN_STEP_HALVES(64x40),  "64x40"  },
+    { 64, 128, esn_step_64x128, ESN_STEP_HALVES(64x128), "64x128" },
+};
+
+static const struct {
+    int num_neurons;
+    esn_recur_fn recur;
+    esn_recur_half_fn recur_half[2];
+} recur_table[] = {
+    {  8, esn_recur_8,  { esn_recur_f16_8,  esn_recur_bf16_8  } },
+    { 16, esn_recur_16, { esn_recur_f16_16, esn_recur_bf16_16 } },
+    { 32, esn_recur_32, { esn_recur_f16_32, esn_recur_bf16_32 } },
+    { 64, esn_recur_64, { esn_recur_f16_64, esn_recur_bf16_64 } },
+};
+
+#if !defined(ESN_KERNEL_SCALAR)
+static const struct {
+    int num_neurons;
+    esn_recur_block_fn recur_block;
+} recur_block_table[] = {
+    {     VEC_WIDTH, esn_recur_block_reg1 },
+    { 2 * VEC_WIDTH, esn_recur_block_reg2 },
+};
+#endif
+
+void esn_select_kernels(esn_model_t *m)
+{
+    static const esn_step_half_fn step_half_generic[4] =
+        ESN_STEP_HALVES(generic);
+
+    m->step = esn_step_generic;
+    m->recur = esn_recur_generic;
+    m->recur_block = esn_recur_block_generic;
+    memcpy(m->step_half, step_half_generic, sizeof(m->step_half));
+    m->recur_half[0] = esn_recur_f16_generic;
+    m->recur_half[1] = esn_recur_bf16_generic;
+    m->kernel_variant = "generic";
+
+    for (unsigned k = 0; k < sizeof(step_table) / sizeof(step_table[0]); k++) {
+        if (step_table[k].num_neurons == m->num_neurons &&
+            step_table[k].num_inputs == m->num_inputs) {
+            m->step = step_table[k].step;
+            memcpy(m->step_half, step_table[k].step_half,
+                   sizeof(m->step_half));
+            m->kernel_variant = step_table[k].name;
+            break;
+        }
+    }
+    for (unsigned k = 0; k < sizeof(recur_table) / sizeof(recur_table[0]); k++) {
+        if (recur_table[k].num_neurons == m->num_neurons) {
+            m->recur = recur_table[k].recur;
+            memcpy(m->recur_half, recur_table[k].recur_half,
+                   sizeof(m->recur_half));
+            break;
+        }
+    }
+#if !defined(ESN_KERNEL_SCALAR)
+    for (unsigned k = 0;
+         k < sizeof(recur_block_table) / sizeof(recur_block_table[0]); k++) {
+        if (recur_block_table[k].num_neurons == m->num_neurons) {
+            m->recur_block = recur_block_table[k].recur_block;
+            break;
+        }
+    }
+#endif
+}
+
 /*
  * Update reservoir state based on:
- *   state(i) = tanh( W_in(i,:)*dataIn + W_x(i,:)*state_pre )
+ *   state(i) = act( W_in(i,:)*dataIn + W_x(i,:)*state_pre )
+ * with act the tanh tier selected by esn_set_activation().
  */
-void update_state(const float *W_in,
+void update_state(const esn_model_t *m,
+                  const float *W_in,
                   const float *dataIn,
                   const float *W_x,
                   const float *state_pre,
                   float *state)
 {
-    float temp1[NUM_NEURONS] = {0};
-    float temp2[NUM_NEURONS] = {0};
+    float temp1[m->num_neurons];
 
-    /* temp1[i] = sum_j( W_in[i * NUM_INPUTS + j] * dataIn[j] ) */
-    for (int i = 0; i < NUM_NEURONS; i++) {
-        for (int j = 0; j < NUM_INPUTS; j++) {
-            temp1[i] += W_in[i * NUM_INPUTS + j] * dataIn[j];
-        }
-    }
+    /* temp1[i] = sum_j( W_in[i * num_inputs + j] * dataIn[j] ) */
+    esn_gemv(W_in, m->num_inputs, dataIn, m->num_neurons, m->num_inputs, temp1);
 
-    /* temp2[i] = sum_j( W_x[i * NUM_NEURONS + j] * state_pre[j] ) */
-    for (int i = 0; i < NUM_NEURONS; i++) {
-        for (int j = 0; j < NUM_NEURONS; j++) {
-            temp2[i] += W_x[i * NUM_NEURONS + j] * state_pre[j];
-        }
-    }
+    m->recur(m, temp1, W_x, state_pre, state);
+}
+
+/*
+ * Recurrent half of update_state(), for when the input projection
+ * W_in*dataIn has already been computed (e.g. for a whole chunk by esn_gemm):
+ *   state(i) = act( input_proj(i) + W_x(i,:)*state_pre )
+ */
+void update_state_projected(const esn_model_t *m,
+                            const float *input_proj,
+                            const float *W_x,
+                            const float *state_pre,
+                            float *state)
+{
+    m->recur(m, input_proj, W_x, state_pre, state);
+}
+
+void update_state_block(const esn_model_t *m,
+                        const float *input_proj,
+                        const float *W_x,
+                        const float *state_pre,
+                        int count,
+                        float *states)
+{
+    m->recur_block(m, input_proj, W_x, state_pre, count, states);
+}
 
-    /* state[i] = tanh(temp1[i] + temp2[i]) */
-    for (int i = 0; i < NUM_NEURONS; i++) {
-        float sum_val = temp1[i] + temp2[i];
-        /* Use tanhf for single-precision float math.
-           If you're using double math, use tanh(). */
-        state[i] = tanh(sum_val);
+void update_state_block_half(const esn_model_t *m,
+                             esn_weight_format_t fmt,
+                             const float *input_proj,
+                             const uint16_t *W_x,
+                             const float *state_pre,
+                             int count,
+                             float *states)
+{
+    const int n = m->num_neurons;
+    const esn_recur_half_fn recur = m->recur_half[fmt == ESN_WEIGHTS_BF16];
+
+#if !defined(ESN_KERNEL_SCALAR)
+    // fmt only matters while W_x is loaded, so it is not specialized on
+    if (n == VEC_WIDTH) {
+        recur_block_reg(1, fmt, input_proj, W_x, state_pre, count, states);
+        return;
+    }
+    if (n == 2 * VEC_WIDTH) {
+        recur_block_reg(2, fmt, input_proj, W_x, state_pre, count, states);
+        return;
+    }
+#endif
+    for (int s = 0; s < count; s++) {
+        recur(m, &input_proj[s * n], W_x, state_pre, &states[s * n]);
+        state_pre = &states[s * n];
     }
 }
 
@@ -66,19 +1220,20 @@ void update_state(const float *W_in,
  *
  * state_extended = [reservoir_state; input_data]
  *
- * so it ends up length (NUM_NEURONS + NUM_INPUTS).
+ * so it ends up length (num_neurons + num_inputs).
  */
-void form_state_extended(const float *dataIn,
+void form_state_extended(const esn_model_t *m,
+                         const float *dataIn,
                          const float *state,
                          float *state_extended)
 {
     /* Copy reservoir state first */
-    for (int i = 0; i < NUM_NEURONS; i++) {
+    for (int i = 0; i < m->num_neurons; i++) {
         state_extended[i] = state[i];
     }
     /* Then copy input data after that */
-    for (int i = 0; i < NUM_INPUTS; i++) {
-        state_extended[NUM_NEURONS + i] = dataIn[i];
+    for (int i = 0; i < m->num_inputs; i++) {
+        state_extended[m->num_neurons + i] = dataIn[i];
     }
 }
 
@@ -86,26 +1241,75 @@ void form_state_extended(const float *dataIn,
  * Compute ESN output, e.g.:
  *   data_out[k] = sum_j( W_out[k*TOTAL + j] * state_extended[j] )
  *
- * Where TOTAL = (NUM_INPUTS + NUM_NEURONS),
+ * Where TOTAL = (num_inputs + num_neurons),
  * and k goes over however many output dimensions you have (i.e., 4).
  */
-void compute_output(const float *W_out,
+void compute_output(const esn_model_t *m,
+                    const float *W_out,
                     const float *state_extended,
                     float *data_out)
 {
-    // Use the defined macro NUM_OUTPUTS instead of constant 4.
-    int output_dim = NUM_OUTPUTS;
-    // total = NUM_INPUTS + NUM_NEURONS, e.g., 128 + 8 = 136
-    int total = NUM_INPUTS + NUM_NEURONS;
+    // total = num_inputs + num_neurons, e.g., 128 + 8 = 136
+    int total = m->extended_size;
 
-    for (int i = 0; i < output_dim; i++) {
-        data_out[i] = 0.0f;
-        for (int j = 0; j < total; j++) {
-            data_out[i] += W_out[i * total + j] * state_extended[j];
-        }
-    }
+    esn_gemv(W_out, total, state_extended, m->num_outputs, total, data_out);
 }
 
+/*
+ * Output layer without state_extended: W_out is read as
+ * [W_out_state | W_out_input], so
+ *   data_out[k] = W_out_state(k,:)*state + W_out_input(k,:)*dataIn
+ * with state and dataIn read in place. Equal to form_state_extended()
+ * followed by compute_output().
+ */
+void compute_output_split(const esn_model_t *m,
+                          const float *W_out,
+                          const float *state,
+                          const float *dataIn,
+                          float *data_out)
+{
+    esn_gemv_split(W_out, m->extended_size,
+                   state, m->num_neurons,
+                   dataIn, m->num_inputs,
+                   m->num_outputs, data_out);
+}
+
+/*
+ * Fused ESN step: update_state() + form_state_extended() + compute_output()
+ * in one call, without the state_extended copy.
+ *   - state:    new reservoir state (size num_neurons)
+ *   - data_out: ESN output for this sample (size num_outputs)
+ */
+void esn_step(const esn_model_t *m,
+              const float *W_in,
+              const float *W_x,
+              const float *W_out,
+              const float *dataIn,
+              const float *state_pre,
+              float *state,
+              float *data_out)
+{
+    m->step(m, W_in, W_x, W_out, dataIn, state_pre, state, data_out);
+}
+
+void esn_step_half(const esn_model_t *m,
+                   esn_weight_format_t fmt,
+                   const uint16_t *W_in,
+                   const uint16_t *W_x,
+                   const uint16_t *W_out_half,
+                   const float *W_out,
+                   const float *dataIn,
+                   const float *state_pre,
+                   float *state,
+                   float *data_out)
+{
+    const int k = 2 * (fmt == ESN_WEIGHTS_BF16) + (W_out_half == NULL);
+    const void *W_out_fmt = (W_out_half != NULL) ? (const void *)W_out_half
+                                                 : (const void *)W_out;
+
+    m->step_half[k](m, W_in, W_x, W_out_fmt, dataIn, state_pre, state,
+                    data_out);
+}
 
 /**
  * Computes the Mean Squared Error (MSE) between two arrays of floats.
@@ -6,9 +6,12 @@ extern "C" {
 #endif
 
 #include <math.h>
+#include "esn_activation.h"
+#include "esn_half.h"
 
 /*
- * Adjust NUM_INPUTS, NUM_OUTPUTS and NUM_NEURONS here,
+ * Default model dimensions, used until a MODEL___ descriptor is loaded
+ * (see esn_model.h). Adjust NUM_INPUTS, NUM_OUTPUTS and NUM_NEURONS here,
  */
 #define NUM_INPUTS  128   /* data input size */
 #define NUM_OUTPUTS 128	 /* data output size */
@@ -16,44 +19,351 @@ extern "C" {
 
 #define EXTENDED_STATE_SIZE (NUM_INPUTS + NUM_NEURONS)
 
+/*
+ * Largest model a descriptor may ask for. Reservoirs above
+ * ESN_MAX_DENSE_NEURONS must be sparse (see esn_sparse.h). Per-sample
+ * scratch is sized from the loaded model (small arrays on the stack, or
+ * arena buffers for anything that grows with a sparse reservoir), never
+ * from these limits: the stack is only 40 KB (lscript.ld).
+ */
+#define ESN_MAX_INPUTS        128
+#define ESN_MAX_OUTPUTS       128
+#define ESN_MAX_NEURONS       2048
+#define ESN_MAX_DENSE_NEURONS 64
+#define ESN_MAX_EXTENDED      (ESN_MAX_INPUTS + ESN_MAX_NEURONS)
+
+typedef struct esn_model esn_model_t;
+
+/* Per-sample kernels, specialized for common sizes by esn_select_kernels() */
+typedef void (*esn_step_fn)(const esn_model_t *m,
+                            const float *W_in,
+                            const float *W_x,
+                            const float *W_out,
+                            const float *dataIn,
+                            const float *state_pre,
+                            float *state,
+                            float *data_out);
+typedef void (*esn_recur_fn)(const esn_model_t *m,
+                             const float *input_proj,
+                             const float *W_x,
+                             const float *state_pre,
+                             float *state);
+typedef void (*esn_recur_block_fn)(const esn_model_t *m,
+                                   const float *input_proj,
+                                   const float *W_x,
+                                   const float *state_pre,
+                                   int count,
+                                   float *states);
+/* The same with W_in, W_x and W_out stored in fp16/bf16 (esn_half.h) */
+typedef void (*esn_step_half_fn)(const esn_model_t *m,
+                                 const void *W_in,
+                                 const void *W_x,
+                                 const void *W_out,
+                                 const float *dataIn,
+                                 const float *state_pre,
+                                 float *state,
+                                 float *data_out);
+typedef void (*esn_recur_half_fn)(const esn_model_t *m,
+                                  const float *input_proj,
+                                  const void *W_x,
+                                  const float *state_pre,
+                                  float *state);
+
+/* Online W_out trainer used while training is on (TRN_ON) */
+typedef enum {
+    ESN_TRAINER_RLS = 0,         /* recursive least squares, O(ext^2)/sample */
+    ESN_TRAINER_NLMS,            /* normalized LMS, O(ext)/sample, no Psi */
+    ESN_TRAINER_QR_RLS           /* inverse QR-RLS: Cholesky factor of Psi */
+} esn_trainer_t;
+
+/*
+ * Model descriptor: everything that used to be fixed at compile time.
+ * Loaded at run time with the weights; every buffer is sized from it.
+ */
+struct esn_model {
+    int num_inputs;              /* data input size */
+    int num_outputs;             /* data output size */
+    int num_neurons;             /* reservoir (hidden) layer size */
+    int extended_size;           /* num_neurons + num_inputs */
+
+    esn_activation_t activation; /* reservoir tanh tier */
+
+    float forgetting_factor;     /* RLS lambda */
+    float psi_init;              /* RLS: Psi = psi_init * I on init */
+    esn_trainer_t trainer;       /* NLMS models allocate no Psi */
+    int feature_stride;          /* RLS trains on the reservoir plus every
+                                    k-th input (0: none), Psi sized to it */
+
+    /*
+     * 0: dense W_in/W_x (switched to CSR if loaded sparse enough).
+     * > 0: sparse reservoir, W_in/W_x only stored in CSR form with at most
+     *      this many nonzeros per row.
+     */
+    int max_row_nnz;
+
+    /* Filled in by esn_select_kernels() */
+    esn_step_fn step;
+    esn_recur_fn recur;
+    esn_recur_block_fn recur_block;
+    esn_step_half_fn step_half[4];   /* [2 * is_bf16 + fp32_W_out] */
+    esn_recur_half_fn recur_half[2]; /* [is_bf16] */
+    const char *kernel_variant;  /* e.g. "8x128" or "generic" */
+};
+
+/*
+ * esn_select_kernels()
+ *   Point m->step and m->recur at the compile-time-specialized kernels for
+ *   m's dimensions (8/16/32/64 neurons x 40/128 inputs), or at the generic
+ *   loops for any other size. m->recur_block is the register-resident
+ *   block recurrence for reservoirs one or two vectors wide (4 or 8 neurons
+ *   on NEON and SSE, 8 or 16 on AVX) under every tanh tier, otherwise
+ *   m->recur once per sample. m->step_half and m->recur_half are the same sizes with
+ *   fp16/bf16 weights, used by esn_step_half() and
+ *   update_state_block_half().
+ */
+void esn_select_kernels(esn_model_t *m);
+
+/*
+ * Define ESN_FIXED_POINT (-DESN_FIXED_POINT) for FPU-less targets such as
+ * MicroBlaze: inference then runs on the Q15/Q31 path in esn_fixed.c
+ * whenever RLS training is off.
+ */
+
+/*
+ * GEMV kernel selection (build time):
+ *   - ESN_KERNEL_NEON:   Cortex-A9 built with -mfpu=neon
+ *   - ESN_KERNEL_AVX:    host builds with -mavx
+ *   - ESN_KERNEL_SSE:    host builds with SSE (x86-64 default)
+ *   - ESN_KERNEL_SCALAR: original nested loops (reference path)
+ * Define ESN_FORCE_SCALAR to build the reference path on any target.
+ */
+#if defined(ESN_FORCE_SCALAR)
+#define ESN_KERNEL_SCALAR
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ESN_KERNEL_NEON
+#elif defined(__AVX__)
+#define ESN_KERNEL_AVX
+#elif defined(__SSE__)
+#define ESN_KERNEL_SSE
+#else
+#define ESN_KERNEL_SCALAR
+#endif
+
+/*
+ * esn_gemv()
+ *   y = A * x, where A is (rows x cols) stored row-major with a row stride
+ *   of lda floats. Uses the vector kernel selected above.
+ *
+ * esn_gemv_ref()
+ *   Same product using the scalar nested loop. Always available so the
+ *   vector kernels can be checked against it.
+ */
+void esn_gemv(const float *A, int lda, const float *x,
+              int rows, int cols, float *y);
+void esn_gemv_ref(const float *A, int lda, const float *x,
+                  int rows, int cols, float *y);
+
+/*
+ * esn_gemv_split()
+ *   y = A * [x0; x1] without forming the concatenation: the first n0
+ *   columns of A multiply x0 and the next n1 columns multiply x1.
+ */
+void esn_gemv_split(const float *A, int lda,
+                    const float *x0, int n0,
+                    const float *x1, int n1,
+                    int rows, float *y);
+
+/*
+ * esn_gemm()
+ *   C(:, s) = A * B(:, s) for s = 0 .. n-1, i.e. esn_gemv() over a block of
+ *   n samples. B and C are column-major: sample s starts at B[s * ldb] and
+ *   C[s * ldc]. Cache- and register-blocked so A is streamed once per panel
+ *   of samples instead of once per sample.
+ */
+void esn_gemm(const float *A, int lda, const float *B, int ldb,
+              int rows, int cols, int n, float *C, int ldc);
+
+/*
+ * esn_gemm_half()
+ *   esn_gemm() with A stored in fmt (ESN_WEIGHTS_FP16 or ESN_WEIGHTS_BF16),
+ *   widened to fp32 as it is loaded.
+ */
+void esn_gemm_half(esn_weight_format_t fmt, const uint16_t *A, int lda,
+                   const float *B, int ldb, int rows, int cols, int n,
+                   float *C, int ldc);
+
+/*
+ * esn_axpy()
+ *   y += a * x over n floats.
+ *
+ * esn_axpy_multi()
+ *   y += sum_c a[c] * x_c for k vectors x_c = &x[c * ldx], in fewer passes
+ *   over y than k esn_axpy() calls (rank-k updates in block RLS).
+ *
+ * esn_axpy_multi_from()
+ *   y = y0 + sum_c a[c] * x_c, the same update reading y0 on the first
+ *   pass, so copying a matrix row and updating it is one pass (y0 may be y).
+ *
+ * esn_dot_axpy()
+ *   p += a * row over n floats, and returns row . z. One pass over row,
+ *   used for the symmetric Psi * z product in RLS training.
+ *
+ * esn_dot()
+ *   Returns x . y over n floats.
+ *
+ * esn_rotate()
+ *   (x, y) <- (a * x + b * y, c * x + d * y) elementwise over n floats,
+ *   the Givens rotations (with lambda folded in) of inverse QR-RLS.
+ */
+void esn_axpy(int n, float a, const float *x, float *y);
+void esn_axpy_multi(int n, int k, const float *a,
+                    const float *x, int ldx, float *y);
+void esn_axpy_multi_from(int n, int k, const float *a,
+                         const float *x, int ldx, const float *y0, float *y);
+float esn_dot_axpy(int n, const float *row, const float *z,
+                   float a, float *p);
+float esn_dot(int n, const float *x, const float *y);
+void esn_rotate(int n, float a, float b, float c, float d,
+                float *x, float *y);
+
+/* Returns "NEON", "AVX", "SSE" or "scalar" */
+const char *esn_kernel_name(void);
+
+/*
+ * All functions below take the model descriptor m for their dimensions:
+ * num_inputs, num_neurons, num_outputs and extended_size.
+ */
+
 /*
  * update_state()
- *   - W_in:    Flattened input weight matrix of size (NUM_NEURONS * NUM_INPUTS)
- *   - dataIn:  Array of size NUM_INPUTS
- *   - W_x:     Flattened recurrent weight matrix of size (NUM_NEURONS * NUM_NEURONS)
- *   - state_pre: The previous reservoir state (size NUM_NEURONS)
- *   - state:   The new updated reservoir state (size NUM_NEURONS)
+ *   - W_in:    Flattened input weight matrix of size (num_neurons * num_inputs)
+ *   - dataIn:  Array of size num_inputs
+ *   - W_x:     Flattened recurrent weight matrix of size (num_neurons * num_neurons)
+ *   - state_pre: The previous reservoir state (size num_neurons)
+ *   - state:   The new updated reservoir state (size num_neurons)
  */
-void update_state(const float *W_in,
+void update_state(const esn_model_t *m,
+                  const float *W_in,
                   const float *dataIn,
                   const float *W_x,
                   const float *state_pre,
                   float *state);
 
+/*
+ * update_state_projected()
+ *   - input_proj: precomputed W_in * dataIn (size num_neurons)
+ *   - W_x, state_pre, state: as for update_state()
+ *   Recurrent part of update_state() only, used when the chunk's input
+ *   projection was computed up front with esn_gemm().
+ */
+void update_state_projected(const esn_model_t *m,
+                            const float *input_proj,
+                            const float *W_x,
+                            const float *state_pre,
+                            float *state);
+
+/*
+ * update_state_block()
+ *   update_state_projected() for count consecutive samples of one chunk:
+ *   - input_proj: count projections, sample s at input_proj[s * num_neurons]
+ *   - state_pre:  state before the first sample
+ *   - states:     count new states, sample s at states[s * num_neurons]
+ *   Reservoirs one or two vectors wide (up to 8 neurons on NEON) keep W_x
+ *   in registers for the whole block, with the tanh tier inlined.
+ */
+void update_state_block(const esn_model_t *m,
+                        const float *input_proj,
+                        const float *W_x,
+                        const float *state_pre,
+                        int count,
+                        float *states);
+
+/*
+ * update_state_block_half()
+ *   update_state_block() with W_x stored in fmt (ESN_WEIGHTS_FP16 or
+ *   ESN_WEIGHTS_BF16). The register-resident kernel widens W_x once per
+ *   block, so its sample loop is the fp32 one.
+ */
+void update_state_block_half(const esn_model_t *m,
+                             esn_weight_format_t fmt,
+                             const float *input_proj,
+                             const uint16_t *W_x,
+                             const float *state_pre,
+                             int count,
+                             float *states);
+
 /*
  * form_state_extended()
- *   - dataIn:  input vector (size NUM_INPUTS)
- *   - state:   reservoir state (size NUM_NEURONS)
- *   - state_extended: an output array of size (NUM_NEURONS + NUM_INPUTS)
+ *   - dataIn:  input vector (size num_inputs)
+ *   - state:   reservoir state (size num_neurons)
+ *   - state_extended: an output array of size extended_size
  *       which combines (state + input) for computing output layer
  */
-void form_state_extended(const float *dataIn,
+void form_state_extended(const esn_model_t *m,
+                         const float *dataIn,
                          const float *state,
                          float *state_extended);
 
 /*
  * compute_output()
  *   - W_out:  Flattened output weight matrix of size:
- *             (output_dim * (NUM_INPUTS + NUM_NEURONS))
- *             If your ESN’s output is 4 floats, that means 4 * (NUM_INPUTS + NUM_NEURONS).
- *   - state_extended: The extended state array (size NUM_INPUTS + NUM_NEURONS)
+ *             (num_outputs * extended_size)
+ *             If your ESN’s output is 4 floats, that means 4 * (num_inputs + num_neurons).
+ *   - state_extended: The extended state array (size extended_size)
  *   - data_out: The ESN's output vector
  *       (size is however many output neurons you have, e.g., 4).
  */
-void compute_output(const float *W_out,
+void compute_output(const esn_model_t *m,
+                    const float *W_out,
                     const float *state_extended,
                     float *data_out);
 
+/*
+ * compute_output_split()
+ *   Same as compute_output() on [state; dataIn], but reads the reservoir
+ *   state and the input in place instead of from state_extended.
+ */
+void compute_output_split(const esn_model_t *m,
+                          const float *W_out,
+                          const float *state,
+                          const float *dataIn,
+                          float *data_out);
+
+/*
+ * esn_step()
+ *   Fused single-pass ESN step: new state (size num_neurons) and output
+ *   (size num_outputs) for one sample, with no state_extended copy.
+ *   Matches update_state() + form_state_extended() + compute_output().
+ *   Runs the kernel esn_select_kernels() picked for m.
+ */
+void esn_step(const esn_model_t *m,
+              const float *W_in,
+              const float *W_x,
+              const float *W_out,
+              const float *dataIn,
+              const float *state_pre,
+              float *state,
+              float *data_out);
+
+/*
+ * esn_step_half()
+ *   esn_step() with W_in and W_x stored in fmt (ESN_WEIGHTS_FP16 or
+ *   ESN_WEIGHTS_BF16, see esn_half.h). W_out is read from W_out_half in the
+ *   same format, or from the fp32 W_out when W_out_half is NULL (while RLS
+ *   training is changing it every sample). Accumulation stays in fp32.
+ *   Runs the m->step_half kernel for the format pair.
+ */
+void esn_step_half(const esn_model_t *m,
+                   esn_weight_format_t fmt,
+                   const uint16_t *W_in,
+                   const uint16_t *W_x,
+                   const uint16_t *W_out_half,
+                   const float *W_out,
+                   const float *dataIn,
+                   const float *state_pre,
+                   float *state,
+                   float *data_out);
+
 float compute_mse(const float *predicted,
 				  const float *golden,
 				  int length);
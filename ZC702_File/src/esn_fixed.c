@@ -0,0 +1,284 @@
+/*******************************************************************************
+ * File: esn_fixed.c
+ *
+ *   Description:
+ *     Q15/Q31 fixed-point version of the ESN inference step for targets
+ *     without an FPU. Weights are quantized once at load time with a
+ *     power-of-two scale per matrix, so rescaling is just a shift. The
+ *     reservoir state stays in Q15 between samples.
+ *
+ ******************************************************************************/
+
+#include "esn_fixed.h"
+#include "esn_model.h"
+#include <math.h>
+
+/*
+ * Quantized weights (allocated from the model arena) and their scales
+ * (value = q * 2^(exp - 15))
+ */
+static const esn_model_t *model = NULL;
+static int16_t *w_in_q = NULL;
+static int16_t *w_x_q = NULL;
+static int16_t *w_out_q = NULL;
+static int w_in_exp = 0;
+static int w_x_exp = 0;
+static int w_out_exp = 0;
+
+/* Current input sample, reservoir state and previous state (Q15) */
+static int16_t *x_q = NULL;
+static int16_t *state_q = NULL;
+static int16_t *state_pre_q = NULL;
+
+/* Shift from a dot_q15() result with scale exponent 0 to Q16.16 */
+#define ACC_SHIFT (14 - ESN_FIXED_GUARD_BITS)
+
+/* Q15 tanh(-8 + i/16), i = 0 .. ESN_FIXED_TANH_SIZE */
+static const int16_t tanh_q15[ESN_FIXED_TANH_SIZE + 1] = {
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32766, -32766, -32766, -32766, -32765,
+    -32765, -32765, -32764, -32764, -32763, -32762, -32762, -32761,
+    -32760, -32759, -32758, -32756, -32755, -32753, -32751, -32749,
+    -32746, -32743, -32740, -32736, -32732, -32727, -32721, -32715,
+    -32708, -32700, -32691, -32681, -32670, -32657, -32642, -32625,
+    -32606, -32584, -32560, -32532, -32501, -32466, -32426, -32381,
+    -32329, -32271, -32206, -32132, -32048, -31953, -31846, -31726,
+    -31589, -31435, -31262, -31067, -30847, -30600, -30322, -30010,
+    -29660, -29268, -28830, -28341, -27797, -27191, -26519, -25776,
+    -24956, -24054, -23066, -21986, -20813, -19542, -18173, -16706,
+    -15143, -13486, -11743,  -9919,  -8025,  -6073,  -4075,  -2045,
+         0,   2045,   4075,   6073,   8025,   9919,  11743,  13486,
+     15143,  16706,  18173,  19542,  20813,  21986,  23066,  24054,
+     24956,  25776,  26519,  27191,  27797,  28341,  28830,  29268,
+     29660,  30010,  30322,  30600,  30847,  31067,  31262,  31435,
+     31589,  31726,  31846,  31953,  32048,  32132,  32206,  32271,
+     32329,  32381,  32426,  32466,  32501,  32532,  32560,  32584,
+     32606,  32625,  32642,  32657,  32670,  32681,  32691,  32700,
+     32708,  32715,  32721,  32727,  32732,  32736,  32740,  32743,
+     32746,  32749,  32751,  32753,  32755,  32756,  32758,  32759,
+     32760,  32761,  32762,  32762,  32763,  32764,  32764,  32765,
+     32765,  32765,  32766,  32766,  32766,  32766,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767
+};
+
+/* Saturating 32-bit add */
+static inline int32_t sat_add32(int32_t a, int32_t b)
+{
+    int32_t s = (int32_t)((uint32_t)a + (uint32_t)b);
+
+    /* Overflow iff a and b have the same sign and s does not */
+    if (((a ^ s) & (b ^ s)) < 0) {
+        s = (a < 0) ? INT32_MIN : INT32_MAX;
+    }
+    return s;
+}
+
+/*
+ * Rescale by 2^shift: saturating left shift for shift > 0, rounding
+ * arithmetic right shift for shift < 0.
+ */
+static inline int32_t shift_sat(int32_t v, int shift)
+{
+    if (shift >= 0) {
+        if (shift > 30) {
+            shift = 30;
+        }
+        if (v > (INT32_MAX >> shift)) {
+            return INT32_MAX;
+        }
+        if (v < (INT32_MIN >> shift)) {
+            return INT32_MIN;
+        }
+        return v * (1 << shift);
+    }
+
+    shift = -shift;
+    if (shift > 31) {
+        return 0;
+    }
+    return (int32_t)(((int64_t)v + ((int64_t)1 << (shift - 1))) >> shift);
+}
+
+/*
+ * Saturating Q15 x Q15 dot product into a Q31 accumulator. Each product
+ * (at most 2^30) is rounded down by ESN_FIXED_GUARD_BITS first, so the sum
+ * of up to 2^GUARD products can grow past the largest single product
+ * before the accumulator clips.
+ */
+static int32_t dot_q15(const int16_t *a, const int16_t *x, int n)
+{
+    const int32_t half = 1 << (ESN_FIXED_GUARD_BITS - 1);
+    int32_t acc = 0;
+
+    for (int j = 0; j < n; j++) {
+        int32_t p = ((int32_t)a[j] * x[j] + half) >> ESN_FIXED_GUARD_BITS;
+        acc = sat_add32(acc, p);
+    }
+    return acc;
+}
+
+int esn_fixed_exponent(const float *v, int n)
+{
+    float max_abs = 0.0f;
+    int exp = 0;
+
+    for (int i = 0; i < n; i++) {
+        float a = fabsf(v[i]);
+        if (a > max_abs) {
+            max_abs = a;
+        }
+    }
+    if (max_abs > 0.0f) {
+        frexpf(max_abs, &exp);  /* max_abs = f * 2^exp, 0.5 <= f < 1 */
+    }
+    return exp;
+}
+
+void esn_fixed_quantize(const float *v, int n, int exp, int16_t *q)
+{
+    float scale = ldexpf(1.0f, 15 - exp);
+
+    for (int i = 0; i < n; i++) {
+        float s = v[i] * scale;
+        int32_t r = (int32_t)(s < 0.0f ? s - 0.5f : s + 0.5f);
+        if (r > INT16_MAX) {
+            r = INT16_MAX;
+        }
+        if (r < -INT16_MAX) {
+            r = -INT16_MAX;
+        }
+        q[i] = (int16_t)r;
+    }
+}
+
+int esn_fixed_configure(const esn_model_t *m)
+{
+    model = m;
+    w_in_q = esn_arena_alloc(sizeof(int16_t) * m->num_neurons * m->num_inputs);
+    w_x_q = esn_arena_alloc(sizeof(int16_t) * m->num_neurons * m->num_neurons);
+    w_out_q = esn_arena_alloc(sizeof(int16_t) * m->num_outputs *
+                              m->extended_size);
+    x_q = esn_arena_alloc(sizeof(int16_t) * m->num_inputs);
+    state_q = esn_arena_alloc(sizeof(int16_t) * m->num_neurons);
+    state_pre_q = esn_arena_alloc(sizeof(int16_t) * m->num_neurons);
+    w_in_exp = 0;
+    w_x_exp = 0;
+    w_out_exp = 0;
+
+    if (w_in_q == NULL || w_x_q == NULL || w_out_q == NULL || x_q == NULL ||
+        state_q == NULL || state_pre_q == NULL) {
+        model = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void esn_fixed_load_w_in(const float *W_in)
+{
+    int n = model->num_neurons * model->num_inputs;
+
+    w_in_exp = esn_fixed_exponent(W_in, n);
+    esn_fixed_quantize(W_in, n, w_in_exp, w_in_q);
+}
+
+void esn_fixed_load_w_x(const float *W_x)
+{
+    int n = model->num_neurons * model->num_neurons;
+
+    w_x_exp = esn_fixed_exponent(W_x, n);
+    esn_fixed_quantize(W_x, n, w_x_exp, w_x_q);
+}
+
+void esn_fixed_load_w_out(const float *W_out)
+{
+    int n = model->num_outputs * model->extended_size;
+
+    w_out_exp = esn_fixed_exponent(W_out, n);
+    esn_fixed_quantize(W_out, n, w_out_exp, w_out_q);
+}
+
+int16_t esn_fixed_tanh(int32_t x_q16)
+{
+    const int32_t range = 8 << 16;
+
+    /* Table interval is 1/16, i.e. 2^12 in Q16.16 */
+    if (x_q16 <= -range) {
+        return tanh_q15[0];
+    }
+    if (x_q16 >= range) {
+        return tanh_q15[ESN_FIXED_TANH_SIZE];
+    }
+
+    int32_t pos = x_q16 + range;
+    int idx = pos >> 12;
+    int32_t frac = pos & 0xFFF;
+    int32_t lo = tanh_q15[idx];
+    int32_t hi = tanh_q15[idx + 1];
+
+    return (int16_t)(lo + (((hi - lo) * frac + 2048) >> 12));
+}
+
+void esn_fixed_set_state(const float *state)
+{
+    esn_fixed_quantize(state, model->num_neurons, 0, state_q);
+}
+
+void esn_fixed_get_state(float *state)
+{
+    for (int i = 0; i < model->num_neurons; i++) {
+        state[i] = (float)state_q[i] * (1.0f / 32768.0f);
+    }
+}
+
+void esn_fixed_step(const float *dataIn, int in_exp, int32_t *data_out_q)
+{
+    const int n = model->num_neurons;
+    const int n_in = model->num_inputs;
+    const int n_out = model->num_outputs;
+    const int ext = model->extended_size;
+    int16_t *s_pre_q = state_q;
+    int16_t *s_q = state_pre_q;
+
+    /* The new state goes in the other buffer: swap the two for next time */
+    state_q = s_q;
+    state_pre_q = s_pre_q;
+
+    /* Inputs at the chunk's scale; the previous state is already Q15 */
+    esn_fixed_quantize(dataIn, n_in, in_exp, x_q);
+
+    /*
+     * state = tanh(W_in*dataIn + W_x*state_pre). A dot product of two Q15
+     * vectors with scales ea and eb is value * 2^(30 - GUARD - ea - eb), so
+     * the shift to Q16.16 is (ea + eb - ACC_SHIFT).
+     */
+    for (int i = 0; i < n; i++) {
+        int32_t u = dot_q15(&w_in_q[i * n_in], x_q, n_in);
+        int32_t r = dot_q15(&w_x_q[i * n], s_pre_q, n);
+        int32_t pre = sat_add32(shift_sat(u, w_in_exp + in_exp - ACC_SHIFT),
+                                shift_sat(r, w_x_exp - ACC_SHIFT));
+
+        s_q[i] = esn_fixed_tanh(pre);
+    }
+
+    /*
+     * data_out = [W_out_state | W_out_input] * [state; dataIn], with the
+     * two halves at different scales, so they are accumulated separately.
+     */
+    for (int k = 0; k < n_out; k++) {
+        const int16_t *w = &w_out_q[k * ext];
+        int32_t ys = dot_q15(w, s_q, n);
+        int32_t yi = dot_q15(&w[n], x_q, n_in);
+
+        data_out_q[k] = sat_add32(shift_sat(ys, w_out_exp - ACC_SHIFT),
+                                  shift_sat(yi, w_out_exp + in_exp - ACC_SHIFT));
+    }
+}
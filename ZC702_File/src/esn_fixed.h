@@ -0,0 +1,92 @@
+#ifndef ESN_FIXED_H
+#define ESN_FIXED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esn_core.h"
+#include <stdint.h>
+
+/*
+ * Fixed-point ESN inference for targets without an FPU (e.g. MicroBlaze
+ * built from platform_mb.c). Build with -DESN_FIXED_POINT to make
+ * run_esn_calculation() use it whenever RLS training is off; training
+ * itself stays in float.
+ *
+ * Number formats:
+ *   - Weights and inputs: Q15 with a power-of-two scale per matrix (or per
+ *     chunk for the inputs), value = q * 2^(exp - 15).
+ *   - MACs: Q31 accumulators with saturating adds and 8 guard bits.
+ *   - Pre-activations and outputs: Q16.16.
+ *   - Reservoir state: Q15 (tanh output in (-1, 1)), kept here from one
+ *     sample to the next.
+ * Floats only cross at the edges: each input sample is quantized once,
+ * the output is handed back in Q16.16, and the state is exchanged with
+ * the float path once per chunk (esn_fixed_set_state/get_state).
+ */
+
+/* Accumulator headroom: products are pre-shifted so 2^8 of them can add up */
+#define ESN_FIXED_GUARD_BITS 8
+
+/* Q15 tanh table: ESN_FIXED_TANH_SIZE intervals over [-8, 8] */
+#define ESN_FIXED_TANH_SIZE  256
+
+/*
+ * esn_fixed_exponent()
+ *   Smallest power-of-two exponent e with max|v| < 2^e, i.e. the scale that
+ *   maps v onto the full Q15 range.
+ */
+int esn_fixed_exponent(const float *v, int n);
+
+/*
+ * esn_fixed_quantize()
+ *   q[i] = round(v[i] * 2^(15 - exp)), saturated to int16.
+ */
+void esn_fixed_quantize(const float *v, int n, int exp, int16_t *q);
+
+/*
+ * esn_fixed_configure()
+ *   Allocate the Q15 weight, input and state buffers for model m from the
+ *   model arena. Returns 0 on success, -1 if the arena is too small.
+ */
+int esn_fixed_configure(const esn_model_t *m);
+
+/*
+ * esn_fixed_load_w_in / w_x / w_out
+ *   Quantize a weight matrix to Q15 and compute its scale. Call when the
+ *   matrix is loaded (and again after RLS has changed W_out).
+ */
+void esn_fixed_load_w_in(const float *W_in);
+void esn_fixed_load_w_x(const float *W_x);
+void esn_fixed_load_w_out(const float *W_out);
+
+/*
+ * esn_fixed_tanh()
+ *   Q16.16 in, Q15 out, table lookup with linear interpolation.
+ */
+int16_t esn_fixed_tanh(int32_t x_q16);
+
+/*
+ * esn_fixed_set_state / esn_fixed_get_state
+ *   Copy the reservoir state (size num_neurons) in from the float path,
+ *   quantized to Q15, or back out to it.
+ */
+void esn_fixed_set_state(const float *state);
+void esn_fixed_get_state(float *state);
+
+/*
+ * esn_fixed_step()
+ *   Fixed-point equivalent of esn_step() on the loaded Q15 weights, from
+ *   and to the Q15 state held here.
+ *   - dataIn:      input vector (size num_inputs), quantized on entry
+ *   - in_exp:      input scale from esn_fixed_exponent() (one per chunk)
+ *   - data_out_q:  ESN output in Q16.16 (size num_outputs)
+ */
+void esn_fixed_step(const float *dataIn, int in_exp, int32_t *data_out_q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_FIXED_H */
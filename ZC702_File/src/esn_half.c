@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * File: esn_half.c
+ *
+ *   Description:
+ *     fp32 -> fp16 / bf16 conversion for the reduced-precision weight
+ *     storage mode. Runs once when weights are loaded (or after RLS has
+ *     changed W_out), so it is plain portable C.
+ *
+ ******************************************************************************/
+
+#include "esn_half.h"
+#include <math.h>
+
+const char *esn_weight_format_name(esn_weight_format_t fmt)
+{
+    switch (fmt) {
+    case ESN_WEIGHTS_FP16:
+        return "fp16";
+    case ESN_WEIGHTS_BF16:
+        return "bf16";
+    default:
+        return "fp32";
+    }
+}
+
+uint16_t esn_float_to_fp16(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+
+    uint16_t sign = (uint16_t)((u >> 16) & 0x8000);
+    uint32_t a = u & 0x7FFFFFFF;
+
+    if (a > 0x7F800000) {
+        return sign | 0x7E00;                 /* NaN */
+    }
+    if (a >= 0x477FF000) {
+        return sign | 0x7BFF;                 /* would round past 65504 */
+    }
+    if (a < 0x38800000) {
+        /* Below 2^-14: fp16 subnormal, in units of 2^-24 */
+        if (a < 0x33000000) {
+            return sign;
+        }
+        return sign | (uint16_t)lrintf(fabsf(f) * 16777216.0f);
+    }
+
+    /* Normal: rebias the exponent (127 -> 15), round off 13 mantissa bits */
+    uint32_t r = a - 0x38000000;
+    r += 0x0FFF + ((r >> 13) & 1);
+    return sign | (uint16_t)(r >> 13);
+}
+
+uint16_t esn_float_to_bf16(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+
+    if ((u & 0x7FFFFFFF) > 0x7F800000) {
+        return (uint16_t)((u >> 16) | 0x0040);  /* keep NaN quiet */
+    }
+    u += 0x7FFF + ((u >> 16) & 1);
+    return (uint16_t)(u >> 16);
+}
+
+void esn_convert_weights(const float *src, int n, esn_weight_format_t fmt,
+                         uint16_t *dst)
+{
+    if (fmt == ESN_WEIGHTS_BF16) {
+        for (int i = 0; i < n; i++) {
+            dst[i] = esn_float_to_bf16(src[i]);
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            dst[i] = esn_float_to_fp16(src[i]);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef ESN_HALF_H
+#define ESN_HALF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Storage formats for the inference weights (W_in, W_x, W_out). The
+ * reduced-precision formats halve the bytes streamed per sample; the GEMV
+ * kernels widen them to fp32 on load and accumulate in fp32.
+ *   - ESN_WEIGHTS_FP32: IEEE single (default)
+ *   - ESN_WEIGHTS_FP16: IEEE half, 11-bit significand, |w| <= 65504
+ *   - ESN_WEIGHTS_BF16: bfloat16, 8-bit significand, fp32 range
+ */
+typedef enum {
+    ESN_WEIGHTS_FP32 = 0,
+    ESN_WEIGHTS_FP16,
+    ESN_WEIGHTS_BF16
+} esn_weight_format_t;
+
+/* Returns "fp32", "fp16" or "bf16" */
+const char *esn_weight_format_name(esn_weight_format_t fmt);
+
+/*
+ * esn_float_to_fp16() / esn_float_to_bf16()
+ *   Round to nearest even. fp16 saturates to +/-65504 instead of
+ *   overflowing to infinity.
+ */
+uint16_t esn_float_to_fp16(float f);
+uint16_t esn_float_to_bf16(float f);
+
+/*
+ * esn_convert_weights()
+ *   dst[i] = src[i] in fmt (ESN_WEIGHTS_FP16 or ESN_WEIGHTS_BF16).
+ */
+void esn_convert_weights(const float *src, int n, esn_weight_format_t fmt,
+                         uint16_t *dst);
+
+/* Widening back to fp32 (exact), for the scalar kernel paths */
+static inline float esn_bf16_to_float(uint16_t h)
+{
+    uint32_t u = (uint32_t)h << 16;
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline float esn_fp16_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t u;
+    float f;
+
+    if (exp == 0x1F) {
+        u = sign | 0x7F800000 | (mant << 13);           /* inf / NaN */
+    } else if (exp != 0) {
+        u = sign | ((exp + 112) << 23) | (mant << 13);  /* rebias 15 -> 127 */
+    } else {
+        f = (float)mant * (1.0f / 16777216.0f);         /* subnormal: m * 2^-24 */
+        return sign ? -f : f;
+    }
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_HALF_H */
@@ -4,37 +4,66 @@
  * Date: 04-01-2025
  *
  * Description:
- *	   Store files sent over Ethernet in a 1MB buffer (from 3MB file buffer),
- *	   parse the file's floating-point values, and run the ESN core.
+ *	   Decode files sent over Ethernet as they arrive (esn_parse.h), straight
+ *	   into their destination arrays, and run the ESN core. A connection
+ *	   carries any number of messages back to back, each a 16-byte header
+ *	   followed by exactly file_size payload bytes.
  *
  *   Expected Files:
+ *     - MODEL (optional, sizes every buffer below; send first)
  *     - DATAIN
- *     - WIN
- *     - WX
+ *     - WIN (dense, or WIN_COO_ sparse triplets)
+ *     - WX (dense, or WX_COO__ sparse triplets)
  *     - WOUT
  *     - GOLDEN SOLUTION
+ *     - CMD_____ (payload is a command-port command, run in stream order)
  *
  ******************************************************************************/
 
 #include "esn_main.h"
-
-/* Global/Static variables local to this file */
-static char file_buffer[MAX_FILE_SIZE];
-static unsigned int file_offset = 0;
-static unsigned int expected_file_size = 0;
-static int expecting_header = 1;
+#include "tcp_command.h"
+#include "xtime_l.h"
+
+/* Receive state: header bytes, then the payload decoded pbuf by pbuf */
+typedef enum {
+    RX_HEADER = 0,      // collecting the 16-byte header
+    RX_PAYLOAD          // decoding payload_left more bytes
+} rx_state_t;
+
+static rx_state_t rx_state = RX_HEADER;
+static struct tcp_pcb *rx_pcb = NULL;          // connection being served
+static file_header_t rx_header;
+static unsigned int header_bytes = 0;
+static unsigned int payload_left = 0;
+static esn_float_stream_t rx_stream;
+static float model_fields[ESN_MODEL_FIELDS];  // MODEL___ is decoded here
+static int rx_command = 0;                     // payload is CMD_____ text
+static char cmd_text[CMD_BUF_SIZE];
+static unsigned int cmd_len = 0;
 //static int global_data_in_samples = 0;
 
-/* Arrays for ESN Equations */
-static float w_in[WIN_MAX];
-static float w_x[WX_MAX];
-static float w_out[WOUT_MAX];
-static float golden_data_out[DATA_OUT_MAX];
+/* Active model; every array below is sized from it by esn_apply_model() */
+static const esn_model_t *model = NULL;
+
+/*
+ * Arrays for ESN Equations (allocated from the model arena). Dense W_in
+ * and W_x are stored in weight_format only: here when it is fp32, in
+ * w_in_h/w_x_h otherwise. W_out lives in rls_training.c.
+ */
+static float *w_in = NULL;
+static float *w_x = NULL;
+static float *golden_data_out = NULL;
 static int golden_sample_count = 0;
 
 static float *data_in = NULL;
 static int data_in_count = 0;  // Total number of floats parsed
 
+/* CSR copies of W_in/W_x, and whether the ESN runs on them (esn_sparse.h) */
+static esn_csr_t w_in_csr;
+static esn_csr_t w_x_csr;
+static int w_in_sparse = 0;
+static int w_x_sparse = 0;
+
 /* Flags to track readiness */
 static int w_in_ready = 0;
 static int w_x_ready = 0;
@@ -42,7 +71,58 @@ static int w_x_ready = 0;
 static int golden_data_out_ready = 0;
 
 // Keep state_pre consistent between chunks
-static float state_pre[NUM_NEURONS] = {0};
+static float *state_pre = NULL;
+
+// Extended state handed to RLS (arena, too big for the stack at 2048 neurons)
+static float *z_scratch = NULL;
+// One sample's new state and output (arena, sized from the model)
+static float *res_state_buf = NULL;
+static float *data_out_buf = NULL;
+#ifdef ESN_FIXED_POINT
+static int32_t *data_out_q_buf = NULL; // Q16.16 output of esn_fixed_step()
+#endif
+
+// Batched mode: W_in*dataIn for a block of samples is computed up front
+static int batched_mode = 0;
+static float *input_proj = NULL;
+static float *state_seq = NULL;    // the block's reservoir states, in order
+// Batched inference (training off): extended states and outputs per block
+static float *state_block = NULL;
+static float *output_block = NULL;
+
+// Streaming mode: DATAIN samples are stepped as soon as they have arrived
+static int stream_mode = 0;
+static int stream_active = 0;      // the DATAIN being received is streamed
+static int stream_samples = 0;     // samples of it stepped so far
+
+// Kernels and error totals of the chunk being run (esn_chunk_begin())
+static struct {
+    int streamed;
+    int use_sparse;
+    int fixed_point;
+    int in_exp;                    // fixed-point input scale (not streamed)
+    int half;
+    const uint16_t *half_W_out;
+    int batched;
+    int batched_output;
+    float total_mse;
+    int samples_compared;
+} chunk;
+
+// Fixed-point builds: W_out must be re-quantized after it changes
+static int w_out_q_stale = 1;
+
+// fp16/bf16 weights: W_in/W_x themselves, and an inference copy of
+// W_out (training keeps updating the fp32 one)
+static esn_weight_format_t weight_format = ESN_WEIGHTS_FP32;
+static uint16_t *w_in_h = NULL;
+static uint16_t *w_x_h = NULL;
+static uint16_t *w_out_h = NULL;
+static int w_out_h_stale = 1;
+// Storage behind w_in/w_in_h and w_x/w_x_h, and whether it holds fp32
+static void *w_in_mem = NULL;
+static void *w_x_mem = NULL;
+static int w_mem_fp32 = 0;
 
 // Performance metrics to keep consistent
 static float cumulative_mse     = 0.0f;
@@ -52,10 +132,168 @@ static int total_samples_processed = 0;    // cumulative sample count
 ///* Init function to reset global state */
 void tcp_file_init(void)
 {
-    memset(file_buffer, 0, sizeof(file_buffer));
-    file_offset = 0;
-    expected_file_size = 0;
-    expecting_header = 1;
+    rx_state = RX_HEADER;
+    header_bytes = 0;
+    payload_left = 0;
+    stream_active = 0;
+}
+
+/*
+ * Point w_in/w_x (fp32) or w_in_h/w_x_h (fp16/bf16) at storage for a dense
+ * model's W_in and W_x in format fmt. fp32 storage is only allocated once
+ * fmt is fp32; the half formats reuse whatever storage there is. The
+ * contents are not converted, see refresh_dense_weights().
+ */
+static int set_dense_storage(const esn_model_t *m, esn_weight_format_t fmt)
+{
+    const int fp32 = (fmt == ESN_WEIGHTS_FP32);
+
+    if (w_in_mem == NULL || (fp32 && !w_mem_fp32)) {
+        size_t elem = fp32 ? sizeof(float) : sizeof(uint16_t);
+        void *in = esn_arena_alloc(elem * WIN_MAX(m));
+        void *x = esn_arena_alloc(elem * WX_MAX(m));
+
+        if (in == NULL || x == NULL) {
+            return -1;
+        }
+        w_in_mem = in;
+        w_x_mem = x;
+        w_mem_fp32 = fp32;
+    }
+    if (!fp32 && w_out_h == NULL) {
+        w_out_h = esn_arena_alloc(sizeof(uint16_t) * WOUT_MAX(m));
+        if (w_out_h == NULL) {
+            return -1;
+        }
+    }
+    w_in = fp32 ? w_in_mem : NULL;
+    w_x = fp32 ? w_x_mem : NULL;
+    w_in_h = fp32 ? NULL : w_in_mem;
+    w_x_h = fp32 ? NULL : w_x_mem;
+    return 0;
+}
+
+/* Carve every model-sized buffer (ours, RLS and fixed-point) from the arena */
+static int allocate_model_buffers(const esn_model_t *m)
+{
+    int sparse_model = (m->max_row_nnz > 0);
+
+    esn_arena_reset();
+
+    /* Sparse models keep W_in/W_x in CSR form only */
+    if (sparse_model) {
+        int in_nnz = (m->max_row_nnz < m->num_inputs) ? m->max_row_nnz
+                                                      : m->num_inputs;
+        int x_nnz = (m->max_row_nnz < m->num_neurons) ? m->max_row_nnz
+                                                      : m->num_neurons;
+        w_in = NULL;
+        w_x = NULL;
+        w_in_h = NULL;
+        w_x_h = NULL;
+        w_out_h = NULL;
+        w_in_mem = NULL;
+        w_x_mem = NULL;
+        if (esn_csr_alloc(&w_in_csr, m->num_neurons, m->num_inputs,
+                          m->num_neurons * in_nnz) != 0 ||
+            esn_csr_alloc(&w_x_csr, m->num_neurons, m->num_neurons,
+                          m->num_neurons * x_nnz) != 0) {
+            return -1;
+        }
+    }
+    else {
+        w_in_mem = NULL;
+        w_x_mem = NULL;
+        w_out_h = NULL;
+        if (set_dense_storage(m, weight_format) != 0 ||
+            esn_csr_alloc(&w_in_csr, m->num_neurons, m->num_inputs,
+                          WIN_MAX(m)) != 0 ||
+            esn_csr_alloc(&w_x_csr, m->num_neurons, m->num_neurons,
+                          WX_MAX(m)) != 0) {
+            return -1;
+        }
+    }
+    golden_data_out = esn_arena_alloc(sizeof(float) * DATA_OUT_MAX(m));
+    state_pre = esn_arena_alloc(sizeof(float) * m->num_neurons);
+    z_scratch = esn_arena_alloc(sizeof(float) * m->extended_size);
+    res_state_buf = esn_arena_alloc(sizeof(float) * m->num_neurons);
+    data_out_buf = esn_arena_alloc(sizeof(float) * m->num_outputs);
+    input_proj = esn_arena_alloc(sizeof(float) * ESN_BATCH_SAMPLES *
+                                 m->num_neurons);
+    state_seq = esn_arena_alloc(sizeof(float) * ESN_BATCH_SAMPLES *
+                                m->num_neurons);
+    state_block = esn_arena_alloc(sizeof(float) * ESN_BATCH_SAMPLES *
+                                  m->extended_size);
+    output_block = esn_arena_alloc(sizeof(float) * ESN_BATCH_SAMPLES *
+                                   m->num_outputs);
+    if (!golden_data_out || !state_pre || !z_scratch ||
+        !res_state_buf || !data_out_buf || !input_proj || !state_seq ||
+        !state_block || !output_block) {
+        return -1;
+    }
+
+    if (rls_configure(m) != 0) {
+        return -1;
+    }
+#ifdef ESN_FIXED_POINT
+    /* Fixed-point inference quantizes the dense matrices only */
+    data_out_q_buf = esn_arena_alloc(sizeof(int32_t) * m->num_outputs);
+    if (data_out_q_buf == NULL ||
+        (!sparse_model && esn_fixed_configure(m) != 0)) {
+        return -1;
+    }
+#endif
+    /* Ridge training allocates its ext^2/2 matrix on RIDGE_ON */
+    ridge_configure(m);
+    return 0;
+}
+
+/*
+ * Switch to model m: reallocate every buffer for its sizes and clear all
+ * loaded weights, golden data and state (they no longer fit). Falls back to
+ * the default model if m does not fit in the arena.
+ */
+int esn_apply_model(const esn_model_t *m)
+{
+    int status = 0;
+
+    esn_model_set(m);
+    model = esn_model_get();
+    if (allocate_model_buffers(model) != 0) {
+        esn_model_t defaults;
+
+        xil_printf("Error: model does not fit, reverting to defaults.\n\r");
+        esn_model_defaults(&defaults);
+        esn_model_set(&defaults);
+        model = esn_model_get();
+        allocate_model_buffers(model);
+        status = -1;
+    }
+
+    /* Freshly allocated buffers are zeroed: nothing is loaded yet */
+    w_in_ready = 0;
+    w_x_ready = 0;
+    w_in_sparse = 0;
+    w_x_sparse = 0;
+    golden_data_out_ready = 0;
+    golden_sample_count = 0;
+    w_out_q_stale = 1;
+    w_out_h_stale = 1;
+    cumulative_mse     = 0.0f;
+    cumulative_samples = 0;
+    total_samples_processed = 0;
+
+    esn_set_activation(model->activation);
+    esn_model_print(model);
+    return status;
+}
+
+/* Start up with the compile-time default model */
+void esn_init(void)
+{
+    esn_model_t defaults;
+
+    esn_model_defaults(&defaults);
+    esn_apply_model(&defaults);
 }
 
 static void print_scientific(float val)
@@ -106,186 +344,629 @@ void print_float_array(const float *arr, int total_count, int max_to_print)
     xil_printf("\n\r");
 }
 
-/* Helper function to read lines or space-delimited values from the buffer and convert to FP values */
+/* Helper function to read whitespace-delimited values from the buffer and convert to FP values */
 int parse_floats_into_array(const char *raw_text,
                                    unsigned int text_len,
                                    float *dest_array,
                                    unsigned int max_count)
 {
-    // Using static buffer instead of malloc() for data_out (heap was overflowing)
-    static char static_buf[MAX_BUFFER_SIZE];
-    if (text_len >= sizeof(static_buf)) {
-        xil_printf("Error: File too large for static buffer.\n\r");
-        return 0;
+    esn_float_stream_t s;
+
+    esn_stream_begin(&s, PAYLOAD_ASCII, dest_array, max_count);
+    esn_stream_feed(&s, raw_text, text_len);
+    return esn_stream_end(&s);
+}
+
+/* Timer ticks (COUNTS_PER_SECOND per second) to microseconds */
+static unsigned int ticks_to_us(XTime ticks)
+{
+    return (unsigned int)((ticks * 1000000ULL) / COUNTS_PER_SECOND);
+}
+
+/* 1 while a file's payload (not a CMD_____ message) is being decoded */
+int esn_upload_pending(void)
+{
+    return rx_state == RX_PAYLOAD && !rx_command;
+}
+
+/* 1 while a DATAIN file is being stepped as it arrives (stream mode) */
+int esn_stream_active(void)
+{
+    return stream_active;
+}
+
+/*
+ * Throughput of the ASCII float parsers on count generated values in the
+ * generator's format ("-1.2345678901234567"): the original strtok/sscanf
+ * loop, strtof, and esn_parse_float via the stream decoder. Uses arena
+ * scratch, where W_in/W_x uploads are staged, so it refuses to run while
+ * a file is arriving.
+ */
+void parse_benchmark(int count)
+{
+    const unsigned int chars = 20;  // sign, digit, point, 16 digits, newline
+    size_t scratch_bytes;
+    char *text = esn_arena_scratch(&scratch_bytes);
+
+    if (esn_upload_pending()) {
+        xil_printf("Error: PARSE_BENCH refused while a file is being "
+                   "received.\n\r");
+        return;
     }
+    if (count <= 0) {
+        count = PARSE_BENCH_VALUES;
+    }
+    // text, a copy for strtok, and three result arrays
+    size_t per_value = 2 * chars + 3 * sizeof(float);
+    if ((size_t)count * per_value + 1 > scratch_bytes) {
+        count = (int)((scratch_bytes - 1) / per_value);
+    }
+    unsigned int len = (unsigned int)count * chars;
+    char *copy = text + len + 1;
+    float *ref = (float *)(((uintptr_t)(copy + len + 1) + 3) & ~(uintptr_t)3);
+    float *val_strtof = ref + count;
+    float *val_fast = val_strtof + count;
+
+    uint32_t seed = 12345;
+    char *p = text;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        *p++ = (seed & 0x80000000u) ? '-' : ' ';
+        *p++ = (char)('0' + (seed >> 8) % 7);
+        *p++ = '.';
+        for (int d = 0; d < 16; d++) {
+            seed = seed * 1664525u + 1013904223u;
+            *p++ = (char)('0' + (seed >> 16) % 10);
+        }
+        *p++ = '\n';
+    }
+    *p = '\0';
+
+    XTime t0, t1, t2, t3;
+    int n_ref = 0, n_strtof = 0;
+
+    // Original parser: copy, strtok on newlines, sscanf("%f") per line
+    XTime_GetTime(&t0);
+    memcpy(copy, text, len + 1);
+    for (char *line = strtok(copy, "\n"); line && n_ref < count;
+         line = strtok(NULL, "\n")) {
+        if (sscanf(line, "%f", &ref[n_ref]) == 1) {
+            n_ref++;
+        }
+    }
+    XTime_GetTime(&t1);
+
+    for (char *q = text, *end; n_strtof < count; q = end) {
+        val_strtof[n_strtof] = strtof(q, &end);
+        if (end == q) {
+            break;
+        }
+        n_strtof++;
+    }
+    XTime_GetTime(&t2);
 
-    memcpy(static_buf, raw_text, text_len);
-    static_buf[text_len] = '\0';  // Null-terminate the buffer
+    int n_fast = parse_floats_into_array(text, len, val_fast, count);
+    XTime_GetTime(&t3);
 
-    unsigned int count = 0;
-    char *line = strtok(static_buf, "\n");
-    while (line && count < max_count) {
-        float val = 0.0f;
-        if (sscanf(line, "%f", &val) == 1) {
-            dest_array[count++] = val;
+    int mismatches = 0;
+    for (int i = 0; i < n_fast && i < n_ref; i++) {
+        if (memcmp(&val_fast[i], &ref[i], sizeof(float)) != 0) {
+            mismatches++;
         }
-        line = strtok(NULL, "\n");
     }
-    return count;
+
+    unsigned int us_ref = ticks_to_us(t1 - t0);
+    unsigned int us_strtof = ticks_to_us(t2 - t1);
+    unsigned int us_fast = ticks_to_us(t3 - t2);
+    xil_printf("Parse benchmark: %d values, %u bytes\n\r", count, len);
+    xil_printf("  strtok+sscanf:   %u us (%u KB/s)\n\r", us_ref,
+               us_ref ? (unsigned int)((len * 1000ULL) / us_ref) : 0);
+    xil_printf("  strtof:          %u us (%u KB/s)\n\r", us_strtof,
+               us_strtof ? (unsigned int)((len * 1000ULL) / us_strtof) : 0);
+    xil_printf("  esn_parse_float: %u us (%u KB/s)\n\r", us_fast,
+               us_fast ? (unsigned int)((len * 1000ULL) / us_fast) : 0);
+    xil_printf("  %d/%d/%d values parsed, %d differ from sscanf\n\r",
+               n_ref, n_strtof, n_fast, mismatches);
 }
 
+/*
+ * Where W_in/W_x files are decoded to: triplets and dense files for sparse
+ * models (no dense buffer) go to arena scratch, which nothing else touches
+ * while the file is arriving. Returns NULL if the matrix cannot fit.
+ */
+static float *reservoir_matrix_dest(int coo, const esn_csr_t *csr,
+                                    float *dense, unsigned int *max_count)
+{
+    unsigned int total = (unsigned int)(csr->rows * csr->cols);
+    size_t scratch_bytes;
+    float *scratch = esn_arena_scratch(&scratch_bytes);
 
+    if (coo) {
+        *max_count = scratch_bytes / sizeof(float);
+        return scratch;
+    }
 
-/* The actual TCP callback function (called in tcp_perf_server.c) */
-err_t tcp_recv_file(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+    if (dense == NULL) {
+        if (scratch_bytes < total * sizeof(float)) {
+            xil_printf("Error: no room to stage a dense %d x %d matrix, "
+                       "send it as triplets.\n\r", csr->rows, csr->cols);
+            return NULL;
+        }
+        dense = scratch;
+    }
+    memset(dense, 0, total * sizeof(float));
+    *max_count = total;
+    return dense;
+}
+
+/*
+ * Finish loading W_in or W_x from the count values decoded into values by
+ * reservoir_matrix_dest(). The matrix always ends up in csr; dense models
+ * also keep it in dense. Returns 0 on success, -1 if it does not fit.
+ */
+static int load_reservoir_matrix(const float *values, unsigned int count,
+                                 int coo, esn_csr_t *csr, float *dense)
 {
-	// If not packet is recieved, connection has been closed by client
-    if (!p) {
-        tcp_close(tpcb);
-        return ERR_OK;
+    if (values == NULL) {
+        return -1;
+    }
+    if (coo) {
+        if (esn_csr_from_coo(csr, values, count) != 0) {
+            return -1;
+        }
+        if (dense != NULL) {
+            esn_csr_to_dense(csr, dense);
+        }
+        return 0;
+    }
+    return esn_csr_from_dense(csr, values);
+}
+
+/*
+ * The exact fp32 values of a dense model's W_in or W_x: the fp32 storage
+ * itself, or its CSR copy expanded into arena scratch when the matrix is
+ * stored in fp16/bf16. NULL if the scratch is too small.
+ */
+static const float *dense_fp32(const esn_csr_t *csr, const float *dense)
+{
+    size_t scratch_bytes;
+    float *scratch;
+
+    if (dense != NULL) {
+        return dense;
+    }
+    scratch = esn_arena_scratch(&scratch_bytes);
+    if (scratch_bytes < sizeof(float) * csr->rows * csr->cols) {
+        xil_printf("Error: no room to expand a %d x %d matrix.\n\r",
+                   csr->rows, csr->cols);
+        return NULL;
     }
+    esn_csr_to_dense(csr, scratch);
+    return scratch;
+}
 
-    // Temp pointer 'q' to iterate through the pbuf chain
-    struct pbuf *q = p;
-    unsigned int bytes_copied = 0; // total number of bytes copied
+/* Store a dense model's W_in or W_x in fp16/bf16, from its CSR copy */
+static void store_half(const esn_csr_t *csr, uint16_t *half)
+{
+    const float *w = dense_fp32(csr, NULL);
 
-    // Loop through all linked pbuf segments (in case packet is chained)
-    while (q) {
-    	// Length of current segment
-        unsigned int copy_len = q->len;
+    if (w != NULL) {
+        esn_convert_weights(w, csr->rows * csr->cols, weight_format, half);
+    }
+}
+
+/*
+ * Sparse models always run W_in/W_x on the CSR kernel; dense models switch
+ * to it when the loaded matrix is at most ESN_SPARSE_MAX_DENSITY full.
+ */
+static int use_csr_kernel(const esn_csr_t *csr, const char *name)
+{
+    float density = esn_csr_density(csr);
+    int sparse = (model->max_row_nnz > 0) || density <= ESN_SPARSE_MAX_DENSITY;
+
+    xil_printf("%s: %d nonzeros (%d%% dense), %s kernel\n\r", name, csr->nnz,
+               (int)(density * 100.0f + 0.5f), sparse ? "CSR" : "dense");
+    return sparse;
+}
+
+/* Chunk runner, shared by run_esn_calculation() and streamed DATAIN files */
+static void esn_chunk_begin(int num_samples, int streamed);
+static void esn_chunk_sample(int sample, int num_samples_in_chunk);
+static void esn_chunk_end(int num_samples_in_chunk);
+
+/*
+ * Header complete: pick where the payload's values go, so they can be
+ * decoded as they arrive. Unknown IDs are decoded and dropped.
+ */
+static void begin_file(void)
+{
+    const char *id = rx_header.file_id;
+    int format = (rx_header.format == PAYLOAD_F32) ? PAYLOAD_F32
+                                                    : PAYLOAD_ASCII;
+    float *dest = NULL;
+    unsigned int max_count = 0;
+
+    // Commands are collected as text and run once complete
+    rx_command = (strncmp(id, "CMD_____", 8) == 0);
+    if (rx_command) {
+        cmd_len = 0;
+        return;
+    }
+
+    char file_id_str[9];
+    memcpy(file_id_str, id, 8);
+    file_id_str[8] = '\0';
+    xil_printf("Header -> ID: %s, Size: %u bytes%s\n\r",
+               file_id_str, (unsigned int)rx_header.file_size,
+               (format == PAYLOAD_F32) ? " (float32)" : "");
 
-        /* Avoid buffer overflow if file is too large */
-        if (file_offset + copy_len > MAX_FILE_SIZE) {
-            copy_len = MAX_FILE_SIZE - file_offset;
+    if (strncmp(id, "MODEL___", 8) == 0) {
+        dest = model_fields;
+        max_count = ESN_MODEL_FIELDS;
+    }
+    else if (strncmp(id, "WIN_____", 8) == 0 ||
+             strncmp(id, "WIN_COO_", 8) == 0) {
+        w_in_ready = 0;
+        dest = reservoir_matrix_dest(id[4] == 'C', &w_in_csr, w_in,
+                                     &max_count);
+    }
+    else if (strncmp(id, "WX______", 8) == 0 ||
+             strncmp(id, "WX_COO__", 8) == 0) {
+        w_x_ready = 0;
+        dest = reservoir_matrix_dest(id[3] == 'C', &w_x_csr, w_x,
+                                     &max_count);
+    }
+    else if (strncmp(id, "WOUT____", 8) == 0) {
+        // Staged in arena scratch: set_W_out() copies it into place
+        size_t scratch_bytes;
+
+        max_count = WOUT_MAX(model);
+        dest = esn_arena_scratch(&scratch_bytes);
+        if (scratch_bytes < sizeof(float) * max_count) {
+            xil_printf("Error: no room to stage W_out.\n\r");
+            dest = NULL;
+            max_count = 0;
+        } else {
+            memset(dest, 0, sizeof(float) * max_count);
+        }
+    }
+    else if (strncmp(id, "DATAIN__", 8) == 0) {
+        // Allocate memory for data_in dynamically (ASCII values take
+        // at least 8 bytes each, float32 exactly 4)
+        max_count = rx_header.file_size /
+            ((format == PAYLOAD_F32) ? sizeof(float) : 8);
+        if (data_in != NULL) {
+            free(data_in);
+        }
+        data_in = (float *)malloc(sizeof(float) * max_count);
+        if (data_in == NULL) {
+            xil_printf("Error: Unable to allocate memory for data_in.\n\r");
+            max_count = 0;
+        }
+        dest = data_in;
+
+        // Streaming: step each sample as soon as all its inputs are here
+        stream_active = stream_mode && data_in != NULL &&
+                        w_in_ready && w_x_ready;
+        stream_samples = 0;
+        if (stream_active) {
+            esn_chunk_begin(0, 1);  // sample count unknown until the end
         }
+    }
+    else if (strncmp(id, "DATAOUT_", 8) == 0) {
+        dest = golden_data_out;
+        max_count = DATA_OUT_MAX(model);
+    }
 
-        // Copy current segment's payload into file buffer at correct offset
-        memcpy(&file_buffer[file_offset], q->payload, copy_len);
+    esn_stream_begin(&rx_stream, format, dest, max_count);
+}
+
+/* Step every streamed DATAIN sample whose inputs have all been decoded */
+static void step_streamed_samples(void)
+{
+    const unsigned int n_in = model->num_inputs;
 
-        // Update buffer with # of bytes copied
-        file_offset += copy_len;
+    while (stream_active && rx_stream.count >= (stream_samples + 1) * n_in) {
+        esn_chunk_sample(stream_samples, stream_samples + 1);
+        stream_samples++;
+    }
+}
+
+/*
+ * data_in is about to be freed: stop decoding or streaming into it. A
+ * streamed chunk is ended as on a closed connection, so the samples
+ * stepped so far are scored and their queued RLS updates flushed.
+ */
+static void rx_drop_data_in(void)
+{
+    if (rx_stream.dest == data_in) {
+        rx_stream.dest = NULL;
+    }
+    if (stream_active) {
+        stream_active = 0;
+        esn_chunk_end(stream_samples);
+    }
+}
 
-        // Accumulate total # of bytes copied
-        bytes_copied += copy_len;
+/* Payload complete: act on the decoded values according to the file ID */
+static void finish_file(void)
+{
+    const char *id = rx_header.file_id;
 
-        // Next pbuf in chain
-        q = q->next;
+    if (rx_command) {
+        cmd_text[cmd_len] = '\0';
+        execute_command(cmd_text);
+        return;
     }
 
-    /* Free pbuf after copying */
-    pbuf_free(p);
+    int count = esn_stream_end(&rx_stream);
+
+    if (strncmp(id, "MODEL___", 8) == 0) {
+        esn_model_t new_model;
 
-    /* Check if we've parsed the header yet */
-    if (expecting_header && file_offset >= HEADER_SIZE) {
-        file_header_t *hdr = (file_header_t*)file_buffer;
-        expected_file_size = hdr->file_size;
-
-        char file_id_str[9];
-        memcpy(file_id_str, hdr->file_id, 8);
-        file_id_str[8] = '\0';
-        xil_printf("Header -> ID: %s, Size: %u bytes\n\r",
-                   file_id_str, expected_file_size);
-
-        expecting_header = 0;
-    }
-
-    /* Check if we've received the full file payload */
-    if (!expecting_header &&
-        file_offset >= (HEADER_SIZE + expected_file_size)) {
-
-        /* Re-interpret the header to get the file ID */
-        file_header_t *hdr = (file_header_t*)file_buffer;
-        char file_id_str[9];
-        memcpy(file_id_str, hdr->file_id, 8);
-        file_id_str[8] = '\0';  // null-terminate
-
-        /*
-         * Now decide what to do based on file ID.
-         */
-        if (strncmp(hdr->file_id, "WIN_____", 8) == 0) {
-            parse_floats_into_array(
-                &file_buffer[HEADER_SIZE],
-                expected_file_size,
-                w_in,
-                WIN_MAX
-            );
+        if (esn_model_from_floats(model_fields, count, &new_model) == 0) {
+            esn_apply_model(&new_model);
+        }
+    }
+    else if (strncmp(id, "WIN_____", 8) == 0 ||
+             strncmp(id, "WIN_COO_", 8) == 0) {
+        if (load_reservoir_matrix(rx_stream.dest, count, id[4] == 'C',
+                                  &w_in_csr, w_in) == 0) {
+            w_in_sparse = use_csr_kernel(&w_in_csr, "W_in");
             w_in_ready = 1;
+            if (w_in_h != NULL) {
+                store_half(&w_in_csr, w_in_h);
+            }
+#ifdef ESN_FIXED_POINT
+            if (w_in_mem != NULL) {
+                const float *w = dense_fp32(&w_in_csr, w_in);
+                if (w != NULL) {
+                    esn_fixed_load_w_in(w);
+                }
+            }
+#endif
         }
-        else if (strncmp(hdr->file_id, "WX______", 8) == 0) {
-            parse_floats_into_array(
-                &file_buffer[HEADER_SIZE],
-                expected_file_size,
-                w_x,
-                WX_MAX
-            );
+    }
+    else if (strncmp(id, "WX______", 8) == 0 ||
+             strncmp(id, "WX_COO__", 8) == 0) {
+        if (load_reservoir_matrix(rx_stream.dest, count, id[3] == 'C',
+                                  &w_x_csr, w_x) == 0) {
+            w_x_sparse = use_csr_kernel(&w_x_csr, "W_x");
             w_x_ready = 1;
-        }
-        else if (strncmp(hdr->file_id, "WOUT____", 8) == 0) {
-        	int parsedCount = parse_floats_into_array(
-                &file_buffer[HEADER_SIZE],
-                expected_file_size,
-                w_out,
-                WOUT_MAX
-            );
-
-            // Optionally check that the expected number of floats was parsed.
-            if (parsedCount != WOUT_MAX) {
-                xil_printf("Warning: Expected %d floats for W_out but parsed %d floats.\n\r", WOUT_MAX, parsedCount);
+            if (w_x_h != NULL) {
+                store_half(&w_x_csr, w_x_h);
+            }
+#ifdef ESN_FIXED_POINT
+            if (w_x_mem != NULL) {
+                const float *w = dense_fp32(&w_x_csr, w_x);
+                if (w != NULL) {
+                    esn_fixed_load_w_x(w);
+                }
             }
+#endif
+        }
+    }
+    else if (strncmp(id, "WOUT____", 8) == 0) {
+        // Optionally check that the expected number of floats was parsed.
+        if (count != WOUT_MAX(model)) {
+            xil_printf("Warning: Expected %d floats for W_out but parsed %d floats.\n\r", WOUT_MAX(model), count);
+        }
+
+        // Use the setter function to update the global W_out matrix.
+        if (rx_stream.dest != NULL) {
+            set_W_out(rx_stream.dest);
+        }
+        w_out_q_stale = 1;
+        w_out_h_stale = 1;
+    }
+    else if (strncmp(id, "DATAIN__", 8) == 0) {
+        if (data_in == NULL) {
+            xil_printf("DATAIN dropped (reset during transfer).\n\r");
+            return;
+        }
+        data_in_count = count;
+        int num_samples = count / model->num_inputs;
+        xil_printf("DATAIN file: parsed %d floats, which is %d sample(s)\n\r", count, num_samples);
+
+        /* RUN ESN (streamed: only the last sample is left) */
+        if (stream_active) {
+            step_streamed_samples();
+            stream_active = 0;
+            esn_chunk_end(num_samples);
+        }
+        else {
+            run_esn_calculation(num_samples);
+        }
+    }
+    else if (strncmp(id, "DATAOUT_", 8) == 0) {
+        golden_sample_count = count / model->num_outputs;
+        xil_printf("Golden DATAOUT file: parsed %d floats, which is %d sample(s)\n\r", count, golden_sample_count);
+        golden_data_out_ready = 1;
+    }
+}
 
-            // Use the setter function to update the global W_out matrix.
-            set_W_out(w_out);
+/*
+ * Feed one pbuf segment through the receive state machine. Nothing is
+ * buffered beyond the header and one partial value (rx_stream), so a file
+ * may be any size and split anywhere, and one segment may end one message
+ * and start the next.
+ * Returns -1 on a header without HEADER_MAGIC (the rest of the segment is
+ * not used), otherwise 0.
+ */
+static int receive_segment(const char *data, unsigned int len)
+{
+    while (len > 0) {
+        if (rx_state == RX_HEADER) {
+            unsigned int n = HEADER_SIZE - header_bytes;
+            if (n > len) {
+                n = len;
+            }
+            memcpy((char *)&rx_header + header_bytes, data, n);
+            header_bytes += n;
+            data += n;
+            len -= n;
+
+            if (header_bytes == HEADER_SIZE) {
+                if (memcmp(rx_header.magic, HEADER_MAGIC,
+                           sizeof(rx_header.magic)) != 0) {
+                    xil_printf("Error: bad message header (no magic), "
+                               "closing the connection.\n\r");
+                    return -1;
+                }
+                begin_file();
+                payload_left = rx_header.file_size;
+                rx_state = RX_PAYLOAD;
+                if (payload_left == 0) {
+                    finish_file();
+                    rx_state = RX_HEADER;
+                    header_bytes = 0;
+                }
+            }
         }
-        else if (strncmp(hdr->file_id, "DATAIN__", 8) == 0) {
-            // Allocate memory for data_in dynamically
-            int max_possible_floats = expected_file_size / 8;
-            if (data_in != NULL) {
-                free(data_in);
+        else {
+            unsigned int n = (len < payload_left) ? len : payload_left;
+            if (rx_command) {
+                // Keep what fits in cmd_text; the rest is skipped
+                unsigned int room = CMD_BUF_SIZE - 1 - cmd_len;
+                unsigned int keep = (n < room) ? n : room;
+                memcpy(&cmd_text[cmd_len], data, keep);
+                cmd_len += keep;
+            }
+            else {
+                esn_stream_feed(&rx_stream, data, n);
+                step_streamed_samples();
             }
-            data_in = (float *)malloc(sizeof(float) * max_possible_floats);
-            if (data_in == NULL) {
-                xil_printf("Error: Unable to allocate memory for data_in.\n\r");
-                return ERR_MEM;
+            payload_left -= n;
+            data += n;
+            len -= n;
+
+            // Message complete: the next byte starts the next header
+            if (payload_left == 0) {
+                finish_file();
+                rx_state = RX_HEADER;
+                header_bytes = 0;
             }
+        }
+    }
+    return 0;
+}
 
-            // Now parse the floats into data_in.
-            int total_floats = parse_floats_into_array(
-                &file_buffer[HEADER_SIZE],
-                expected_file_size,
-                data_in,
-                max_possible_floats
-            );
-            data_in_count = total_floats;
-            int num_samples = total_floats / NUM_INPUTS;
-            xil_printf("DATAIN file: parsed %d floats, which is %d sample(s)\n\r", total_floats, num_samples);
-
-            /* RUN ESN */
-            run_esn_calculation(num_samples);
+/*
+ * The connection being served ended (closed, reset or aborted): a streamed
+ * DATAIN ends with the samples stepped so far, any other message cut off
+ * is dropped, and the file port is free for the next connection.
+ */
+static void rx_connection_ended(void)
+{
+    if (rx_pcb == NULL) {
+        return;
+    }
+    rx_pcb = NULL;
+    if (rx_state == RX_PAYLOAD && !rx_command) {
+        xil_printf("Connection ended %u byte(s) short of the message, "
+                   "dropped.\n\r", payload_left);
+    }
+    if (stream_active) {
+        stream_active = 0;
+        esn_chunk_end(stream_samples);
+    }
+    tcp_file_init();
+}
+
+int tcp_file_open(struct tcp_pcb *pcb)
+{
+    if (rx_pcb != NULL) {
+        return -1;
+    }
+    tcp_file_init();
+    rx_pcb = pcb;
+    return 0;
+}
+
+void tcp_file_err(void *arg, err_t err)
+{
+    (void)arg;
+    (void)err;
+    // lwIP has already freed the pcb
+    rx_connection_ended();
+}
+
+/* The actual TCP callback function (called in tcp_perf_server.c) */
+err_t tcp_recv_file(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+	// If not packet is recieved, connection has been closed by client
+    if (!p) {
+        rx_connection_ended();
+        if (tcp_close(tpcb) != ERR_OK) {
+            tcp_abort(tpcb);
+            return ERR_ABRT;
         }
-        else if (strncmp(hdr->file_id, "DATAOUT_", 8) == 0) {
-        	// In your DATAOUT branch (in tcp_recv_file or a separate routine):
-        	int total_floats = parse_floats_into_array(&file_buffer[HEADER_SIZE],
-        	                                            expected_file_size,
-        	                                            golden_data_out,
-        	                                            DATA_OUT_MAX);
-        	golden_sample_count = total_floats / NUM_OUTPUTS;
-        	xil_printf("Golden DATAOUT file: parsed %d floats, which is %d sample(s)\n\r", total_floats, golden_sample_count);
-            golden_data_out_ready = 1;
-        }
-
-        /* Reset for the next file */
-        file_offset = 0;
-        expected_file_size = 0;
-        expecting_header = 1;
-        memset(file_buffer, 0, sizeof(file_buffer));
-    }
-    /* Let lwIP know we've consumed these bytes */
-    tcp_recved(tpcb, bytes_copied);
+        return ERR_OK;
+    }
+
+    // Loop through all linked pbuf segments (in case packet is chained)
+    for (struct pbuf *q = p; q != NULL; q = q->next) {
+        if (receive_segment((const char *)q->payload, q->len) != 0) {
+            pbuf_free(p);
+            rx_connection_ended();
+            tcp_abort(tpcb);
+            return ERR_ABRT;
+        }
+    }
+
+    /* Let lwIP know we've consumed these bytes, then free the pbuf */
+    tcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
     return ERR_OK;
 }
 
-/* ESN core calling function with error checking */
-void run_esn_calculation(int num_samples_in_chunk)
+/*
+ * Score one ESN output against the golden output (if there is one for this
+ * sample) and feed it to the online RLS trainer. The extended state is only
+ * built here, when RLS actually needs it.
+ */
+static void score_sample(int sample, const float *data_out,
+                         const float *res_state, const float *sample_in,
+                         float *total_mse, int *samples_compared)
+{
+    // Compare output with golden output for the current sample, if available
+    if ((total_samples_processed + sample) < golden_sample_count) {
+
+    	// Pointer to the corresponding golden output (4 floats per sample)
+        float *golden_sample = &golden_data_out[(total_samples_processed + sample) * model->num_outputs];
+        float mse = compute_mse(data_out, golden_sample, model->num_outputs);
+
+        *total_mse += mse;
+        (*samples_compared)++;
+
+        // Ridge mode only accumulates; W_out is solved for on TRN_SOLVE
+        if (is_ridge_enabled()) {
+            form_state_extended(model, sample_in, res_state, z_scratch);
+            ridge_accumulate(z_scratch, golden_sample);
+        }
+        // Update the output weights using the online RLS training function.
+        else if (is_training_enabled()) {
+            form_state_extended(model, sample_in, res_state, z_scratch);
+
+            // data_out was computed with the current W_out: reuse it
+            rls_block_push(z_scratch, golden_sample, data_out);
+            const float *new_W_out = rls_w_out_acquire();
+            if (new_W_out != NULL) {
+                xil_printf("Printing W_out_%d",
+                           (total_samples_processed + sample));
+                xil_printf("\n\r");
+                print_float_array(new_W_out, WOUT_MAX(model), 3);
+                rls_w_out_release(new_W_out);
+            }
+        }
+    }
+    else {
+        xil_printf("No golden output available for sample %d.\n\r", sample);
+    }
+}
+
+/* Say which files the ESN still needs; returns how many are missing */
+static int esn_files_missing(void)
 {
     /* Check if each required file/array is ready. If not, say so. */
     int missing = 0;
@@ -300,59 +981,212 @@ void run_esn_calculation(int num_samples_in_chunk)
             missing++;
         }
         xil_printf("Total missing: %d file(s).\n\r", missing);
-        return;
     }
+    return missing;
+}
 
-    // Create ESN arrays (can be reset from chunk to chunk)
-    float res_state[NUM_NEURONS];
-    float state_extended[EXTENDED_STATE_SIZE];
-    float data_out[NUM_OUTPUTS];
+/*
+ * Pick the kernels for a chunk of num_samples samples of data_in. A
+ * streamed chunk is stepped while it is still arriving, so it cannot use
+ * the block (batched) kernels or a chunk-wide fixed-point input scale.
+ */
+static void esn_chunk_begin(int num_samples, int streamed)
+{
+    const esn_model_t *m = model;
 
     // For overall error accumulation:
-    float total_mse = 0.0f;
-    int samples_compared = 0;
+    chunk.total_mse = 0.0f;
+    chunk.samples_compared = 0;
+    chunk.streamed = streamed;
+
+    // CSR kernels when either reservoir matrix is stored sparse
+    chunk.use_sparse = w_in_sparse || w_x_sparse;
+
+#ifdef ESN_FIXED_POINT
+    // Fixed-point inference whenever W_out is not being trained (RLS or
+    // ridge need the float state)
+    chunk.fixed_point = !is_training_enabled() && !is_ridge_enabled() &&
+                        !chunk.use_sparse;
+    if (chunk.fixed_point && w_out_q_stale) {
+        // No W_out to quantize: run this chunk in float instead
+        const float *w = rls_w_out_acquire();
+        chunk.fixed_point = (w != NULL);
+        if (w != NULL) {
+            esn_fixed_load_w_out(w);
+            rls_w_out_release(w);
+            w_out_q_stale = 0;
+        }
+    }
+    if (chunk.fixed_point) {
+        // The state stays Q15 in esn_fixed.c until esn_chunk_end()
+        esn_fixed_set_state(state_pre);
+        // One input scale for the whole chunk (per sample when streamed)
+        if (!streamed) {
+            chunk.in_exp = esn_fixed_exponent(data_in,
+                                              num_samples * m->num_inputs);
+        }
+    }
+#else
+    chunk.fixed_point = 0;
+#endif
+
+    // fp16/bf16 weights: dense models only, W_out converted once per change
+    chunk.half = w_in_h != NULL && !chunk.fixed_point && !chunk.use_sparse;
+    if (chunk.half && w_out_h_stale) {
+        const float *w = rls_w_out_acquire();
+        chunk.half = (w != NULL);
+        if (w != NULL) {
+            esn_convert_weights(w, WOUT_MAX(m), weight_format, w_out_h);
+            rls_w_out_release(w);
+            w_out_h_stale = 0;
+        }
+    }
+    // While RLS updates W_out every sample, read it in fp32
+    chunk.half_W_out = is_training_enabled() ? NULL : w_out_h;
 
-    for (int sample = 0; sample < num_samples_in_chunk; sample++) {
+    // W_out only stays fixed across a block when RLS is not updating it
+    chunk.batched = batched_mode && !chunk.fixed_point && !streamed;
+    chunk.batched_output = chunk.batched && !is_training_enabled();
+}
 
-    	// Pointer to current sample in the new chunk data_in
-        float *current_sample = &data_in[sample * NUM_INPUTS];
+/* Step the ESN on sample 'sample' of data_in (num_samples in the chunk) */
+static void esn_chunk_sample(int sample, int num_samples_in_chunk)
+{
+    // Dimensions of the active model
+    const esn_model_t *m = model;
+    const int n = m->num_neurons;
+    const int n_in = m->num_inputs;
+    const int n_out = m->num_outputs;
+    const int ext = m->extended_size;
+
+    // ESN arrays for this sample (model-sized, from the arena)
+    float *res_state = res_state_buf;
+    float *data_out = data_out_buf;
+
+    // Pointer to current sample in the new chunk data_in
+    float *current_sample = &data_in[sample * n_in];
+
+    // Position in the current block and the block's length
+    int slot = sample % ESN_BATCH_SAMPLES;
+    int block = num_samples_in_chunk - (sample - slot);
+    if (block > ESN_BATCH_SAMPLES) {
+        block = ESN_BATCH_SAMPLES;
+    }
 
-        // Use the current updated W_out:
-        float *current_W_out = get_W_out();
+    // Pin the published W_out for this sample; it is released before
+    // training, which writes the other buffer and publishes that
+    const float *current_W_out = rls_w_out_acquire();
+    if (current_W_out == NULL) {
+        xil_printf("Error: W_out busy, sample %d skipped.\n\r", sample);
+        return;
+    }
 
-        // Process current sample using the persistent state_pre
-        update_state(w_in, current_sample, w_x, state_pre, res_state);
+    // Process current sample using the persistent state_pre
+    if (chunk.fixed_point) {
+#ifdef ESN_FIXED_POINT
+        int in_exp = chunk.streamed ? esn_fixed_exponent(current_sample, n_in)
+                                    : chunk.in_exp;
+        int32_t *out_q = data_out_q_buf;
+
+        // Only the Q16.16 output leaves the fixed-point path, for scoring
+        esn_fixed_step(current_sample, in_exp, out_q);
+        for (int k = 0; k < n_out; k++) {
+            data_out[k] = (float)out_q[k] * (1.0f / 65536.0f);
+        }
+#endif
+    }
+    else if (chunk.use_sparse) {
+        // Sparse chunks are never batched: input_proj is free as scratch.
+        // A dense matrix stored in fp16/bf16 runs on its CSR copy too.
+        update_state_sparse(m, (w_in_sparse || w_in == NULL) ? &w_in_csr : NULL,
+                            w_in,
+                            (w_x_sparse || w_x == NULL) ? &w_x_csr : NULL,
+                            w_x, current_sample, state_pre, input_proj,
+                            res_state);
+    }
+    else if (chunk.batched) {
+        // Input projection for the next block of samples in one GEMM,
+        // then the block's whole recurrence (it does not depend on W_out)
+        if (slot == 0) {
+            if (chunk.half) {
+                esn_gemm_half(weight_format, w_in_h, n_in, current_sample,
+                              n_in, n, n_in, block, input_proj, n);
+                update_state_block_half(m, weight_format, input_proj, w_x_h,
+                                        state_pre, block, state_seq);
+            } else {
+                esn_gemm(w_in, n_in, current_sample, n_in,
+                         n, n_in, block,
+                         input_proj, n);
+                update_state_block(m, input_proj, w_x, state_pre, block,
+                                   state_seq);
+            }
+        }
+        memcpy(res_state, &state_seq[slot * n], sizeof(float) * n);
+    }
+    else if (chunk.half) {
+        esn_step_half(m, weight_format, w_in_h, w_x_h, chunk.half_W_out,
+                      current_W_out, current_sample, state_pre,
+                      res_state, data_out);
+    }
+    else {
+        // Fused step: new state and output in one call
+        esn_step(m, w_in, w_x, current_W_out, current_sample, state_pre,
+                 res_state, data_out);
+    }
 
-        // Update state_pre for the next sample
-        for (int i = 0; i < NUM_NEURONS; i++) {
+    // Update state_pre for the next sample (fixed point keeps its own)
+    if (!chunk.fixed_point) {
+        for (int i = 0; i < n; i++) {
             state_pre[i] = res_state[i];
         }
+    }
 
-        form_state_extended(current_sample, res_state, state_extended);
-
-        compute_output(current_W_out, state_extended, data_out);
-
-        // Compare output with golden output for the current sample, if available
-        if ((total_samples_processed + sample) < golden_sample_count) {
-
-        	// Pointer to the corresponding golden output (4 floats per sample)
-            float *golden_sample = &golden_data_out[(total_samples_processed + sample) * NUM_OUTPUTS];
-            float mse = compute_mse(data_out, golden_sample, NUM_OUTPUTS);
-
-            total_mse += mse;
-            samples_compared++;
-
-            // Update the output weights using the online RLS training function.
-            update_training_rls(state_extended, golden_sample);
-            float *new_W_out = get_W_out();
-            xil_printf("Printing W_out_%d", (total_samples_processed + sample));
-            xil_printf("\n\r");
-            print_float_array(new_W_out, WOUT_MAX, 3);
+    if (chunk.batched_output) {
+        // Collect the block's extended states (one column per sample)
+        float *z = &state_block[slot * ext];
+        form_state_extended(m, current_sample, res_state, z);
+
+        // Block complete: all outputs in one GEMM, then score them
+        if (slot == block - 1) {
+            if (chunk.half_W_out != NULL) {
+                esn_gemm_half(weight_format, chunk.half_W_out, ext,
+                              state_block, ext, n_out, ext, block,
+                              output_block, n_out);
+            } else {
+                esn_gemm(current_W_out, ext,
+                         state_block, ext,
+                         n_out, ext, block,
+                         output_block, n_out);
+            }
+            for (int b = 0; b < block; b++) {
+                const float *z_b = &state_block[b * ext];
+                score_sample(sample - slot + b,
+                             &output_block[b * n_out],
+                             z_b, &z_b[n],
+                             &chunk.total_mse, &chunk.samples_compared);
+            }
         }
-        else {
-            xil_printf("No golden output available for sample %d.\n\r", sample);
+        // RLS is off in this mode, so scoring did not write W_out
+        rls_w_out_release(current_W_out);
+    }
+    else {
+        // esn_step() and esn_step_half() already produced data_out
+        if (chunk.batched || chunk.use_sparse) {
+            compute_output_split(m, current_W_out, res_state, current_sample,
+                                 data_out);
         }
+        rls_w_out_release(current_W_out);
+
+        score_sample(sample, data_out, res_state, current_sample,
+                     &chunk.total_mse, &chunk.samples_compared);
     }
+}
+
+/* Report the chunk's error and finish its training updates */
+static void esn_chunk_end(int num_samples_in_chunk)
+{
+    float total_mse = chunk.total_mse;
+    int samples_compared = chunk.samples_compared;
 
     // batch results
     if (samples_compared > 0) {
@@ -383,33 +1217,160 @@ void run_esn_calculation(int num_samples_in_chunk)
         xil_printf("\n\r");
     }
 
+#ifdef ESN_FIXED_POINT
+    // Hand the Q15 state back to the float path
+    if (chunk.fixed_point) {
+        esn_fixed_get_state(state_pre);
+    }
+#endif
+
+    // Apply the last partial RLS block before W_out is reported or reused
+    rls_block_flush();
+    if (is_training_enabled()) {
+        rls_print_skip_stats();
+    }
+
+    // RLS may have changed W_out during this chunk
+    if (is_training_enabled()) {
+        w_out_q_stale = 1;
+        w_out_h_stale = 1;
+    }
+
     total_samples_processed += num_samples_in_chunk;
     xil_printf("Chunk processed. Total samples processed: %d\n\r",
                total_samples_processed);
 }
 
+/* ESN core calling function with error checking */
+void run_esn_calculation(int num_samples_in_chunk)
+{
+    if (esn_files_missing() > 0) {
+        return;
+    }
+
+    esn_chunk_begin(num_samples_in_chunk, 0);
+    for (int sample = 0; sample < num_samples_in_chunk; sample++) {
+        esn_chunk_sample(sample, num_samples_in_chunk);
+    }
+    esn_chunk_end(num_samples_in_chunk);
+}
+
+/* Solve the accumulated ridge regression for W_out and stop accumulating */
+void solve_ridge_training(float beta)
+{
+    xil_printf("Ridge beta = %d/1000000\n\r", (int)(beta * 1e6f));
+    if (ridge_solve(beta) == 0) {
+        w_out_q_stale = 1;
+        w_out_h_stale = 1;
+        const float *w = rls_w_out_acquire();
+        if (w != NULL) {
+            print_float_array(w, WOUT_MAX(model), 3);
+            rls_w_out_release(w);
+        }
+    }
+    ridge_disable();
+}
+
+/*
+ * Storage format of the dense W_in/W_x (and of the inference copy of
+ * W_out). The matrices are converted in place from their exact CSR
+ * copies, so switching back to fp32 loses nothing. fp32 storage left over
+ * from an earlier switch is reused; it is freed with the next model.
+ */
+void set_weight_format(esn_weight_format_t fmt)
+{
+    if (model->max_row_nnz > 0) {
+        weight_format = fmt;
+        xil_printf("Weight storage set to %s.\n\r", esn_weight_format_name(fmt));
+        if (fmt != ESN_WEIGHTS_FP32) {
+            xil_printf("Note: sparse models keep fp32 CSR weights.\n\r");
+        }
+        return;
+    }
+    if (set_dense_storage(model, fmt) != 0) {
+        xil_printf("Error: no room for %s weights, keeping %s.\n\r",
+                   esn_weight_format_name(fmt),
+                   esn_weight_format_name(weight_format));
+        return;
+    }
+    weight_format = fmt;
+    w_out_h_stale = 1;
+    if (w_in != NULL) {
+        esn_csr_to_dense(&w_in_csr, w_in);
+        esn_csr_to_dense(&w_x_csr, w_x);
+    } else {
+        store_half(&w_in_csr, w_in_h);
+        store_half(&w_x_csr, w_x_h);
+    }
+    xil_printf("Weight storage set to %s.\n\r", esn_weight_format_name(fmt));
+}
+
+/* Batched mode on/off (input projection per block instead of per sample) */
+void enable_batched_mode(void)
+{
+    batched_mode = 1;
+    xil_printf("Batched ESN mode enabled.\n\r");
+}
+
+void disable_batched_mode(void)
+{
+    batched_mode = 0;
+    xil_printf("Batched ESN mode disabled.\n\r");
+}
+
+/* Streaming mode on/off (step DATAIN samples while the file is arriving) */
+void enable_stream_mode(void)
+{
+    stream_mode = 1;
+    xil_printf("Streaming DATAIN mode enabled.\n\r");
+    if (batched_mode) {
+        xil_printf("Note: streamed chunks are run per sample, not batched.\n\r");
+    }
+}
+
+void disable_stream_mode(void)
+{
+    stream_mode = 0;
+    xil_printf("Streaming DATAIN mode disabled.\n\r");
+}
+
 /* Soft reset function */
 void reset_arrays(void)
 {
+    /*
+     * Free dynamic data_in if allocated. A DATAIN still arriving is
+     * dropped first: ending its chunk can flush RLS into W_out and hand
+     * back the fixed-point state, both cleared below.
+     */
+    if (data_in != NULL) {
+        rx_drop_data_in();
+        free(data_in);
+        data_in = NULL;
+    }
+
     /* Clear flags for matrix files */
     w_in_ready = 0;
     w_x_ready = 0;
+    w_in_sparse = 0;
+    w_x_sparse = 0;
 //    w_out_ready = 0;
     golden_data_out_ready = 0;
 
-    /* Clear static arrays for matrices */
-    memset(w_in, 0, sizeof(w_in));
-    memset(w_x, 0, sizeof(w_x));
-    memset(w_out, 0, sizeof(w_out));
-    set_W_out(w_out);
-    memset(state_pre, 0, sizeof(state_pre));
-    memset(w_out, 0, sizeof(w_out));
-
-    /* Free dynamic data_in if allocated */
-    if (data_in != NULL) {
-        free(data_in);
-        data_in = NULL;
+    /* Clear arrays for matrices */
+    if (w_in != NULL) {
+        memset(w_in, 0, sizeof(float) * WIN_MAX(model));
+        memset(w_x, 0, sizeof(float) * WX_MAX(model));
+    }
+    if (w_in_h != NULL) {
+        memset(w_in_h, 0, sizeof(uint16_t) * WIN_MAX(model));
+        memset(w_x_h, 0, sizeof(uint16_t) * WX_MAX(model));
     }
+    esn_csr_clear(&w_in_csr);
+    esn_csr_clear(&w_x_csr);
+    set_W_out(NULL);
+    w_out_q_stale = 1;
+    w_out_h_stale = 1;
+    memset(state_pre, 0, sizeof(float) * model->num_neurons);
     data_in_count = 0;
     cumulative_mse     = 0.0f;
     cumulative_samples = 0;
@@ -424,12 +1385,13 @@ void reset_arrays(void)
 void reset_data_in(void)
 {
     if (data_in != NULL) {
+        rx_drop_data_in();
         free(data_in);
         data_in = NULL;
     }
     data_in_count = 0;
     total_samples_processed = 0;
-    memset(state_pre, 0, sizeof(state_pre));
+    memset(state_pre, 0, sizeof(float) * model->num_neurons);
     cumulative_mse     = 0.0f;
     cumulative_samples = 0;
 
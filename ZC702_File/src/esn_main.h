@@ -8,36 +8,57 @@ extern "C" {
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
 #include "esn_core.h"
+#include "esn_fixed.h"
+#include "esn_model.h"
+#include "esn_sparse.h"
+#include "esn_parse.h"
 #include "xil_printf.h"
 #include "rls_training.h"
+#include "ridge_training.h"
+#include "nlms_training.h"
 #include <string.h> // for memcpy, memset
 
-/* Buffer size for File Reception Buffer */
-#define MAX_FILE_SIZE   (3072 * 3072)  /* 3MB (can be adjusted) */
-#define MAX_BUFFER_SIZE (1024 * 1024)  /* 1MB (can be adjusted) */
-
 /* The file header format:
  *  8 bytes for ID
  * +4 bytes for file_size
- * +4 bytes reserved
+ * +1 byte payload encoding
+ * +3 bytes magic "ESN"
  * = 16 bytes total
+ * followed by file_size payload bytes; the next message's header follows
+ * directly on the same connection (no end marker). A header without the
+ * magic means the stream is out of step, and the connection is closed.
  */
 #define HEADER_SIZE 16
+#define HEADER_MAGIC "ESN"
 
 /* Sample Count: */
 #define SAMPLES     140
 
-/* Expected integer counts for each file: */
-#define WIN_MAX     	(NUM_NEURONS * NUM_INPUTS)
-#define WX_MAX      	(NUM_NEURONS * NUM_NEURONS)
-#define WOUT_MAX    	(NUM_OUTPUTS * (NUM_INPUTS + NUM_NEURONS))
-#define DATA_OUT_MAX    (NUM_OUTPUTS * SAMPLES)
+/* Values generated by PARSE_BENCH when no count is given */
+#define PARSE_BENCH_VALUES 17920
+
+/* Samples per input-projection GEMM block in batched mode */
+#define ESN_BATCH_SAMPLES 32
+
+/* Expected float counts for each file, from the active model m: */
+#define WIN_MAX(m)      ((m)->num_neurons * (m)->num_inputs)
+#define WX_MAX(m)       ((m)->num_neurons * (m)->num_neurons)
+#define WOUT_MAX(m)     ((m)->num_outputs * (m)->extended_size)
+#define DATA_OUT_MAX(m) ((m)->num_outputs * SAMPLES)
+
+/*
+ * The format byte of the header selects the payload encoding:
+ *   PAYLOAD_ASCII: decimal floats, one per line (default, older senders)
+ *   PAYLOAD_F32:   raw little-endian float32 values, 4 bytes each
+ * (values in esn_parse.h)
+ */
 
 /* Define a struct to match file header (packed) */
 typedef struct __attribute__((__packed__)) {
     char file_id[8];
     uint32_t file_size;
-    char reserved[4];
+    uint8_t format;
+    char magic[3];
 } file_header_t;
 
 /* Init function to reset global state */
@@ -53,6 +74,18 @@ int parse_floats_into_array(const char *raw_text,
                                    unsigned int text_len,
                                    float *dest_array,
                                    unsigned int max_count);
+/* Time the ASCII float parsers on count generated values (PARSE_BENCH) */
+void parse_benchmark(int count);
+
+/* 1 while a file payload is being received on the file port */
+int esn_upload_pending(void);
+
+/*
+ * 1 while a streamed DATAIN is running: its kernels, trainer and weights
+ * were latched when it started, so commands must not change them.
+ */
+int esn_stream_active(void);
+
 /*
  * tcp_recv_file:
  *   The main callback function handling file data arrival.
@@ -61,10 +94,28 @@ int parse_floats_into_array(const char *raw_text,
  */
 err_t tcp_recv_file(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
 
+/*
+ * tcp_file_open / tcp_file_err:
+ *   The receive state above is global, so the file port serves one
+ *   connection at a time. tcp_file_open() hands it to a new connection
+ *   (returns -1 while another one is open); tcp_file_err() is the lwIP
+ *   error callback that releases it when the connection is reset.
+ */
+int tcp_file_open(struct tcp_pcb *pcb);
+void tcp_file_err(void *arg, err_t err);
+
 /* ESN-Related Function Prototypes */
+void esn_init(void);
+int esn_apply_model(const esn_model_t *m);
 void run_esn_calculation(int num_samples_in_chunk);
 void reset_arrays(void);
 void reset_data_in(void);
+void enable_batched_mode(void);
+void disable_batched_mode(void);
+void enable_stream_mode(void);
+void disable_stream_mode(void);
+void set_weight_format(esn_weight_format_t fmt);
+void solve_ridge_training(float beta);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ * File: esn_model.c
+ *
+ *   Description:
+ *     Run-time ESN model descriptor (dimensions, activation and RLS
+ *     settings) and the static arena that every model-sized buffer is
+ *     allocated from, so the reservoir size can change without reflashing.
+ *
+ ******************************************************************************/
+
+#include "esn_model.h"
+#include "rls_training.h"
+#include <string.h>
+
+static esn_model_t active_model;
+static int active_model_set = 0;
+
+static unsigned char arena[ESN_ARENA_BYTES] __attribute__((aligned(16)));
+static size_t arena_used = 0;
+
+void esn_model_defaults(esn_model_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->num_inputs = NUM_INPUTS;
+    m->num_outputs = NUM_OUTPUTS;
+    m->num_neurons = NUM_NEURONS;
+    m->extended_size = EXTENDED_STATE_SIZE;
+    m->activation = ESN_ACT_TANH_EXACT;
+    m->forgetting_factor = RLS_FORGETTING_FACTOR;
+    m->psi_init = RLS_PSI_INIT;
+    m->feature_stride = 1;
+    esn_select_kernels(m);
+}
+
+/*
+ * Integer descriptor field: v must be a whole number in lo..hi before it
+ * is cast (NaN, infinities and fractions are rejected, and out-of-range
+ * values never reach the int conversion).
+ */
+static int model_int_field(float v, int lo, int hi, const char *name,
+                           int *out)
+{
+    if (!(v >= (float)lo && v <= (float)hi) || v != floorf(v)) {
+        xil_printf("Error: MODEL___ %s must be a whole number in "
+                   "%d..%d.\n\r", name, lo, hi);
+        return -1;
+    }
+    *out = (int)v;
+    return 0;
+}
+
+int esn_model_from_floats(const float *v, int count, esn_model_t *m)
+{
+    int activation = ESN_ACT_TANH_EXACT;
+    int trainer = ESN_TRAINER_RLS;
+
+    if (count < ESN_MODEL_MIN_FIELDS) {
+        xil_printf("Error: MODEL___ needs %d values, got %d.\n\r",
+                   ESN_MODEL_MIN_FIELDS, count);
+        return -1;
+    }
+
+    esn_model_defaults(m);
+    m->max_row_nnz = 0;
+    if (model_int_field(v[0], 1, ESN_MAX_INPUTS, "num_inputs",
+                        &m->num_inputs) != 0 ||
+        model_int_field(v[1], 1, ESN_MAX_NEURONS, "num_neurons",
+                        &m->num_neurons) != 0 ||
+        model_int_field(v[2], 1, ESN_MAX_OUTPUTS, "num_outputs",
+                        &m->num_outputs) != 0 ||
+        model_int_field(v[3], ESN_ACT_TANH_EXACT, ESN_ACT_TANH_LUT,
+                        "activation", &activation) != 0 ||
+        (count > 6 && model_int_field(v[6], 0, ESN_MAX_NEURONS,
+                                      "max_row_nnz", &m->max_row_nnz) != 0) ||
+        (count > 7 && model_int_field(v[7], ESN_TRAINER_RLS,
+                                      ESN_TRAINER_QR_RLS, "trainer",
+                                      &trainer) != 0) ||
+        (count > 8 && model_int_field(v[8], 0, ESN_MAX_INPUTS,
+                                      "feature_stride",
+                                      &m->feature_stride) != 0)) {
+        return -1;
+    }
+    m->activation = (esn_activation_t)activation;
+    m->trainer = (esn_trainer_t)trainer;
+    m->forgetting_factor = v[4];
+    m->psi_init = v[5];
+    m->extended_size = m->num_neurons + m->num_inputs;
+
+    int max_neurons = (m->max_row_nnz > 0) ? ESN_MAX_NEURONS
+                                           : ESN_MAX_DENSE_NEURONS;
+    if (m->num_inputs < 1 || m->num_inputs > ESN_MAX_INPUTS ||
+        m->num_neurons < 1 || m->num_neurons > max_neurons ||
+        m->num_outputs < 1 || m->num_outputs > ESN_MAX_OUTPUTS) {
+        xil_printf("Error: model %d inputs x %d neurons x %d outputs is "
+                   "outside the %d x %d x %d limit.\n\r",
+                   m->num_inputs, m->num_neurons, m->num_outputs,
+                   ESN_MAX_INPUTS, max_neurons, ESN_MAX_OUTPUTS);
+        return -1;
+    }
+    if (m->feature_stride > m->num_inputs) {
+        xil_printf("Error: feature stride must be 0..%d.\n\r",
+                   m->num_inputs);
+        return -1;
+    }
+    if (!(m->forgetting_factor > 0.0f && m->forgetting_factor <= 1.0f) ||
+        !(m->psi_init > 0.0f && isfinite(m->psi_init))) {
+        xil_printf("Error: need 0 < forgetting_factor <= 1 and psi_init > 0.\n\r");
+        return -1;
+    }
+
+    esn_select_kernels(m);
+    return 0;
+}
+
+void esn_model_set(const esn_model_t *m)
+{
+    active_model = *m;
+    esn_select_kernels(&active_model);
+    active_model_set = 1;
+}
+
+const esn_model_t *esn_model_get(void)
+{
+    if (!active_model_set) {
+        esn_model_defaults(&active_model);
+        active_model_set = 1;
+    }
+    return &active_model;
+}
+
+void esn_model_print(const esn_model_t *m)
+{
+    xil_printf("ESN model: %d inputs, %d neurons, %d outputs, "
+               "activation %s, kernel %s\n\r",
+               m->num_inputs, m->num_neurons, m->num_outputs,
+               esn_activation_name(m->activation), m->kernel_variant);
+    if (m->max_row_nnz > 0) {
+        xil_printf("Sparse reservoir: up to %d nonzeros per row\n\r",
+                   m->max_row_nnz);
+    }
+    if (m->trainer == ESN_TRAINER_NLMS) {
+        xil_printf("Trainer: NLMS (no Psi)\n\r");
+    }
+    else {
+        xil_printf("%s: lambda = %d/100000, Psi(0) = %d/1000 * I\n\r",
+                   (m->trainer == ESN_TRAINER_QR_RLS) ? "QR-RLS" : "RLS",
+                   (int)(m->forgetting_factor * 100000.0f + 0.5f),
+                   (int)(m->psi_init * 1000.0f + 0.5f));
+        if (m->feature_stride != 1) {
+            xil_printf("RLS features: reservoir + every %d-th input "
+                       "(0 = none)\n\r", m->feature_stride);
+        }
+    }
+    xil_printf("Arena: %d of %d bytes in use\n\r",
+               (int)arena_used, ESN_ARENA_BYTES);
+}
+
+void *esn_arena_alloc(size_t bytes)
+{
+    size_t size = (bytes + 15) & ~(size_t)15;
+
+    if (size > ESN_ARENA_BYTES - arena_used) {
+        xil_printf("Error: model arena exhausted (%d bytes requested, "
+                   "%d free).\n\r", (int)bytes,
+                   (int)(ESN_ARENA_BYTES - arena_used));
+        return NULL;
+    }
+
+    void *p = &arena[arena_used];
+    arena_used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+void *esn_arena_scratch(size_t *bytes)
+{
+    *bytes = ESN_ARENA_BYTES - arena_used;
+    return &arena[arena_used];
+}
+
+void esn_arena_reset(void)
+{
+    arena_used = 0;
+}
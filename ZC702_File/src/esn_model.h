@@ -0,0 +1,76 @@
+#ifndef ESN_MODEL_H
+#define ESN_MODEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esn_core.h"
+#include "xil_printf.h"
+#include <stddef.h>
+
+/*
+ * MODEL___ file: one value per line, in this order:
+ *   num_inputs, num_neurons, num_outputs,
+ *   activation (0 = tanhf, 1 = rational, 2 = lut),
+ *   forgetting_factor, psi_init,
+ *   max_row_nnz (optional, 0 = dense; see esn_model_t),
+ *   trainer (optional, 0 = RLS, 1 = NLMS, 2 = QR-RLS; see esn_trainer_t),
+ *   feature_stride (optional, 1 = all inputs; see rls_set_feature_stride())
+ * Send it before WIN/WX/WOUT: loading a model clears the weights.
+ */
+#define ESN_MODEL_FIELDS     9
+#define ESN_MODEL_MIN_FIELDS 6
+
+/*
+ * Static arena the model's buffers are carved from (esn_main.c, RLS,
+ * sparse and fixed-point weights). The heap is too small for this. The
+ * default fits the deployed 128x8x128 model with RLS, ridge, fp16 and
+ * fixed-point buffers (about 0.5 MB) plus room to stage uploads; builds
+ * for larger reservoirs pass -DESN_ARENA_BYTES=... (32 MB holds a
+ * 2048-neuron sparse reservoir including its 9.5 MB packed RLS Psi).
+ */
+#ifndef ESN_ARENA_BYTES
+#define ESN_ARENA_BYTES  (768 * 1024)
+#endif
+
+/* Fill m with the compile-time defaults (NUM_INPUTS etc. in esn_core.h) */
+void esn_model_defaults(esn_model_t *m);
+
+/*
+ * esn_model_from_floats()
+ *   Build a model from the ESN_MODEL_FIELDS values of a MODEL___ file.
+ *   Returns 0 on success, -1 (and prints why) if a value is out of range
+ *   or, for the integer fields, not a whole number.
+ */
+int esn_model_from_floats(const float *v, int count, esn_model_t *m);
+
+/*
+ * esn_model_set() / esn_model_get()
+ *   Make m the active model (and pick its kernels) / return the active
+ *   model, which is the defaults until esn_model_set() is called.
+ */
+void esn_model_set(const esn_model_t *m);
+const esn_model_t *esn_model_get(void);
+
+/* Print the model's dimensions and settings over UART */
+void esn_model_print(const esn_model_t *m);
+
+/*
+ * esn_arena_alloc()
+ *   16-byte aligned, zeroed block of the given size from the arena, or
+ *   NULL if it is exhausted. esn_arena_reset() frees everything at once.
+ *
+ * esn_arena_scratch()
+ *   The unallocated rest of the arena (its size in *bytes), for temporary
+ *   use until the next esn_arena_alloc().
+ */
+void *esn_arena_alloc(size_t bytes);
+void *esn_arena_scratch(size_t *bytes);
+void esn_arena_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_MODEL_H */
@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * File: esn_parse.c
+ *
+ *   Description:
+ *     Incremental float decoder for TCP file payloads: ASCII tokens or raw
+ *     float32 values are decoded as each pbuf arrives, so no copy of the
+ *     whole file is ever staged.
+ *
+ ******************************************************************************/
+
+#include "esn_parse.h"
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Powers of ten that are exact in double */
+static const double pow10_exact[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' ||
+           c == '\v' || c == '\f';
+}
+
+static inline int is_digit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline void store(esn_float_stream_t *s, float v)
+{
+    if (s->count < s->max_count) {
+        if (s->dest != NULL) {
+            s->dest[s->count] = v;
+        }
+        s->count++;
+    }
+}
+
+float esn_parse_float(const char *str, char **end)
+{
+    const char *p = str;
+    uint64_t w = 0;         // significant digits, as an integer
+    int digits = 0;         // how many of them
+    int exp10 = 0;          // value = w * 10^exp10
+    int any = 0;            // saw at least one digit
+    int dropped = 0;        // nonzero digits beyond the 19 that fit in w
+    int neg = 0;
+
+    if (*p == '-' || *p == '+') {
+        neg = (*p == '-');
+        p++;
+    }
+    while (*p == '0') {
+        p++;
+        any = 1;
+    }
+    for (; is_digit(*p); p++, any = 1) {
+        if (digits < 19) {
+            w = w * 10 + (uint64_t)(*p - '0');
+            digits++;
+        }
+        else {
+            exp10++;
+            dropped |= (*p != '0');
+        }
+    }
+    if (*p == '.') {
+        p++;
+        if (digits == 0) {
+            for (; *p == '0'; p++, any = 1) {
+                exp10--;
+            }
+        }
+        for (; is_digit(*p); p++, any = 1) {
+            if (digits < 19) {
+                w = w * 10 + (uint64_t)(*p - '0');
+                digits++;
+                exp10--;
+            }
+            else {
+                dropped |= (*p != '0');
+            }
+        }
+    }
+    // inf, nan, hex floats and non-numbers are left to the C library
+    if (!any || *p == 'x' || *p == 'X') {
+        return strtof(str, end);
+    }
+    if (*p == 'e' || *p == 'E') {
+        const char *q = p + 1;
+        int eneg = 0;
+        int e = 0;
+
+        if (*q == '-' || *q == '+') {
+            eneg = (*q == '-');
+            q++;
+        }
+        if (is_digit(*q)) {
+            for (; is_digit(*q); q++) {
+                if (e < 100000) {
+                    e = e * 10 + (*q - '0');
+                }
+            }
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+
+    if (w == 0) {
+        *end = (char *)p;
+        return neg ? -0.0f : 0.0f;
+    }
+
+    /*
+     * One multiply or divide by an exact power of ten gives a double within
+     * 3 ulps of the true value (0.5 ulp if w is exact too). The float that
+     * double rounds to is correctly rounded unless the double sits that
+     * close to a float midpoint (low 29 mantissa bits near 1000...0); those
+     * cases, subnormals and overflow are left to strtof.
+     */
+    if (exp10 < -22 || exp10 > 22) {
+        return strtof(str, end);
+    }
+    double d = (exp10 < 0) ? (double)w / pow10_exact[-exp10]
+                           : (double)w * pow10_exact[exp10];
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    int64_t from_mid = (int64_t)(bits & 0x1FFFFFFF) - 0x10000000;
+    int64_t margin = (dropped || w > (1ULL << 53)) ? 4 : 0;
+    if (d < FLT_MIN || d > FLT_MAX ||
+        (from_mid >= -margin && from_mid <= margin)) {
+        return strtof(str, end);
+    }
+
+    *end = (char *)p;
+    return neg ? -(float)d : (float)d;
+}
+
+/* Parse one token that ends at whitespace or NUL; skip it if not a number */
+static void emit_token(esn_float_stream_t *s, const char *tok)
+{
+    char *end;
+    float v = esn_parse_float(tok, &end);
+
+    if (end != tok) {
+        store(s, v);
+    }
+}
+
+void esn_stream_begin(esn_float_stream_t *s, int format, float *dest,
+                      unsigned int max_count)
+{
+    s->format = format;
+    s->dest = dest;
+    s->max_count = max_count;
+    s->count = 0;
+    s->len = 0;
+}
+
+static void feed_f32(esn_float_stream_t *s, const char *data, unsigned int len)
+{
+    // Complete a value split across pieces first
+    if (s->len > 0) {
+        while (s->len < sizeof(float) && len > 0) {
+            s->tok[s->len++] = *data++;
+            len--;
+        }
+        if (s->len < sizeof(float)) {
+            return;
+        }
+        float v;
+        memcpy(&v, s->tok, sizeof(float));
+        store(s, v);
+        s->len = 0;
+    }
+
+    // Whole values go straight to dest
+    unsigned int n = len / sizeof(float);
+    unsigned int room = s->max_count - s->count;
+    unsigned int copy = (n < room) ? n : room;
+    if (s->dest != NULL) {
+        memcpy(&s->dest[s->count], data, copy * sizeof(float));
+    }
+    s->count += copy;
+
+    // Keep the bytes of a trailing partial value
+    unsigned int rest = len - n * sizeof(float);
+    memcpy(s->tok, &data[n * sizeof(float)], rest);
+    s->len = rest;
+}
+
+static void feed_ascii(esn_float_stream_t *s, const char *data,
+                       unsigned int len)
+{
+    unsigned int i = 0;
+
+    // Finish a token carried over from the previous piece
+    if (s->len > 0) {
+        while (i < len && !is_space(data[i])) {
+            if (s->len <= ESN_TOKEN_MAX) {
+                s->tok[s->len] = data[i];
+            }
+            s->len++;
+            i++;
+        }
+        if (i == len) {
+            return;
+        }
+        if (s->len <= ESN_TOKEN_MAX) {
+            s->tok[s->len] = '\0';
+            emit_token(s, s->tok);
+        }
+        s->len = 0;
+    }
+
+    // Tokens that end inside this piece are parsed in place (the
+    // whitespace after them stops the parser)
+    while (i < len) {
+        if (is_space(data[i])) {
+            i++;
+            continue;
+        }
+        unsigned int start = i;
+        while (i < len && !is_space(data[i])) {
+            i++;
+        }
+        if (i < len) {
+            emit_token(s, &data[start]);
+        }
+        else {
+            // Runs past the end of the piece: keep it for the next one
+            unsigned int n = len - start;
+            s->len = n;
+            memcpy(s->tok, &data[start], (n <= ESN_TOKEN_MAX) ? n : 0);
+        }
+    }
+}
+
+void esn_stream_feed(esn_float_stream_t *s, const char *data,
+                     unsigned int len)
+{
+    if (s->format == PAYLOAD_F32) {
+        feed_f32(s, data, len);
+    }
+    else {
+        feed_ascii(s, data, len);
+    }
+}
+
+unsigned int esn_stream_end(esn_float_stream_t *s)
+{
+    if (s->format != PAYLOAD_F32 && s->len > 0 && s->len <= ESN_TOKEN_MAX) {
+        s->tok[s->len] = '\0';
+        emit_token(s, s->tok);
+    }
+    s->len = 0;
+    return s->count;
+}
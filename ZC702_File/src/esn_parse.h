@@ -0,0 +1,58 @@
+#ifndef ESN_PARSE_H
+#define ESN_PARSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Resumable float decoder for file payloads that arrive in pieces (one
+ * pbuf at a time). Values are written straight into the destination
+ * array; only a value split across two pieces is buffered, so the state
+ * is one token regardless of the file size.
+ */
+
+/* Payload encodings (file header format byte, see esn_main.h) */
+#define PAYLOAD_ASCII   0   /* decimal floats separated by whitespace */
+#define PAYLOAD_F32     1   /* raw little-endian float32, 4 bytes each */
+
+/* Longest ASCII token kept across a piece boundary (longer ones are skipped) */
+#define ESN_TOKEN_MAX   63
+
+typedef struct {
+    int format;                 /* PAYLOAD_ASCII or PAYLOAD_F32 */
+    float *dest;                /* NULL: decode and drop */
+    unsigned int max_count;     /* capacity of dest */
+    unsigned int count;         /* values stored so far */
+    unsigned int len;           /* bytes held in tok (> ESN_TOKEN_MAX: too long) */
+    char tok[ESN_TOKEN_MAX + 1];
+} esn_float_stream_t;
+
+/*
+ * esn_parse_float()
+ *   Drop-in for strtof(): correctly rounded decimal to float, with a fast
+ *   path for plain decimals of up to 19 significant digits (everything the
+ *   data generator writes); other input falls back to strtof().
+ *
+ * esn_stream_begin()
+ *   Start decoding a payload in the given format into dest (at most
+ *   max_count values; any further values are dropped).
+ *
+ * esn_stream_feed()
+ *   Decode the next len bytes of the payload.
+ *
+ * esn_stream_end()
+ *   Finish the last value and return the number of values stored.
+ */
+float esn_parse_float(const char *str, char **end);
+void esn_stream_begin(esn_float_stream_t *s, int format, float *dest,
+                      unsigned int max_count);
+void esn_stream_feed(esn_float_stream_t *s, const char *data,
+                     unsigned int len);
+unsigned int esn_stream_end(esn_float_stream_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_PARSE_H */
@@ -0,0 +1,181 @@
+/*******************************************************************************
+ * File: esn_sparse.c
+ *
+ *   Description:
+ *     CSR storage and GEMV kernels for sparse reservoirs. Typical reservoirs
+ *     are 1-10% dense, so for 500-2000 neurons the CSR W_x is both small
+ *     enough to stay in cache and 10-100x less work than the dense product.
+ *
+ ******************************************************************************/
+
+#include "esn_sparse.h"
+#include "esn_activation.h"
+#include "esn_model.h"
+#include "xil_printf.h"
+#include <string.h>
+
+int esn_csr_alloc(esn_csr_t *A, int rows, int cols, int capacity)
+{
+    A->rows = rows;
+    A->cols = cols;
+    A->nnz = 0;
+    A->capacity = capacity;
+    A->row_ptr = esn_arena_alloc(sizeof(int) * (rows + 1));
+    A->col_idx = esn_arena_alloc(sizeof(uint16_t) * capacity);
+    A->val = esn_arena_alloc(sizeof(float) * capacity);
+
+    if (A->row_ptr == NULL || A->col_idx == NULL || A->val == NULL) {
+        A->capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void esn_csr_clear(esn_csr_t *A)
+{
+    A->nnz = 0;
+    if (A->row_ptr != NULL) {
+        memset(A->row_ptr, 0, sizeof(int) * (A->rows + 1));
+    }
+}
+
+int esn_csr_from_dense(esn_csr_t *A, const float *dense)
+{
+    int nnz = 0;
+
+    for (int i = 0; i < A->rows; i++) {
+        A->row_ptr[i] = nnz;
+        for (int j = 0; j < A->cols; j++) {
+            float v = dense[i * A->cols + j];
+            if (v == 0.0f) {
+                continue;
+            }
+            if (nnz == A->capacity) {
+                xil_printf("Error: more than %d nonzeros for a %d x %d CSR "
+                           "matrix.\n\r", A->capacity, A->rows, A->cols);
+                esn_csr_clear(A);
+                return -1;
+            }
+            A->col_idx[nnz] = (uint16_t)j;
+            A->val[nnz] = v;
+            nnz++;
+        }
+    }
+    A->row_ptr[A->rows] = nnz;
+    A->nnz = nnz;
+    return 0;
+}
+
+int esn_csr_from_coo(esn_csr_t *A, const float *triplets, int count)
+{
+    int n = count / 3;
+
+    if (n > A->capacity) {
+        xil_printf("Error: %d entries for a %d x %d CSR matrix that holds "
+                   "%d.\n\r", n, A->rows, A->cols, A->capacity);
+        return -1;
+    }
+
+    /* Count the entries of each row (row_ptr[i + 1]), checking indices */
+    memset(A->row_ptr, 0, sizeof(int) * (A->rows + 1));
+    for (int k = 0; k < n; k++) {
+        int i = (int)triplets[3 * k];
+        int j = (int)triplets[3 * k + 1];
+        if (i < 0 || i >= A->rows || j < 0 || j >= A->cols) {
+            xil_printf("Error: entry (%d, %d) outside a %d x %d matrix.\n\r",
+                       i, j, A->rows, A->cols);
+            esn_csr_clear(A);
+            return -1;
+        }
+        A->row_ptr[i + 1]++;
+    }
+
+    /* Prefix sum, then place each entry using row_ptr[i] as the cursor */
+    for (int i = 0; i < A->rows; i++) {
+        A->row_ptr[i + 1] += A->row_ptr[i];
+    }
+    for (int k = 0; k < n; k++) {
+        int i = (int)triplets[3 * k];
+        int pos = A->row_ptr[i]++;
+        A->col_idx[pos] = (uint16_t)(int)triplets[3 * k + 1];
+        A->val[pos] = triplets[3 * k + 2];
+    }
+
+    /* The cursors now point at the next row's start: shift them back */
+    for (int i = A->rows; i > 0; i--) {
+        A->row_ptr[i] = A->row_ptr[i - 1];
+    }
+    A->row_ptr[0] = 0;
+    A->nnz = n;
+    return 0;
+}
+
+void esn_csr_to_dense(const esn_csr_t *A, float *dense)
+{
+    memset(dense, 0, sizeof(float) * A->rows * A->cols);
+    for (int i = 0; i < A->rows; i++) {
+        for (int k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++) {
+            dense[i * A->cols + A->col_idx[k]] += A->val[k];
+        }
+    }
+}
+
+float esn_csr_density(const esn_csr_t *A)
+{
+    return (float)A->nnz / ((float)A->rows * (float)A->cols);
+}
+
+/*
+ * Row-wise CSR product. Two accumulators per row hide the FMA latency
+ * behind the indexed loads of x (there is no gather on the A9).
+ */
+void esn_csr_gemv(const esn_csr_t *A, const float *x, float *y)
+{
+    const int *row_ptr = A->row_ptr;
+    const uint16_t *col = A->col_idx;
+    const float *val = A->val;
+
+    for (int i = 0; i < A->rows; i++) {
+        int k = row_ptr[i];
+        const int end = row_ptr[i + 1];
+        float acc0 = 0.0f;
+        float acc1 = 0.0f;
+
+        for (; k + 2 <= end; k += 2) {
+            acc0 += val[k] * x[col[k]];
+            acc1 += val[k + 1] * x[col[k + 1]];
+        }
+        if (k < end) {
+            acc0 += val[k] * x[col[k]];
+        }
+        y[i] = acc0 + acc1;
+    }
+}
+
+void update_state_sparse(const esn_model_t *m,
+                         const esn_csr_t *W_in_csr, const float *W_in,
+                         const esn_csr_t *W_x_csr, const float *W_x,
+                         const float *dataIn,
+                         const float *state_pre,
+                         float *input_proj,
+                         float *state)
+{
+    if (W_in_csr != NULL) {
+        esn_csr_gemv(W_in_csr, dataIn, input_proj);
+    } else {
+        esn_gemv(W_in, m->num_inputs, dataIn, m->num_neurons, m->num_inputs,
+                 input_proj);
+    }
+
+    if (W_x_csr == NULL) {
+        update_state_projected(m, input_proj, W_x, state_pre, state);
+        return;
+    }
+
+    /* state = act(W_x*state_pre + input_proj), same order as update_state() */
+    esn_csr_gemv(W_x_csr, state_pre, state);
+    for (int i = 0; i < m->num_neurons; i++) {
+        state[i] += input_proj[i];
+    }
+    esn_activate(state, state, m->num_neurons);
+}
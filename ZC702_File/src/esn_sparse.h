@@ -0,0 +1,91 @@
+#ifndef ESN_SPARSE_H
+#define ESN_SPARSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esn_core.h"
+#include <stdint.h>
+
+/*
+ * Sparse reservoir support. W_in and W_x are stored in CSR form when the
+ * model is sparse (max_row_nnz > 0) or when a dense file turns out to be
+ * at most ESN_SPARSE_MAX_DENSITY full.
+ *
+ * Sparse file encoding (WIN_COO_ / WX_COO__): one value per line, as
+ * "row, col, value" triplets in any order. Duplicate entries are summed.
+ */
+
+/*
+ * Density at or below which a dense W_in/W_x is switched to CSR. The CSR
+ * kernel has no SIMD and gathers x, so it only beats the dense kernel on
+ * in-cache matrices (dense models, <= 64 neurons) below about 10% density;
+ * for 1000+ neurons the break-even rises to about 30%.
+ */
+#ifndef ESN_SPARSE_MAX_DENSITY
+#define ESN_SPARSE_MAX_DENSITY 0.10f
+#endif
+
+/* Compressed sparse row matrix; storage comes from the model arena */
+typedef struct {
+    int rows;
+    int cols;
+    int nnz;        /* stored entries */
+    int capacity;   /* allocated entries */
+    int *row_ptr;       /* row i is entries row_ptr[i] .. row_ptr[i+1]-1 */
+    uint16_t *col_idx;  /* column of each entry */
+    float *val;         /* value of each entry */
+} esn_csr_t;
+
+/*
+ * esn_csr_alloc()
+ *   Allocate a rows x cols CSR matrix holding up to capacity entries.
+ *   Returns 0 on success, -1 if the arena is too small.
+ */
+int esn_csr_alloc(esn_csr_t *A, int rows, int cols, int capacity);
+
+/* Empty A (no stored entries), keeping its storage */
+void esn_csr_clear(esn_csr_t *A);
+
+/*
+ * esn_csr_from_dense() / esn_csr_from_coo()
+ *   Fill A from a row-major dense matrix, or from count/3 (row, col, value)
+ *   triplets. Return 0 on success, -1 (and print why) if the entries do not
+ *   fit in A's capacity or an index is out of range.
+ */
+int esn_csr_from_dense(esn_csr_t *A, const float *dense);
+int esn_csr_from_coo(esn_csr_t *A, const float *triplets, int count);
+
+/* Write A out as a row-major dense matrix (zeros elsewhere) */
+void esn_csr_to_dense(const esn_csr_t *A, float *dense);
+
+/* Fraction of A's entries that are stored (nnz / (rows * cols)) */
+float esn_csr_density(const esn_csr_t *A);
+
+/*
+ * esn_csr_gemv()
+ *   y = A * x for a CSR matrix A (size A->rows).
+ */
+void esn_csr_gemv(const esn_csr_t *A, const float *x, float *y);
+
+/*
+ * update_state_sparse()
+ *   update_state() where either weight matrix may be in CSR form: a
+ *   non-NULL W_in_csr / W_x_csr is used instead of the dense W_in / W_x.
+ *   input_proj is caller scratch of num_neurons floats (W_in*dataIn ends
+ *   up there); state must not overlap state_pre.
+ */
+void update_state_sparse(const esn_model_t *m,
+                         const esn_csr_t *W_in_csr, const float *W_in,
+                         const esn_csr_t *W_x_csr, const float *W_x,
+                         const float *dataIn,
+                         const float *state_pre,
+                         float *input_proj,
+                         float *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESN_SPARSE_H */
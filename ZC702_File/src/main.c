@@ -67,6 +67,7 @@ extern volatile int TcpSlowTmrFlag;
 void platform_enable_interrupts(void);
 void start_application(void);
 void print_app_header(void);
+void esn_init(void);
 
 #if defined (__arm__) && !defined (ARMR5)
 #if XPAR_GIGE_PCS_PMA_SGMII_CORE_PRESENT == 1 || \
@@ -220,8 +221,8 @@ int main(void)
 	// Start the command reception application (TCP server on port 5002) */
 	start_command_server();
 
-	/* init training module */
-	init_rls();
+	/* init ESN model buffers and training module (default model) */
+	esn_init();
 
 	while (1) {
 		if (TcpFastTmrFlag) {
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * File: nlms_training.c
+ *
+ *   Description:
+ *     Normalized-LMS update of W_out: one dot product for |z|^2 and one
+ *     multiply-add stream per output row, no inverse correlation matrix.
+ *
+ ******************************************************************************/
+
+#include "nlms_training.h"
+
+static float step_size = NLMS_STEP_SIZE;
+
+void nlms_set_step_size(float mu)
+{
+    if (!(mu > 0.0f && mu < 2.0f)) {
+        xil_printf("Error: NLMS step size must be in (0, 2).\n\r");
+        return;
+    }
+    step_size = mu;
+    xil_printf("NLMS step size: %d/1000\n\r", (int)(mu * 1000.0f + 0.5f));
+}
+
+void update_training_nlms(const esn_model_t *m, const float *W_cur,
+                          float *W_next, const float *z,
+                          const float *y_target, const float *y_pred,
+                          float step_scale)
+{
+    const int ext = m->extended_size;
+    const int n_out = m->num_outputs;
+
+    float zz = 0.0f;
+    for (int i = 0; i < ext; i++) {
+        zz += z[i] * z[i];
+    }
+    const float c = step_size * step_scale / (NLMS_EPSILON + zz);
+
+    for (int i = 0; i < n_out; i++) {
+        const float a = (y_target[i] - y_pred[i]) * c;
+        esn_axpy_multi_from(ext, 1, &a, z, ext, &W_cur[i * ext],
+                            &W_next[i * ext]);
+    }
+}
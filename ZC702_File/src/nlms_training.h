@@ -0,0 +1,50 @@
+#ifndef NLMS_TRAINING_H
+#define NLMS_TRAINING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esn_core.h"
+#include "xil_printf.h"
+
+/*
+ * Normalized LMS trainer, the cheap alternative to RLS: per sample
+ *   W_out += (mu / (eps + z^T z)) * e * z^T,   e = y_target - W_out * z
+ * which is O(num_outputs * extended_size) and keeps no Psi. It is driven
+ * through the RLS interface (enable_training(), rls_block_push() ...) when
+ * the model's trainer is ESN_TRAINER_NLMS or after rls_set_trainer().
+ */
+
+/* Default step size (0 < mu < 2 for a stable NLMS) */
+#define NLMS_STEP_SIZE  0.5f
+
+/* Regularization of z^T z, keeps the step bounded for a near-zero z */
+#define NLMS_EPSILON    1e-4f
+
+/**
+ * nlms_set_step_size
+ * ------------------
+ * Set mu (0 < mu < 2). Larger mu converges faster with more misadjustment.
+ */
+void nlms_set_step_size(float mu);
+
+/**
+ * update_training_nlms
+ * --------------------
+ * One NLMS step on W_out (num_outputs x extended_size of model m) with
+ * y_pred = W_cur * z computed by the caller (the inference output),
+ * written to W_next (W_next may be W_cur). The step is mu * step_scale;
+ * set-membership training passes 1 - bound / RMS(e) as step_scale, plain
+ * NLMS 1.
+ */
+void update_training_nlms(const esn_model_t *m, const float *W_cur,
+                          float *W_next, const float *z,
+                          const float *y_target, const float *y_pred,
+                          float step_scale);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NLMS_TRAINING_H */
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ * File: ridge_training.c
+ *
+ *   Description:
+ *     Ridge-regression trainer: accumulate R = sum z z^T and P = sum y z^T
+ *     (symmetric rank-k adds over RIDGE_BLOCK samples at a time), then
+ *     solve for W_out once with a packed in-place Cholesky.
+ *
+ ******************************************************************************/
+
+#include "ridge_training.h"
+#include "rls_training.h"
+#include "esn_model.h"
+#include <string.h>
+
+static const esn_model_t *model = NULL;
+static float *R = NULL;      // sum z z^T, packed upper triangle
+static float *P = NULL;      // sum y z^T (num_outputs x extended_size)
+static int ridge_samples = 0;
+static float *queue_z = NULL; // samples not yet added (RIDGE_BLOCK x ext)
+static float *queue_y = NULL; // their targets (RIDGE_BLOCK x num_outputs)
+static int queued = 0;
+static int ridgeEnabled = 0;
+
+/* Offset of R(i, i) in the packed upper triangle (same layout as RLS Psi) */
+static inline int packed_row(int i, int ext)
+{
+    return i * ext - (i * (i - 1)) / 2;
+}
+
+static void ridge_clear(void)
+{
+    const int ext = model->extended_size;
+
+    memset(R, 0, sizeof(float) * RLS_PSI_PACKED_SIZE(ext));
+    memset(P, 0, sizeof(float) * model->num_outputs * ext);
+    ridge_samples = 0;
+    queued = 0;
+}
+
+/*
+ * Add the queued samples as one rank-k update of R and P, so each row of R
+ * and P is loaded and stored k/4 times instead of k times (esn_axpy_multi).
+ */
+static void ridge_flush(void)
+{
+    const int ext = model->extended_size;
+    const int n_out = model->num_outputs;
+    float coef[RIDGE_BLOCK];
+
+    // R += sum_k z_k z_k^T, upper triangle only
+    for (int i = 0; i < ext; i++) {
+        for (int k = 0; k < queued; k++) {
+            coef[k] = queue_z[k * ext + i];
+        }
+        esn_axpy_multi(ext - i, queued, coef, &queue_z[i], ext,
+                       &R[packed_row(i, ext)]);
+    }
+
+    // P += sum_k y_k z_k^T
+    for (int o = 0; o < n_out; o++) {
+        for (int k = 0; k < queued; k++) {
+            coef[k] = queue_y[k * n_out + o];
+        }
+        esn_axpy_multi(ext, queued, coef, queue_z, ext, &P[o * ext]);
+    }
+    queued = 0;
+}
+
+void ridge_configure(const esn_model_t *m)
+{
+    // The arena was reset for m: earlier buffers are gone
+    model = m;
+    ridgeEnabled = 0;
+    R = NULL;
+    P = NULL;
+    queue_z = NULL;
+    queue_y = NULL;
+    ridge_samples = 0;
+    queued = 0;
+}
+
+/* Allocate R, P and the sample queue for the model on first use */
+static int ridge_allocate(void)
+{
+    const int ext = model->extended_size;
+
+    if (R != NULL) {
+        return 0;
+    }
+    R = esn_arena_alloc(sizeof(float) * RLS_PSI_PACKED_SIZE(ext));
+    P = esn_arena_alloc(sizeof(float) * model->num_outputs * ext);
+    queue_z = esn_arena_alloc(sizeof(float) * RIDGE_BLOCK * ext);
+    queue_y = esn_arena_alloc(sizeof(float) * RIDGE_BLOCK * model->num_outputs);
+    if (R == NULL || P == NULL || queue_z == NULL || queue_y == NULL) {
+        R = NULL;
+        P = NULL;
+        queue_z = NULL;
+        queue_y = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void ridge_enable(void)
+{
+    if (model == NULL || ridge_allocate() != 0) {
+        xil_printf("Error: no room for ridge training with this model.\n\r");
+        return;
+    }
+    ridge_clear();
+    ridgeEnabled = 1;
+    xil_printf("Ridge training enabled (accumulating R and P).\n\r");
+}
+
+void ridge_disable(void)
+{
+    ridgeEnabled = 0;
+    xil_printf("Ridge training disabled.\n\r");
+}
+
+int is_ridge_enabled(void)
+{
+    return ridgeEnabled;
+}
+
+void ridge_accumulate(const float *z, const float *y_target)
+{
+    const int ext = model->extended_size;
+    const int n_out = model->num_outputs;
+
+    memcpy(&queue_z[queued * ext], z, sizeof(float) * ext);
+    memcpy(&queue_y[queued * n_out], y_target, sizeof(float) * n_out);
+    ridge_samples++;
+    if (++queued == RIDGE_BLOCK) {
+        ridge_flush();
+    }
+}
+
+/*
+ * Right-looking Cholesky of the packed matrix A = U^T U, in place: row i of
+ * the upper triangle becomes row i of U. Each step scales one row and
+ * subtracts its outer product from the rows below it. Returns the number
+ * of rows factored: n on success, or the row whose pivot was not positive
+ * (A is then partly factored, see cholesky_undo()).
+ */
+static int cholesky_packed(float *A, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float *row = &A[packed_row(i, n)];   // row[0] = A(i,i)
+
+        if (!(row[0] > 0.0f)) {
+            return i;
+        }
+        const float d = sqrtf(row[0]);
+        const float inv_d = 1.0f / d;
+
+        row[0] = d;
+        for (int j = 1; j < n - i; j++) {
+            row[j] *= inv_d;
+        }
+        // A(r, r..) -= U(i, r) * U(i, r..) for every row r below i
+        for (int r = i + 1; r < n; r++) {
+            esn_axpy(n - r, -row[r - i], &row[r - i],
+                     &A[packed_row(r, n)]);
+        }
+    }
+    return n;
+}
+
+/*
+ * Undo the first steps steps of cholesky_packed(), last step first, which
+ * gives back A up to rounding.
+ */
+static void cholesky_undo(float *A, int n, int steps)
+{
+    for (int i = steps - 1; i >= 0; i--) {
+        float *row = &A[packed_row(i, n)];
+        const float d = row[0];
+
+        for (int r = i + 1; r < n; r++) {
+            esn_axpy(n - r, row[r - i], &row[r - i], &A[packed_row(r, n)]);
+        }
+        for (int j = 1; j < n - i; j++) {
+            row[j] *= d;
+        }
+        row[0] = d * d;
+    }
+}
+
+int ridge_solve(float beta)
+{
+    if (model == NULL || ridge_samples == 0) {
+        xil_printf("Error: no ridge samples accumulated.\n\r");
+        return -1;
+    }
+
+    const int ext = model->extended_size;
+    const int n_out = model->num_outputs;
+
+    ridge_flush();
+    float max_diag = 0.0f;
+    for (int i = 0; i < ext; i++) {
+        R[packed_row(i, ext)] += beta;
+        if (R[packed_row(i, ext)] > max_diag) {
+            max_diag = R[packed_row(i, ext)];
+        }
+    }
+
+    // float R is only accurate to ~1e-7 of its largest entries, so with few
+    // samples or a tiny beta the factorization can meet a pivot <= 0.
+    // Undo it and load the diagonal, ten times more on each retry.
+    float load = RIDGE_LOAD_START;
+    float loaded = 0.0f;
+    int tries = 0;
+    int done;
+    while ((done = cholesky_packed(R, ext)) < ext) {
+        cholesky_undo(R, ext, done);
+        if (tries++ == RIDGE_LOAD_TRIES || !(max_diag > 0.0f)) {
+            xil_printf("Error: R + beta*I is not positive definite "
+                       "(too few samples for this beta; try a larger one).\n\r");
+            ridge_clear();
+            return -1;
+        }
+        for (int i = 0; i < ext; i++) {
+            R[packed_row(i, ext)] += load * max_diag - loaded;
+        }
+        loaded = load * max_diag;
+        xil_printf("Warning: R + beta*I not positive definite at row %d, "
+                   "retrying with %d ppm of max R(i,i) on the diagonal.\n\r",
+                   done, (int)(load * 1e6f + 0.5f));
+        load *= 10.0f;
+    }
+
+    // Each output row w: U^T y = p (forward), then U w = y (back), in P
+    for (int o = 0; o < n_out; o++) {
+        float *w = &P[o * ext];
+
+        for (int i = 0; i < ext; i++) {
+            const float *row = &R[packed_row(i, ext)];
+            w[i] /= row[0];
+            esn_axpy(ext - i - 1, -w[i], &row[1], &w[i + 1]);
+        }
+        for (int i = ext - 1; i >= 0; i--) {
+            const float *row = &R[packed_row(i, ext)];
+            float acc = w[i];
+            for (int j = 1; j < ext - i; j++) {
+                acc -= row[j] * w[i + j];
+            }
+            w[i] = acc / row[0];
+        }
+    }
+
+    xil_printf("Ridge solve over %d sample(s) done.\n\r", ridge_samples);
+    set_W_out(P);
+    ridge_clear();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef RIDGE_TRAINING_H
+#define RIDGE_TRAINING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esn_core.h"
+#include "xil_printf.h"
+
+/*
+ * Ridge-regression (batch least squares) training, for offline or initial
+ * training. While accumulating, every trained sample only adds to
+ *   R = sum z z^T   (extended_size^2, packed upper triangle like RLS Psi)
+ *   P = sum y z^T   (num_outputs x extended_size)
+ * over any number of DATAIN chunks. ridge_solve() then sets W_out from
+ *   (R + beta I) W_out^T = P^T
+ * with one in-place Cholesky factorization.
+ */
+
+/* Default regularization when TRN_SOLVE gives none (matches RLS_PSI_INIT) */
+#define RIDGE_DEFAULT_BETA  1.0f
+
+/* Samples queued before they are added to R and P in one rank-k update */
+#define RIDGE_BLOCK         16
+
+/*
+ * Diagonal loading when R + beta I is not numerically positive definite:
+ * the first retry adds RIDGE_LOAD_START * max R(i,i) to the diagonal, each
+ * further one ten times more, for at most RIDGE_LOAD_TRIES retries.
+ */
+#define RIDGE_LOAD_START    1e-6f
+#define RIDGE_LOAD_TRIES    6
+
+/**
+ * ridge_configure
+ * ---------------
+ * Binds ridge training to model m. Nothing is allocated until the first
+ * ridge_enable(), so models that never use it do not pay for R and P.
+ */
+void ridge_configure(const esn_model_t *m);
+
+/**
+ * ridge_enable / ridge_disable / is_ridge_enabled
+ * -----------------------------------------------
+ * While enabled, trained samples go to ridge_accumulate() instead of RLS.
+ * Enabling allocates R and P from the model arena (first time only) and
+ * clears them; it fails with a message if the arena is too small.
+ */
+void ridge_enable(void);
+void ridge_disable(void);
+int is_ridge_enabled(void);
+
+/**
+ * ridge_accumulate
+ * ----------------
+ * R += z z^T and P += y_target z^T for one sample (applied in groups of
+ * RIDGE_BLOCK samples; ridge_solve() adds any that are still queued).
+ */
+void ridge_accumulate(const float *z, const float *y_target);
+
+/**
+ * ridge_solve
+ * -----------
+ * Solves (R + beta I) W_out^T = P^T and installs the result with
+ * set_W_out(). R is factored in place, so the accumulation starts over
+ * afterwards. If rounding leaves R + beta I indefinite, the factorization
+ * is undone and retried with diagonal loading (RIDGE_LOAD_START). Returns
+ * 0 on success, -1 if nothing was accumulated or no loading helped.
+ */
+int ridge_solve(float beta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RIDGE_TRAINING_H */
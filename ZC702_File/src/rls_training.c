@@ -1,29 +1,370 @@
 #include "rls_training.h"
+#include "esn_model.h"
+#include "nlms_training.h"
 
-/* Global variables for RLS training */
-static float W_out[NUM_OUTPUTS * EXTENDED_STATE_SIZE]; // Dimensions: NUM_OUTPUTS x EXTENDED_STATE_SIZE
-static float Psi[EXTENDED_STATE_SIZE * EXTENDED_STATE_SIZE]; // Inverse correlation matrix
+/* Global variables for RLS training (allocated from the model arena) */
+static const esn_model_t *model = NULL;
+static float *W_out = NULL; // Copy being written (n_out x ext), see below
+static const float *W_src = NULL; // Published copy the update starts from
+static float *Psi = NULL;   // Inverse correlation matrix, packed (see below)
+static float *scratch = NULL; // Psi*z (selected features)
+static float psi_scale = 1.0f; // Psi = psi_scale * (stored Psi)
 static int trainingEnabled = 0;  // 1: enabled; 0: disabled
+static esn_trainer_t trainer = ESN_TRAINER_RLS;
+
+/* Set-membership RLS: skip samples in bound, step the others onto it */
+static float error_bound = 0.0f;  // 0: plain RLS on every sample
+static int selective_seen = 0;    // samples offered since the last report
+static int selective_skipped = 0; // of those, skipped
+
+/* Block RLS: samples waiting for the next rank-K update */
+static int block_size = 1;       // K (1: update every sample)
+static int block_count = 0;      // samples collected so far
+static float *block_z = NULL;    // z of each sample (K x selected features)
+static float *block_u = NULL;    // stored Psi * z per sample (K x features)
+static float *block_e = NULL;    // a-priori errors (K x num_outputs)
+static float *block_s = NULL;    // S and its Cholesky factor (K x K)
+static float block_mu[RLS_BLOCK_MAX]; // set-membership step per sample
+
+/*
+ * Double-buffered W_out: inference pins the published copy
+ * (rls_w_out_acquire()) and training never writes it. An update reads the
+ * published copy and writes the result to the other buffer in the same
+ * pass (no separate copy), then publishes it with one index store.
+ */
+static float *w_out_buf[2] = {NULL, NULL};
+static volatile int w_out_front = 0;       // index of the published copy
+static volatile int w_out_readers[2] = {0, 0};
+static int w_out_dropped = 0;              // updates dropped, W_out pinned
+
+/*
+ * Feature mask: RLS only trains the W_out columns listed in feat_idx.
+ * Psi, scratch, block_z/u and feat_z are sized to the selection.
+ */
+static int feat_n = 0;           // selected features (Psi is feat_n^2)
+static int feat_cap = 0;         // features the buffers above have room for
+static int feat_stride = 1;      // every k-th input (0: reservoir only)
+static int feat_prefix = 1;      // 1: the selection is columns 0..feat_n-1
+static int feat_span = 0;        // W_out columns 0..feat_span-1 are updated
+static int *feat_idx = NULL;     // selected columns of z and W_out
+static float *feat_z = NULL;     // z gathered to the selection
+static float *feat_x = NULL;     // K vectors spread back to z's columns
+
+/*
+ * Psi is symmetric, so only its upper triangle is stored: row i holds
+ * Psi(i, i..ext-1), rows back to back, ext*(ext+1)/2 floats in total.
+ * psi_row(i, ext) is the offset of Psi(i, i); Psi(i, j) for j >= i is at
+ * psi_row(i, ext) + (j - i).
+ */
+static inline int psi_row(int i, int ext)
+{
+    return i * ext - (i * (i - 1)) / 2;
+}
+
+/*
+ * Set-membership step for the a-priori error e = y_target - y_pred:
+ *   0                   RMS(e) <= error_bound, the sample is skipped
+ *   1 - bound / RMS(e)  otherwise; the fraction of e the update removes
+ *                       so that the a-posteriori RMS error is the bound
+ *   1                   no bound set (plain RLS)
+ */
+static float selective_step(const float *y_target, const float *y_pred)
+{
+    const int n_out = model->num_outputs;
+
+    selective_seen++;
+    if (error_bound <= 0.0f) {
+        return 1.0f;
+    }
+
+    float e2 = 0.0f;
+    for (int i = 0; i < n_out; i++) {
+        const float e = y_target[i] - y_pred[i];
+        e2 += e * e;
+    }
+    if (e2 <= error_bound * error_bound * n_out) {
+        selective_skipped++;
+        return 0.0f;
+    }
+    return 1.0f - error_bound * sqrtf((float)n_out / e2);
+}
+
+/*
+ * Fold psi_scale back into the stored matrix long before the stored values
+ * could underflow (or overflow, for lambda > 1).
+ */
+static void renormalize_psi(void)
+{
+    if (psi_scale > RLS_PSI_SCALE_LIMIT ||
+        psi_scale < 1.0f / RLS_PSI_SCALE_LIMIT) {
+        const int packed = RLS_PSI_PACKED_SIZE(feat_n);
+        for (int i = 0; i < packed; i++) {
+            Psi[i] *= psi_scale;
+        }
+        psi_scale = 1.0f;
+    }
+}
+
+/*
+ * Psi = psi_init * I (packed upper triangle over the selected features).
+ * QR-RLS keeps its factor R (Psi = R^T R) in the same storage instead,
+ * so it starts from sqrt(psi_init) * I.
+ */
+static void reset_psi(void)
+{
+    const float diag = (trainer == ESN_TRAINER_QR_RLS) ? sqrtf(model->psi_init)
+                                                        : model->psi_init;
+
+    memset(Psi, 0, sizeof(float) * RLS_PSI_PACKED_SIZE(feat_n));
+    psi_scale = 1.0f;
+    for (int i = 0; i < feat_n; i++) {
+        Psi[psi_row(i, feat_n)] = diag;
+    }
+}
+
+/*
+ * Make room for f selected features (and feat_x if the selection is not a
+ * prefix of z). Growing takes new buffers from the arena; the old ones are
+ * only reclaimed when the model is loaded again.
+ * Returns 0 on success, -1 if the arena is full (nothing is changed).
+ */
+static int reserve_features(int f, int prefix)
+{
+    if (f > feat_cap) {
+        float *psi = esn_arena_alloc(sizeof(float) * RLS_PSI_PACKED_SIZE(f));
+        float *s = esn_arena_alloc(sizeof(float) * f);
+        float *bz = esn_arena_alloc(sizeof(float) * RLS_BLOCK_MAX * f);
+        float *bu = esn_arena_alloc(sizeof(float) * RLS_BLOCK_MAX * f);
+        float *fz = esn_arena_alloc(sizeof(float) * f);
+
+        if (psi == NULL || s == NULL || bz == NULL || bu == NULL ||
+            fz == NULL) {
+            return -1;
+        }
+        Psi = psi;
+        scratch = s;
+        block_z = bz;
+        block_u = bu;
+        feat_z = fz;
+        feat_cap = f;
+    }
+    if (!prefix && feat_x == NULL) {
+        feat_x = esn_arena_alloc(sizeof(float) * RLS_BLOCK_MAX *
+                                 model->extended_size);
+        if (feat_x == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Select all reservoir neurons plus every stride-th input (stride 0: no
+ * inputs, 1: all of z). Since z = [state; input], strides 0 and 1 select
+ * a prefix of z, which needs no gather or scatter.
+ * Returns -1 (keeping the old selection) if the buffers cannot grow.
+ */
+static int select_features(int stride)
+{
+    const int n = model->num_neurons;
+    const int inputs = (stride > 0) ? (model->num_inputs + stride - 1) / stride
+                                    : 0;
+    const int prefix = (stride == 1 || inputs <= 1);
+
+    if (reserve_features(n + inputs, prefix) != 0) {
+        return -1;
+    }
+    feat_stride = stride;
+    feat_n = 0;
+    for (int i = 0; i < n; i++) {
+        feat_idx[feat_n++] = i;
+    }
+    for (int i = 0; stride > 0 && i < model->num_inputs; i += stride) {
+        feat_idx[feat_n++] = n + i;
+    }
+    feat_prefix = prefix;
+    feat_span = feat_idx[feat_n - 1] + 1;
+    if (!prefix) {
+        // The columns in between stay zero in feat_x
+        memset(feat_x, 0, sizeof(float) * RLS_BLOCK_MAX * model->extended_size);
+    }
+    return 0;
+}
+
+/* z restricted to the selected features */
+static const float *gather_features(const float *z)
+{
+    if (feat_prefix) {
+        return z;
+    }
+    for (int j = 0; j < feat_n; j++) {
+        feat_z[j] = z[feat_idx[j]];
+    }
+    return feat_z;
+}
+
+/*
+ * k vectors over the selected features, x_c = &x[c * ldx], put back in
+ * the columns of z they came from with zeros in between (feat_x), once
+ * per update rather than once per W_out row. *ld is the result's stride.
+ */
+static const float *spread_features(int k, const float *x, int ldx, int *ld)
+{
+    const int ext = model->extended_size;
+    const int n = model->num_neurons;
+
+    if (feat_prefix) {
+        *ld = ldx;
+        return x;
+    }
+    for (int c = 0; c < k; c++) {
+        float *dst = &feat_x[c * ext];
+        const float *src = &x[c * ldx];
+
+        memcpy(dst, src, sizeof(float) * n);
+        for (int j = n; j < feat_n; j++) {
+            dst[feat_idx[j]] = src[j];
+        }
+    }
+    *ld = ext;
+    return feat_x;
+}
+
+/*
+ * W_out(i,:) = W_src(i,:) + sum_c a[c] * x_c over columns 0..feat_span-1,
+ * x_c = &x[c * ldx] from spread_features(): one contiguous multiply-add
+ * stream that also moves the row to the back buffer. The unselected
+ * columns in the span get zero added; those past it are copied.
+ */
+static void update_w_out_row(int i, int k, const float *a,
+                             const float *x, int ldx)
+{
+    const int ext = model->extended_size;
+
+    esn_axpy_multi_from(feat_span, k, a, x, ldx, &W_src[i * ext],
+                        &W_out[i * ext]);
+    if (feat_span < ext) {
+        memcpy(&W_out[i * ext + feat_span], &W_src[i * ext + feat_span],
+               sizeof(float) * (ext - feat_span));
+    }
+}
+
+/*
+ * Point W_src at the published copy and W_out at the other buffer, which
+ * the update overwrites up to publish_w_out(). A reader still pinning the
+ * other buffer's older snapshot is waited for; one that stays longer than
+ * RLS_PIN_SPIN_LIMIT polls drops the update. Returns 0, or -1 if the
+ * update has to be dropped (Psi must not change).
+ */
+static int prepare_w_out(void)
+{
+    const int front = w_out_front;
+    const int back = 1 - front;
+
+    for (int spin = 0; w_out_readers[back] != 0; spin++) {
+        if (spin == RLS_PIN_SPIN_LIMIT) {
+            w_out_dropped++;
+            return -1;
+        }
+    }
+    W_src = w_out_buf[front];
+    W_out = w_out_buf[back];
+    return 0;
+}
+
+/*
+ * Publish the buffer prepare_w_out() handed out by flipping the front
+ * index. Every W_out write is visible first, so a reader never sees a
+ * half update; the flip is visible before the next prepare_w_out() looks
+ * for readers, so a reader that pinned the old front sees it moved.
+ */
+static void publish_w_out(void)
+{
+    __sync_synchronize();
+    w_out_front = 1 - w_out_front;
+    __sync_synchronize();
+}
+
+/**
+ * rls_configure
+ * -------------
+ * Allocates W_out and Psi for model m from the model arena, then
+ * initializes them with init_rls().
+ */
+int rls_configure(const esn_model_t *m)
+{
+    model = m;
+    trainer = m->trainer;
+    w_out_buf[0] = esn_arena_alloc(sizeof(float) * m->num_outputs *
+                                   m->extended_size);
+    w_out_buf[1] = esn_arena_alloc(sizeof(float) * m->num_outputs *
+                                   m->extended_size);
+    W_out = (w_out_buf[0] != NULL) ? w_out_buf[1] : NULL;
+    Psi = NULL;
+    scratch = NULL;
+    block_z = NULL;
+    block_u = NULL;
+    feat_z = NULL;
+    feat_x = NULL;
+    feat_cap = 0;
+    if (W_out != NULL && trainer == ESN_TRAINER_NLMS) {
+        // NLMS only needs W_out: no Psi or block buffers
+        block_e = NULL;
+        block_s = NULL;
+        feat_idx = NULL;
+        init_rls();
+        return 0;
+    }
+    // Psi and the per-feature buffers come with the feature selection
+    block_e = esn_arena_alloc(sizeof(float) * RLS_BLOCK_MAX * m->num_outputs);
+    block_s = esn_arena_alloc(sizeof(float) * RLS_BLOCK_MAX * RLS_BLOCK_MAX);
+    feat_idx = esn_arena_alloc(sizeof(int) * m->extended_size);
+    if (W_out == NULL || block_e == NULL || block_s == NULL ||
+        feat_idx == NULL || select_features(m->feature_stride) != 0) {
+        model = NULL;
+        w_out_buf[0] = NULL;
+        w_out_buf[1] = NULL;
+        W_out = NULL;
+        Psi = NULL;
+        scratch = NULL;
+        block_z = NULL;
+        block_u = NULL;
+        block_e = NULL;
+        block_s = NULL;
+        feat_idx = NULL;
+        feat_z = NULL;
+        feat_x = NULL;
+        feat_cap = 0;
+        return -1;
+    }
+
+    init_rls();
+    return 0;
+}
 
 /**
  * init_rls
  * --------
  * Initializes the RLS training module.
- * W_out is set to zero and Psi is initialized as an identity matrix.
+ * W_out is set to zero and Psi is initialized as psi_init times the
+ * identity matrix (psi_init from the model, 1.0 by default).
  */
 void init_rls(void)
 {
-    // Optionally initialize W_out to zeros.
-    memset(W_out, 0, sizeof(W_out));
+    const int ext = model->extended_size;
 
-    // Initialize Psi as an identity matrix.
-    for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-        for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-            if (i == j)
-                Psi[i * EXTENDED_STATE_SIZE + j] = 1.0f; // or a tuned initial value
-            else
-                Psi[i * EXTENDED_STATE_SIZE + j] = 0.0f;
-        }
+    // Optionally initialize W_out to zeros (both copies, front is 0).
+    memset(w_out_buf[0], 0, sizeof(float) * model->num_outputs * ext);
+    memset(w_out_buf[1], 0, sizeof(float) * model->num_outputs * ext);
+    w_out_front = 0;
+    W_src = w_out_buf[0];
+    W_out = w_out_buf[1];
+    w_out_dropped = 0;
+
+    // Initialize Psi as a scaled identity matrix (RLS models only).
+    block_count = 0;
+    if (Psi != NULL) {
+        reset_psi();
     }
 
     xil_printf("RLS training module initialized (OFF).\n\r");
@@ -43,8 +384,10 @@ void init_rls(void)
  * 4. Update W_out: W_out = W_out + error * k^T.
  * 5. Update Psi: Psi = (Psi - k * (z^T * Psi)) / lambda.
  *
- * @param z         Extended state vector (size: EXTENDED_STATE_SIZE)
- * @param y_target  Desired target output vector (size: NUM_OUTPUTS)
+ * Steps 2-5 are update_training_rls_fused().
+ *
+ * @param z         Extended state vector (size: extended_size)
+ * @param y_target  Desired target output vector (size: num_outputs)
  */
 void update_training_rls(const float *z, const float *y_target)
 {
@@ -53,62 +396,452 @@ void update_training_rls(const float *z, const float *y_target)
         return;
     }
 
-    float y_pred[NUM_OUTPUTS] = {0};
+    const int ext = model->extended_size;
+    const int n_out = model->num_outputs;
+
+    float y_pred[ESN_MAX_OUTPUTS];
     // Step 1: Compute the predicted output y_pred = W_out * z.
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
-        for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-            y_pred[i] += W_out[i * EXTENDED_STATE_SIZE + j] * z[j];
+    const float *w = rls_w_out_acquire();
+    if (w == NULL) {
+        return;
+    }
+    esn_gemv(w, ext, z, n_out, ext, y_pred);
+    rls_w_out_release(w);
+
+    update_training_rls_fused(z, y_target, y_pred);
+}
+
+/*
+ * Inverse QR-RLS step on the gathered features z (Alexander & Ghirnikar).
+ * Psi is never formed: Psi = R^T R with R upper triangular, stored like
+ * Psi (row j of R is column j of the lower factor L = R^T). The prearray
+ *   [ 1   a^T          ]     a = lambda^-1/2 * R * z
+ *   [ 0   lambda^-1/2 L ]
+ * is rotated column by column (Givens, last column first so L stays
+ * lower triangular) until a is zero, which leaves
+ *   [ gamma^-1/2       0  ]
+ *   [ k * gamma^-1/2   L' ]
+ * with L' the factor of the updated Psi and k the usual RLS gain. Psi
+ * stays positive definite by construction, whatever the rounding.
+ */
+static void update_training_qr(const float *z, const float *y_target,
+                               const float *y_pred, float mu)
+{
+    const int f = feat_n;
+    const int n_out = model->num_outputs;
+    const float lambda_r = 1.0f / sqrtf(model->forgetting_factor);
+    float *g = scratch;   // first column below the pivot: k * gamma^-1/2
+    float pivot = 1.0f;   // gamma^-1/2 once all rotations are done
+
+    // Set-membership weight w (see update_training_rls_fused()): starting
+    // the pivot at w^-1/2 is the prearray of the sample scaled by w^1/2,
+    // and the rotations then give the weighted gain directly. a^T a is
+    // needed first, one extra pass over R.
+    if (mu < 1.0f) {
+        float aa = 0.0f;
+        for (int j = 0; j < f; j++) {
+            const float a = esn_dot(f - j, &Psi[psi_row(j, f)], &z[j]);
+            aa += a * a;
+        }
+        aa *= lambda_r * lambda_r;
+        if (aa * (1.0f / mu - 1.0f) > 1.0f) {
+            pivot = sqrtf(aa * (1.0f / mu - 1.0f));
         }
     }
 
-    // Step 2: Compute the error vector: error = y_target - y_pred.
-    float error[NUM_OUTPUTS];
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
-        error[i] = y_target[i] - y_pred[i];
+    memset(g, 0, sizeof(float) * f);
+    for (int j = f - 1; j >= 0; j--) {
+        float *row = &Psi[psi_row(j, f)];     // R(j, j..f-1)
+
+        // Row j of R is untouched by the rotations so far: a(j) from it
+        const float a = lambda_r * esn_dot(f - j, row, &z[j]);
+        const float r = sqrtf(pivot * pivot + a * a);
+        const float c = pivot / r;
+        const float s = a / r;
+
+        // (g, R(j,:)) <- (c * g + s * L(:,j), c * L(:,j) - s * g) with
+        // L(:,j) = lambda^-1/2 * R(j,:); g(j..) holds zeros until now
+        esn_rotate(f - j, c, s * lambda_r, -s, c * lambda_r, &g[j], row);
+        pivot = r;
+    }
+
+    // W_out += e * k^T, k = g / pivot
+    int ld;
+    const float *gx = spread_features(1, g, f, &ld);
+    for (int i = 0; i < n_out; i++) {
+        const float a = (y_target[i] - y_pred[i]) / pivot;
+        update_w_out_row(i, 1, &a, gx, ld);
     }
+}
 
-    // Step 3: Compute temp vector = Psi * z.
-    float temp_vec[EXTENDED_STATE_SIZE] = {0};
-    for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-        for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-            temp_vec[i] += Psi[i * EXTENDED_STATE_SIZE + j] * z[j];
+/**
+ * update_training_rls_fused
+ * -------------------------
+ * Steps 2-5 of update_training_rls(), given the prediction y_pred = W_out*z
+ * the inference step already produced.
+ *
+ * Psi is symmetric, so z^T * Psi is (Psi * z)^T: one pass over the packed
+ * Psi gives p = Psi * z, and both rank-1 updates are written in terms of p
+ * and 1/d (the gain k = p / d is never stored):
+ *   W_out(i,:) += (e(i) / d) * p^T
+ *   Psi(i,j)    = (Psi(i,j) - (p(i) / d) * p(j)) / lambda,  j >= i
+ *
+ * The 1/lambda is not applied to the matrix: Psi = psi_scale * (stored),
+ * with q = stored * z and p = psi_scale * q the update becomes
+ *   stored(i,j) -= (psi_scale / d) * q(i) * q(j),   psi_scale /= lambda
+ * so each Psi row is a single multiply-add stream (esn_axpy()).
+ *
+ * With an error bound set (rls_set_error_bound()) this is set-membership
+ * RLS: a sample in bound is skipped, and any other is weighted so that
+ * the update takes out the fraction mu = 1 - bound / RMS(e) of its error.
+ * The weighted sample enters d as lambda / w + G, G = z^T Psi z, and the
+ * a-posteriori error is e * (1 - G / d), so
+ *   d = max(lambda + G, G / mu)
+ * leaves exactly the bound behind, except that a step is never larger
+ * than plain RLS takes (w <= 1).
+ */
+void update_training_rls_fused(const float *z, const float *y_target,
+                               const float *y_pred)
+{
+    if (!trainingEnabled) {
+        return;
+    }
+    const float mu = selective_step(y_target, y_pred);
+    if (mu <= 0.0f || prepare_w_out() != 0) {
+        return;
+    }
+    if (trainer == ESN_TRAINER_NLMS) {
+        update_training_nlms(model, W_src, W_out, z, y_target, y_pred, mu);
+        publish_w_out();
+        return;
+    }
+    if (trainer == ESN_TRAINER_QR_RLS) {
+        update_training_qr(gather_features(z), y_target, y_pred, mu);
+        publish_w_out();
+        return;
+    }
+
+    // Psi, q and the update only span the selected features
+    const int f = feat_n;
+    const int n_out = model->num_outputs;
+    const float lambda = model->forgetting_factor;
+
+    z = gather_features(z);
+
+    // Step 3: q = stored Psi * z. Each stored Psi(i,j), j > i, also stands
+    // in for Psi(j,i) below the diagonal.
+    float *q = scratch;
+    memset(q, 0, sizeof(float) * f);
+    for (int i = 0; i < f; i++) {
+        const float *row = &Psi[psi_row(i, f) - i];  // row[j] = Psi(i,j)
+        q[i] += row[i] * z[i] +
+                esn_dot_axpy(f - i - 1, &row[i + 1], &z[i + 1], z[i],
+                             &q[i + 1]);
+    }
+
+    // Denominator d = lambda + z^T * Psi * z = lambda + psi_scale * z^T * q,
+    // or G / mu for a set-membership step.
+    float zq = 0.0f;
+    for (int i = 0; i < f; i++) {
+        zq += z[i] * q[i];
+    }
+    const float G = psi_scale * zq;
+    const float d = (G / mu > lambda + G) ? G / mu : lambda + G;
+    const float c = psi_scale / d;
+
+    // Steps 2 and 4: W_out += (error / d) * p^T = (error * c) * q^T.
+    int ld;
+    const float *qx = spread_features(1, q, f, &ld);
+    for (int i = 0; i < n_out; i++) {
+        const float a = (y_target[i] - y_pred[i]) * c;
+        update_w_out_row(i, 1, &a, qx, ld);
+    }
+
+    // Step 5: stored Psi -= c * q * q^T (upper triangle), Psi scale / lambda.
+    // Kept apart from the W_out loop: the two share only q, and folding
+    // W_out into this loop would walk it by column (stride ext).
+    for (int i = 0; i < f; i++) {
+        float *row = &Psi[psi_row(i, f)];
+        esn_axpy(f - i, -c * q[i], &q[i], row);
+    }
+    psi_scale /= lambda;
+    renormalize_psi();
+    publish_w_out();
+}
+
+/**
+ * rls_set_error_bound
+ * -------------------
+ * Set-membership RLS: skip the update for samples whose a-priori RMS error
+ * over the outputs is at most bound, and step the others just far enough
+ * to bring it down to the bound. 0 turns it off.
+ */
+void rls_set_error_bound(float bound)
+{
+    error_bound = (bound > 0.0f) ? bound : 0.0f;
+    selective_seen = 0;
+    selective_skipped = 0;
+    xil_printf("RLS error bound: %d/1000000 (0 = update every sample).\n\r",
+               (int)(error_bound * 1e6f));
+}
+
+/**
+ * rls_print_skip_stats
+ * --------------------
+ * Print how many offered samples the error bound skipped since the last
+ * call, and how many updates a pinned W_out dropped, then start counting
+ * again.
+ */
+void rls_print_skip_stats(void)
+{
+    if (error_bound > 0.0f && selective_seen > 0) {
+        xil_printf("RLS updates skipped: %d of %d (%d%%)\n\r",
+                   selective_skipped, selective_seen,
+                   (100 * selective_skipped) / selective_seen);
+    }
+    selective_seen = 0;
+    selective_skipped = 0;
+    if (w_out_dropped > 0) {
+        xil_printf("RLS updates dropped, W_out pinned by a reader: %d\n\r",
+                   w_out_dropped);
+        w_out_dropped = 0;
+    }
+}
+
+/**
+ * rls_set_trainer
+ * ---------------
+ * Switch the online trainer for this session. (QR-)RLS needs the Psi that
+ * rls_configure() only allocates for RLS models; switching to RLS or
+ * QR-RLS resets Psi (they store it differently), switching to NLMS keeps
+ * it untouched, and W_out carries over.
+ */
+int rls_set_trainer(esn_trainer_t t)
+{
+    static const char *const names[] = {"RLS", "NLMS", "QR-RLS"};
+
+    if (t != ESN_TRAINER_NLMS && Psi == NULL) {
+        xil_printf("Error: this model was loaded for NLMS (no Psi).\n\r");
+        return -1;
+    }
+    rls_block_flush();
+    if (t != ESN_TRAINER_NLMS && t != trainer) {
+        trainer = t;
+        reset_psi();
+    }
+    trainer = t;
+    xil_printf("Trainer: %s\n\r", names[t]);
+    return 0;
+}
+
+/**
+ * rls_set_feature_stride
+ * ----------------------
+ * Train on the reservoir plus every stride-th input (0: reservoir only,
+ * 1: all of z). Psi restarts at psi_init * I for the new selection; the
+ * other W_out columns keep their values and are no longer trained.
+ */
+int rls_set_feature_stride(int stride)
+{
+    if (Psi == NULL) {
+        xil_printf("Error: this model was loaded for NLMS (no Psi).\n\r");
+        return -1;
+    }
+    if (stride < 0 || stride > model->num_inputs) {
+        xil_printf("Error: feature stride must be 0..%d.\n\r",
+                   model->num_inputs);
+        return -1;
+    }
+    rls_block_flush();
+    if (select_features(stride) != 0) {
+        xil_printf("Error: no room for the Psi of input stride %d.\n\r",
+                   stride);
+        return -1;
+    }
+    reset_psi();
+    xil_printf("RLS features: %d of %d (input stride %d)\n\r",
+               feat_n, model->extended_size, feat_stride);
+    return 0;
+}
+
+/**
+ * rls_set_block_size
+ * ------------------
+ * Number of samples K per block update (1..RLS_BLOCK_MAX). Any samples
+ * already collected are applied first.
+ */
+void rls_set_block_size(int k)
+{
+    if (k < 1 || k > RLS_BLOCK_MAX) {
+        xil_printf("Error: RLS block size must be 1..%d.\n\r", RLS_BLOCK_MAX);
+        return;
+    }
+    rls_block_flush();
+    block_size = k;
+    xil_printf("RLS block size: %d sample(s).\n\r", block_size);
+}
+
+int rls_get_block_size(void)
+{
+    return block_size;
+}
+
+/**
+ * rls_block_push
+ * --------------
+ * Queue one training sample. y_pred must come from the W_out in effect at
+ * the start of the block (W_out is not changed until the block is full),
+ * so its error is the block's a-priori error. With K = 1 this is
+ * update_training_rls_fused().
+ */
+void rls_block_push(const float *z, const float *y_target,
+                    const float *y_pred)
+{
+    if (!trainingEnabled) {
+        return;
+    }
+    if (block_size == 1 || trainer != ESN_TRAINER_RLS) {
+        update_training_rls_fused(z, y_target, y_pred);
+        return;
+    }
+    const float mu = selective_step(y_target, y_pred);
+    if (mu <= 0.0f) {
+        return;
+    }
+
+    const int n_out = model->num_outputs;
+    float *e = &block_e[block_count * n_out];
+
+    block_mu[block_count] = mu;
+    memcpy(&block_z[block_count * feat_n], gather_features(z),
+           sizeof(float) * feat_n);
+    for (int i = 0; i < n_out; i++) {
+        e[i] = y_target[i] - y_pred[i];
+    }
+
+    if (++block_count == block_size) {
+        rls_block_flush();
+    }
+}
+
+/**
+ * rls_block_flush
+ * ---------------
+ * Apply the queued samples z_0..z_{K-1} in one rank-K update. With
+ * Z = [z_0 ... z_{K-1}], U = Psi * Z and errors E = [e_0 ... e_{K-1}]
+ * taken against the block's starting W_out, K sequential RLS steps are
+ * (matrix inversion lemma, exact up to rounding):
+ *   S     = diag(lambda^1 .. lambda^K) + Z^T * U      (K x K, SPD)
+ *   W_out = W_out + E * S^-1 * U^T
+ *   Psi   = (Psi - U * S^-1 * U^T) / lambda^K
+ * Psi is read once for U and written once, instead of twice per sample.
+ */
+void rls_block_flush(void)
+{
+    const int k_n = block_count;
+
+    if (k_n == 0) {
+        return;
+    }
+    block_count = 0;
+
+    const int f = feat_n;  // U, Z and Psi only span the selected features
+    const int n_out = model->num_outputs;
+    const float lambda = model->forgetting_factor;
+    float *S = block_s;
+    float g[RLS_BLOCK_MAX];
+
+    // U = stored Psi * Z, one pass over the packed rows for all K columns
+    memset(block_u, 0, sizeof(float) * k_n * f);
+    for (int i = 0; i < f; i++) {
+        const float *row = &Psi[psi_row(i, f) - i];  // row[j] = Psi(i,j)
+        for (int k = 0; k < k_n; k++) {
+            const float *z = &block_z[k * f];
+            float *u = &block_u[k * f];
+            u[i] += row[i] * z[i] +
+                    esn_dot_axpy(f - i - 1, &row[i + 1], &z[i + 1], z[i],
+                                 &u[i + 1]);
         }
     }
 
-    // Compute denominator: d = lambda + z^T * (Psi * z).
-    float d = RLS_FORGETTING_FACTOR;
-    for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-        d += z[i] * temp_vec[i];
+    // S = diag(lambda^(k+1)) + psi_scale * Z^T * U (lower triangle used).
+    // A set-membership weight raises sample k's diagonal term to
+    // G_k * (1 / mu_k - 1), G_k against the block's starting Psi (exact
+    // for K = 1, as in update_training_rls_fused()).
+    float lambda_k = lambda;
+    for (int a = 0; a < k_n; a++) {
+        for (int b = 0; b <= a; b++) {
+            const float *z = &block_z[a * f];
+            const float *u = &block_u[b * f];
+            float acc = 0.0f;
+            for (int j = 0; j < f; j++) {
+                acc += z[j] * u[j];
+            }
+            S[a * RLS_BLOCK_MAX + b] = psi_scale * acc;
+        }
+        const float sm = S[a * RLS_BLOCK_MAX + a] * (1.0f / block_mu[a] - 1.0f);
+        S[a * RLS_BLOCK_MAX + a] += (sm > lambda_k) ? sm : lambda_k;
+        lambda_k *= lambda;
     }
 
-    // Step 4: Compute gain vector k = (Psi * z) / d.
-    float k[EXTENDED_STATE_SIZE] = {0};
-    for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-        k[i] = temp_vec[i] / d;
+    // Cholesky S = L * L^T in place (S is SPD: diag > 0 plus a Gram matrix)
+    for (int a = 0; a < k_n; a++) {
+        for (int b = 0; b <= a; b++) {
+            float acc = S[a * RLS_BLOCK_MAX + b];
+            for (int c = 0; c < b; c++) {
+                acc -= S[a * RLS_BLOCK_MAX + c] * S[b * RLS_BLOCK_MAX + c];
+            }
+            if (a == b) {
+                S[a * RLS_BLOCK_MAX + a] = sqrtf(acc);
+            } else {
+                S[a * RLS_BLOCK_MAX + b] = acc / S[b * RLS_BLOCK_MAX + b];
+            }
+        }
     }
 
-    // Step 5: Update the output weight matrix W_out.
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
-        for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-            W_out[i * EXTENDED_STATE_SIZE + j] += error[i] * k[j];
+    // U <- U * L^-T, so U * S^-1 * U^T = U' * U'^T and E * S^-1 * U^T =
+    // (E * L^-T) * U'^T. Each element row of U is solved on its own.
+    for (int j = 0; j < f; j++) {
+        for (int a = 0; a < k_n; a++) {
+            float acc = block_u[a * f + j];
+            for (int c = 0; c < a; c++) {
+                acc -= S[a * RLS_BLOCK_MAX + c] * block_u[c * f + j];
+            }
+            block_u[a * f + j] = acc / S[a * RLS_BLOCK_MAX + a];
         }
     }
 
-    // Step 6: Compute z^T * Psi (store as a row vector).
-    float zTPsi[EXTENDED_STATE_SIZE] = {0};
-    for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-        for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-            zTPsi[j] += z[i] * Psi[i * EXTENDED_STATE_SIZE + j];
+    // W_out += psi_scale * (E * L^-T) * U'^T
+    int ld;
+    const float *ux = spread_features(k_n, block_u, f, &ld);
+    if (prepare_w_out() != 0) {
+        return;     // Psi is untouched: the block is dropped as a whole
+    }
+    for (int i = 0; i < n_out; i++) {
+        for (int a = 0; a < k_n; a++) {
+            float acc = block_e[a * n_out + i];
+            for (int c = 0; c < a; c++) {
+                acc -= S[a * RLS_BLOCK_MAX + c] * g[c];
+            }
+            g[a] = acc / S[a * RLS_BLOCK_MAX + a];
         }
+        for (int a = 0; a < k_n; a++) {
+            g[a] *= psi_scale;
+        }
+        update_w_out_row(i, k_n, g, ux, ld);
     }
 
-    // Step 7: Update Psi: Psi = (Psi - k * (z^T * Psi)) / lambda.
-    for (int i = 0; i < EXTENDED_STATE_SIZE; i++) {
-        for (int j = 0; j < EXTENDED_STATE_SIZE; j++) {
-            Psi[i * EXTENDED_STATE_SIZE + j] = (Psi[i * EXTENDED_STATE_SIZE + j] -
-                k[i] * zTPsi[j]) / RLS_FORGETTING_FACTOR;
+    // stored Psi -= psi_scale * U' * U'^T (upper triangle), scale / lambda^K
+    for (int i = 0; i < f; i++) {
+        for (int a = 0; a < k_n; a++) {
+            g[a] = -psi_scale * block_u[a * f + i];
         }
+        esn_axpy_multi(f - i, k_n, g, &block_u[i], f,
+                       &Psi[psi_row(i, f)]);
     }
+    psi_scale /= lambda_k / lambda;
+    renormalize_psi();
+    publish_w_out();
 }
 
 void enable_training(void)
@@ -123,14 +856,47 @@ void disable_training(void)
     xil_printf("RLS training disabled.\n\r");
 }
 
-float *get_W_out(void)
+int is_training_enabled(void)
+{
+    return trainingEnabled;
+}
+
+const float *rls_w_out_acquire(void)
 {
-    return W_out;
+    for (int spin = 0; spin < RLS_PIN_SPIN_LIMIT; spin++) {
+        const int front = w_out_front;
+
+        __sync_fetch_and_add(&w_out_readers[front], 1);
+        // Still the front after the pin: the writer checks the pins before
+        // writing the back buffer, so it will not touch it until released
+        if (front == w_out_front) {
+            return w_out_buf[front];
+        }
+        __sync_fetch_and_sub(&w_out_readers[front], 1);
+    }
+    return NULL;
+}
+
+void rls_w_out_release(const float *w)
+{
+    __sync_fetch_and_sub(&w_out_readers[w == w_out_buf[1]], 1);
 }
 
 void set_W_out(const float *new_W_out)
 {
-    // Overwrite the existing W_out matrix with new values.
-    memcpy(W_out, new_W_out, sizeof(W_out));
+    // Write the new values into the back buffer and publish them at once,
+    // so inference never sees a half-uploaded W_out.
+    if (prepare_w_out() != 0) {
+        xil_printf("Error: W_out is pinned by a reader, not updated.\n\r");
+        return;
+    }
+    if (new_W_out != NULL) {
+        memcpy(W_out, new_W_out,
+               sizeof(float) * model->num_outputs * model->extended_size);
+    } else {
+        memset(W_out, 0,
+               sizeof(float) * model->num_outputs * model->extended_size);
+    }
+    publish_w_out();
     xil_printf("W_out successfully updated from external source.\n\r");
 }
@@ -5,18 +5,50 @@
 extern "C" {
 #endif
 
-#include "esn_core.h"   // Must define NUM_INPUTS, NUM_NEURONS, NUM_OUTPUTS, and EXTENDED_STATE_SIZE
+#include "esn_core.h"   // esn_model_t and the default NUM_* dimensions
 #include "xil_printf.h"
 #include <string.h>
 #include <stdlib.h>
 
-/* Define the forgetting factor for RLS training */
+/* Default forgetting factor and initial Psi scale (the model can override) */
 #define RLS_FORGETTING_FACTOR  0.999f
+#define RLS_PSI_INIT           1.0f
+
+/* Floats in the packed (upper-triangular) Psi for an extended size n */
+#define RLS_PSI_PACKED_SIZE(n) ((n) * ((n) + 1) / 2)
+
+/*
+ * Psi is stored without its accumulated 1/lambda^n factor, which is kept
+ * as a scalar and folded back into the matrix once it passes this limit
+ * (every ~11000 samples at lambda = 0.999).
+ */
+#define RLS_PSI_SCALE_LIMIT    65536.0f
+
+/* Largest block size K for rls_set_block_size() */
+#define RLS_BLOCK_MAX          32
+
+/*
+ * Polls training waits for a reader (rls_w_out_acquire()) to release the
+ * W_out copy it needs (a few milliseconds) before dropping the update,
+ * and tries rls_w_out_acquire() makes before giving up.
+ */
+#define RLS_PIN_SPIN_LIMIT     1000000
+
+/**
+ * rls_configure
+ * -------------
+ * Allocates W_out and Psi (RLS models only, sized to the features that
+ * m->feature_stride selects) for model m from the model arena and
+ * initializes them with init_rls(). m must stay valid while training is
+ * in use.
+ * Returns 0 on success, -1 if the arena is too small.
+ */
+int rls_configure(const esn_model_t *m);
 
 /**
  * init_rls
  * --------
- * Initializes the RLS training module.
+ * Initializes the RLS training module (after rls_configure()).
  * This function sets up the initial output weight matrix and the inverse
  * correlation matrix (Psi) used in the training updates.
  */
@@ -28,12 +60,91 @@ void init_rls(void);
  * Performs an RLS update for a single sample.
  *
  * @param z         The extended state vector for the current sample
- *                  (size: EXTENDED_STATE_SIZE).
+ *                  (size: extended_size).
  * @param y_target  The desired (target) output vector for the current sample
- *                  (size: NUM_OUTPUTS).
+ *                  (size: num_outputs).
  */
 void update_training_rls(const float *z, const float *y_target);
 
+/**
+ * update_training_rls_fused
+ * -------------------------
+ * Same update as update_training_rls(), reusing a prediction that was
+ * already computed with the current W_out (the inference output), so
+ * W_out * z is not evaluated twice.
+ *
+ * @param z         Extended state vector (size: extended_size)
+ * @param y_target  Desired target output vector (size: num_outputs)
+ * @param y_pred    W_out * z for the current W_out (size: num_outputs)
+ */
+void update_training_rls_fused(const float *z, const float *y_target,
+                               const float *y_pred);
+
+/**
+ * rls_set_trainer
+ * ---------------
+ * Select RLS or NLMS (nlms_training.h) for the updates above. Models
+ * loaded with the NLMS trainer have no Psi and cannot switch to RLS
+ * (returns -1). Returns 0 on success.
+ */
+int rls_set_trainer(esn_trainer_t t);
+
+/**
+ * rls_set_feature_stride
+ * ----------------------
+ * Feature-masked RLS: train W_out on the reservoir state plus every
+ * stride-th input only (0 = reservoir only, 1 = all of z, the default).
+ * Psi shrinks to the selected feature count and the update cost scales
+ * with it. The other W_out columns are kept but no longer trained.
+ * Resets Psi. A selection larger than any before it allocates a new Psi
+ * from the model arena. Returns 0 on success, -1 for a bad stride, an
+ * NLMS model or a full arena.
+ */
+int rls_set_feature_stride(int stride);
+
+/**
+ * rls_set_error_bound / rls_print_skip_stats
+ * ------------------------------------------
+ * Set-membership RLS: a sample whose a-priori RMS error over the outputs
+ * is at most bound is skipped; any other sample is weighted so that its
+ * update leaves an RMS error of exactly bound (never more weight than
+ * plain RLS gives it). NLMS scales its step by 1 - bound / RMS(e) instead.
+ * 0 = plain RLS on every sample, the default. The skipped fraction is
+ * printed per chunk. A bound just above the noise RMS, about 1.05-1.1
+ * times sigma, skips 60-75% of the updates of a converged model without
+ * losing accuracy. Updates dropped because W_out was pinned are printed
+ * with the skipped fraction.
+ */
+void rls_set_error_bound(float bound);
+void rls_print_skip_stats(void);
+
+/**
+ * rls_set_block_size / rls_get_block_size
+ * ---------------------------------------
+ * Block RLS: apply K samples (1..RLS_BLOCK_MAX) at a time in one rank-K
+ * update instead of K rank-1 updates. K = 1 (default) is plain RLS.
+ */
+void rls_set_block_size(int k);
+int rls_get_block_size(void);
+
+/**
+ * rls_block_push
+ * --------------
+ * Queue one training sample for the block update (arguments as for
+ * update_training_rls_fused()). W_out only changes when K samples have
+ * been queued, so y_pred for every sample of a block comes from the same
+ * W_out.
+ */
+void rls_block_push(const float *z, const float *y_target,
+                    const float *y_pred);
+
+/**
+ * rls_block_flush
+ * ---------------
+ * Apply any queued samples now (end of a DATAIN chunk).
+ */
+void rls_block_flush(void);
+
 /**
  * enable_training / disable_training
  * -----------------------------------
@@ -43,20 +154,36 @@ void enable_training(void);
 void disable_training(void);
 
 /**
- * get_W_out
- * ---------
- * Returns a pointer to the current output weight matrix W_out.
- * This matrix is used by the ESN core to compute network outputs.
+ * is_training_enabled
+ * -------------------
+ * Returns 1 while RLS training is on (W_out may change every sample).
+ */
+int is_training_enabled(void);
+
+/**
+ * rls_w_out_acquire / rls_w_out_release
+ * -------------------------------------
+ * Pin the published output weight matrix W_out (num_outputs x
+ * extended_size) while reading it; every reader goes through the pin.
+ * Training never writes the published copy: it writes the other buffer
+ * and flips, so a pinned snapshot stays as it was until released. Release
+ * before training on the same core. A pin held across two updates makes
+ * training drop the second one (RLS_PIN_SPIN_LIMIT). acquire returns NULL
+ * if no copy could be pinned within RLS_PIN_SPIN_LIMIT tries.
  */
-float *get_W_out(void);
+const float *rls_w_out_acquire(void);
+void rls_w_out_release(const float *w);
 
 /**
  * set_W_out
  * ---------
- * Updates the global W_out matrix with new values provided by new_W_out.
+ * Updates the global W_out matrix with new values provided by new_W_out,
+ * written to the back buffer and then published in one step (not updated,
+ * with an error, if a reader still pins the back buffer).
  *
  * @param new_W_out A pointer to the external array containing updated weights.
- *                  Its length should be NUM_OUTPUTS * EXTENDED_STATE_SIZE.
+ *                  Its length should be num_outputs * extended_size.
+ *                  NULL sets W_out to zero.
  */
 void set_W_out(const float *new_W_out);
 
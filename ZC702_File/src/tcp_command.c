@@ -5,11 +5,30 @@
  *
  *   Description:
  *	   Send commands over a separate Ethernet port (5002) to control ESN core.
+ *	   The same commands arrive as CMD_____ messages on the file port, which
+ *	   runs them in order with the files; this port does not.
  *
  *   Commands:
  *     - ESN: Start ESN core computation and generate output.
  *     - RESET: Soft reset all ESN arrays/values.
  *     - RDI: Just reset the data_in.
+ *     - TRN_ON / TRN_OFF: Turn RLS training on or off.
+ *     - TRN_BLOCK <K>: RLS update every K samples (block RLS, 1 = per sample).
+ *     - TRN_BOUND <e>: Set-membership RLS: skip updates while the RMS error
+ *       is <= e, step the rest down to e (0 = off).
+ *     - TRN_RLS / TRN_NLMS [mu]: Select the online trainer (NLMS step size mu).
+ *     - TRN_QR: Select inverse QR-RLS (square-root RLS, stays PD in fp32).
+ *     - TRN_FEAT <k>: RLS features: reservoir + every k-th input (0 = none).
+ *     - RIDGE_ON / RIDGE_OFF: Accumulate training samples for ridge regression.
+ *     - TRN_SOLVE [beta]: Solve the accumulated ridge regression for W_out.
+ *     - BATCH_ON / BATCH_OFF: Compute each chunk's input projection up front.
+ *     - STREAM_ON / STREAM_OFF: Run DATAIN samples while the file is arriving.
+ *     - ACT_EXACT / ACT_RAT / ACT_LUT: Select the reservoir tanh tier.
+ *     - WFMT_F32 / WFMT_F16 / WFMT_BF16: Store the dense weights in fp32/fp16/bf16.
+ *     - PARSE_BENCH [n]: Time the ASCII float parsers on n generated values.
+ *
+ *   While a DATAIN file is streaming (STREAM_ON), commands that change the
+ *   trainer, mode, activation or weights are refused until it has ended.
  *
  ******************************************************************************/
 
@@ -19,29 +38,57 @@
 extern struct netif server_netif;
 
 /*
- * cmd_recv_callback:
- *   This function is called by lwIP whenever a TCP segment arrives on the command port.
- *   It copies the incoming command into a local buffer, null-terminates it,
- *   and then checks the command text to call the appropriate function.
+ * Commands that change what a streamed DATAIN latched when it started
+ * (esn_chunk_begin() in esn_main.c): trainer, modes, activation, weights.
  */
-static err_t cmd_recv_callback(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+static int changes_stream_settings(const char *cmd_buf)
 {
-    char cmd_buf[CMD_BUF_SIZE];
+    static const char *const latched[] = {
+        "TRN_ON", "TRN_OFF", "TRN_BLOCK", "TRN_RLS", "TRN_QR", "TRN_NLMS",
+        "TRN_FEAT", "TRN_SOLVE", "RIDGE_", "BATCH_", "STREAM_", "ACT_",
+        "WFMT_",
+    };
 
-    /* If p is NULL, the client closed the connection */
-    if (!p) {
-        xil_printf("Command connection closed by client.\r\n");
-        tcp_close(tpcb);
-        return ERR_OK;
+    for (unsigned int i = 0; i < sizeof(latched) / sizeof(latched[0]); i++) {
+        if (strncmp(cmd_buf, latched[i], strlen(latched[i])) == 0) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    /* Determine how many bytes to copy without overflowing cmd_buf */
-    unsigned int copy_len = (p->tot_len < CMD_BUF_SIZE - 1) ? p->tot_len : CMD_BUF_SIZE - 1;
-    memcpy(cmd_buf, p->payload, copy_len);
-    cmd_buf[copy_len] = '\0';  // Null-terminate the command string
+/*
+ * Commands that may allocate from the model arena. That moves the arena
+ * scratch, which a file-port upload may be decoding into.
+ */
+static int allocates_from_arena(const char *cmd_buf)
+{
+    return strncmp(cmd_buf, "WFMT_", 5) == 0 ||
+           strncmp(cmd_buf, "RIDGE_ON", 8) == 0 ||
+           strncmp(cmd_buf, "TRN_FEAT", 8) == 0;
+}
 
+/*
+ * execute_command:
+ *   Checks the command text and calls the appropriate function. Commands
+ *   arrive on the command port, or as CMD_____ messages in a file-port
+ *   session (esn_main.c).
+ */
+void execute_command(const char *cmd_buf)
+{
     xil_printf("Received command: %s\n\r", cmd_buf);
 
+    if (esn_stream_active() && changes_stream_settings(cmd_buf)) {
+        xil_printf("Error: %s refused while DATAIN is streaming.\n\r",
+                   cmd_buf);
+        return;
+    }
+    if (esn_upload_pending() && allocates_from_arena(cmd_buf)) {
+        xil_printf("Error: %s refused while a file is being received.\n\r",
+                   cmd_buf);
+        return;
+    }
+
     /* Check the command text and call the appropriate function */
 //    if (strncmp(cmd_buf, "ESN", 3) == 0) {
 //        run_esn_calculation();
@@ -58,9 +105,103 @@ static err_t cmd_recv_callback(void *arg, struct tcp_pcb *tpcb, struct pbuf *p,
     else if (strncmp(cmd_buf, "TRN_OFF", 7) == 0) {
     	disable_training();
     }
+    else if (strncmp(cmd_buf, "TRN_BLOCK", 9) == 0) {
+        rls_set_block_size(atoi(&cmd_buf[9]));
+    }
+    else if (strncmp(cmd_buf, "TRN_BOUND", 9) == 0) {
+        rls_set_error_bound((float)atof(&cmd_buf[9]));
+    }
+    else if (strncmp(cmd_buf, "TRN_RLS", 7) == 0) {
+        rls_set_trainer(ESN_TRAINER_RLS);
+    }
+    else if (strncmp(cmd_buf, "TRN_QR", 6) == 0) {
+        rls_set_trainer(ESN_TRAINER_QR_RLS);
+    }
+    else if (strncmp(cmd_buf, "TRN_NLMS", 8) == 0) {
+        float mu = (float)atof(&cmd_buf[8]);
+        if (mu > 0.0f) {
+            nlms_set_step_size(mu);
+        }
+        rls_set_trainer(ESN_TRAINER_NLMS);
+    }
+    else if (strncmp(cmd_buf, "TRN_FEAT", 8) == 0) {
+        rls_set_feature_stride(atoi(&cmd_buf[8]));
+    }
+    else if (strncmp(cmd_buf, "RIDGE_ON", 8) == 0) {
+        ridge_enable();
+    }
+    else if (strncmp(cmd_buf, "RIDGE_OFF", 9) == 0) {
+        ridge_disable();
+    }
+    else if (strncmp(cmd_buf, "TRN_SOLVE", 9) == 0) {
+        float beta = (cmd_buf[9] != '\0') ? (float)atof(&cmd_buf[9])
+                                          : RIDGE_DEFAULT_BETA;
+        solve_ridge_training(beta);
+    }
+    else if (strncmp(cmd_buf, "BATCH_ON", 8) == 0) {
+        enable_batched_mode();
+    }
+    else if (strncmp(cmd_buf, "BATCH_OFF", 9) == 0) {
+        disable_batched_mode();
+    }
+    else if (strncmp(cmd_buf, "STREAM_ON", 9) == 0) {
+        enable_stream_mode();
+    }
+    else if (strncmp(cmd_buf, "STREAM_OFF", 10) == 0) {
+        disable_stream_mode();
+    }
+    else if (strncmp(cmd_buf, "ACT_EXACT", 9) == 0) {
+        esn_set_activation(ESN_ACT_TANH_EXACT);
+        xil_printf("Activation: %s\n\r", esn_activation_name(ESN_ACT_TANH_EXACT));
+    }
+    else if (strncmp(cmd_buf, "ACT_RAT", 7) == 0) {
+        esn_set_activation(ESN_ACT_TANH_RATIONAL);
+        xil_printf("Activation: %s\n\r", esn_activation_name(ESN_ACT_TANH_RATIONAL));
+    }
+    else if (strncmp(cmd_buf, "ACT_LUT", 7) == 0) {
+        esn_set_activation(ESN_ACT_TANH_LUT);
+        xil_printf("Activation: %s\n\r", esn_activation_name(ESN_ACT_TANH_LUT));
+    }
+    else if (strncmp(cmd_buf, "WFMT_F32", 8) == 0) {
+        set_weight_format(ESN_WEIGHTS_FP32);
+    }
+    else if (strncmp(cmd_buf, "WFMT_F16", 8) == 0) {
+        set_weight_format(ESN_WEIGHTS_FP16);
+    }
+    else if (strncmp(cmd_buf, "WFMT_BF16", 9) == 0) {
+        set_weight_format(ESN_WEIGHTS_BF16);
+    }
+    else if (strncmp(cmd_buf, "PARSE_BENCH", 11) == 0) {
+        parse_benchmark(atoi(&cmd_buf[11]));
+    }
     else {
         xil_printf("Unknown command received.\n\r");
     }
+}
+
+/*
+ * cmd_recv_callback:
+ *   This function is called by lwIP whenever a TCP segment arrives on the command port.
+ *   It copies the incoming command into a local buffer, null-terminates it,
+ *   and then executes it.
+ */
+static err_t cmd_recv_callback(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+    char cmd_buf[CMD_BUF_SIZE];
+
+    /* If p is NULL, the client closed the connection */
+    if (!p) {
+        xil_printf("Command connection closed by client.\r\n");
+        tcp_close(tpcb);
+        return ERR_OK;
+    }
+
+    /* Determine how many bytes to copy without overflowing cmd_buf */
+    unsigned int copy_len = (p->tot_len < CMD_BUF_SIZE - 1) ? p->tot_len : CMD_BUF_SIZE - 1;
+    memcpy(cmd_buf, p->payload, copy_len);
+    cmd_buf[copy_len] = '\0';  // Null-terminate the command string
+
+    execute_command(cmd_buf);
 
     /* Inform lwIP that we have received this data */
     tcp_recved(tpcb, p->tot_len);
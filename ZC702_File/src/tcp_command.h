@@ -11,6 +11,7 @@ extern "C" {
 #include "esn_core.h"   // If any ESN functions are needed directly
 #include "xil_printf.h"
 #include "rls_training.h"
+#include "esn_activation.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -22,6 +23,9 @@ extern "C" {
 /* Function prototype to start the command server */
 void start_command_server(void);
 
+/* Run one command (command port, or a CMD_____ message on the file port) */
+void execute_command(const char *cmd_buf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,7 @@ void print_app_header(void)
 {
 	xil_printf("TCP server listening on port %d\r\n",
 			TCP_CONN_PORT);
+	xil_printf("ESN GEMV kernel: %s\r\n", esn_kernel_name());
 }
 
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
@@ -54,13 +55,18 @@ static err_t tcp_server_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
     }
 //    xil_printf("Accepted new TCP client connection\r\n");
 
-    // Optionally re-init file globals each time
-    tcp_file_init();
+    // The receive state is global: serve one client at a time
+    if (tcp_file_open(newpcb) != 0) {
+        xil_printf("TCP server: refusing a second client on port %d\r\n",
+                   TCP_CONN_PORT);
+        tcp_abort(newpcb);
+        return ERR_ABRT;
+    }
 
     tcp_arg(newpcb, NULL);
     /* Use the new function from tcp_file.c */
     tcp_recv(newpcb, tcp_recv_file);
-//    tcp_err(newpcb, tcp_server_err);
+    tcp_err(newpcb, tcp_file_err);
 
     return ERR_OK;
 }
@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * File: bench_kernels.c
+ *
+ *   Description:
+ *     Host benchmark of the ESN kernels at the default model size (128
+ *     inputs, 8 neurons, 128 outputs): GEMV against the scalar reference,
+ *     the fused step, the tanh tiers, the block recurrence against one
+ *     recurrence call per sample, and one training update per trainer.
+ *     Host timings only rank the paths; cycle counts for the board come
+ *     from the XTime figures the firmware prints.
+ *
+ ******************************************************************************/
+
+#define _POSIX_C_SOURCE 199309L
+#include "test_common.h"
+#include "esn_core.h"
+#include "esn_model.h"
+#include "rls_training.h"
+#include <time.h>
+
+#define BENCH_MIN_SECONDS 0.2
+
+typedef void (*bench_fn)(void);
+
+static esn_model_t model;
+static float W_in[ESN_MAX_DENSE_NEURONS * ESN_MAX_INPUTS];
+static float W_x[ESN_MAX_DENSE_NEURONS * ESN_MAX_DENSE_NEURONS];
+static float W_out[ESN_MAX_OUTPUTS * (ESN_MAX_DENSE_NEURONS + ESN_MAX_INPUTS)];
+static float data_in[ESN_MAX_INPUTS];
+static float state_pre[ESN_MAX_DENSE_NEURONS];
+static float state[ESN_MAX_DENSE_NEURONS];
+static float out[ESN_MAX_OUTPUTS];
+static float z[ESN_MAX_DENSE_NEURONS + ESN_MAX_INPUTS];
+static float act_in[1024], act_out[1024];
+
+/* Samples per block recurrence (as ESN_BATCH_SAMPLES in esn_main.c) */
+#define BENCH_BLOCK 32
+static float proj[BENCH_BLOCK * ESN_MAX_DENSE_NEURONS];
+static float states[BENCH_BLOCK * ESN_MAX_DENSE_NEURONS];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Nanoseconds per call, repeating fn for at least BENCH_MIN_SECONDS */
+static double time_ns(bench_fn fn)
+{
+    long calls = 0;
+    long batch = 16;
+    double t0 = now();
+    double t;
+
+    do {
+        for (long i = 0; i < batch; i++) {
+            fn();
+        }
+        calls += batch;
+        batch *= 2;
+        t = now() - t0;
+    } while (t < BENCH_MIN_SECONDS);
+    return t * 1e9 / (double)calls;
+}
+
+static void run_gemv(void)
+{
+    esn_gemv(W_out, model.extended_size, z, model.num_outputs,
+             model.extended_size, out);
+}
+
+static void run_gemv_ref(void)
+{
+    esn_gemv_ref(W_out, model.extended_size, z, model.num_outputs,
+                 model.extended_size, out);
+}
+
+static void run_step(void)
+{
+    esn_step(&model, W_in, W_x, W_out, data_in, state_pre, state, out);
+}
+
+static void run_tanh(void)
+{
+    esn_activate(act_in, act_out, 1024);
+}
+
+static void run_recur_block(void)
+{
+    update_state_block(&model, proj, W_x, state_pre, BENCH_BLOCK, states);
+}
+
+/* What update_state_block() does without a block kernel for the size */
+static void run_recur_per_sample(void)
+{
+    const float *prev = state_pre;
+
+    for (int s = 0; s < BENCH_BLOCK; s++) {
+        update_state_projected(&model, &proj[s * model.num_neurons], W_x,
+                               prev, &states[s * model.num_neurons]);
+        prev = &states[s * model.num_neurons];
+    }
+}
+
+static void run_train(void)
+{
+    update_training_rls(z, out);
+}
+
+int main(void)
+{
+    static const esn_activation_t tiers[] = {
+        ESN_ACT_TANH_EXACT, ESN_ACT_TANH_RATIONAL, ESN_ACT_TANH_LUT
+    };
+    static const esn_trainer_t trainers[] = {
+        ESN_TRAINER_RLS, ESN_TRAINER_NLMS, ESN_TRAINER_QR_RLS
+    };
+    static const char *const trainer_names[] = {"RLS", "NLMS", "QR-RLS"};
+
+    esn_model_defaults(&model);
+    test_fill(W_in, model.num_neurons * model.num_inputs, 0.1f);
+    test_fill(W_x, model.num_neurons * model.num_neurons, 0.3f);
+    test_fill(W_out, model.num_outputs * model.extended_size, 0.1f);
+    test_fill(data_in, model.num_inputs, 1.0f);
+    test_fill(state_pre, model.num_neurons, 0.5f);
+    test_fill(z, model.extended_size, 1.0f);
+    test_fill(act_in, 1024, 4.0f);
+    test_fill(proj, BENCH_BLOCK * model.num_neurons, 1.0f);
+
+    printf("Kernel %s, model %d inputs x %d neurons x %d outputs (%s)\n",
+           esn_kernel_name(), model.num_inputs, model.num_neurons,
+           model.num_outputs, model.kernel_variant);
+    printf("  %-28s %10.1f ns\n", "esn_gemv_ref (output layer)",
+           time_ns(run_gemv_ref));
+    printf("  %-28s %10.1f ns\n", "esn_gemv (output layer)",
+           time_ns(run_gemv));
+    printf("  %-28s %10.1f ns\n", "esn_step", time_ns(run_step));
+
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        char label[40];
+
+        esn_set_activation(tiers[t]);
+        snprintf(label, sizeof(label), "tanh %s (1024 values)",
+                 esn_activation_name(tiers[t]));
+        printf("  %-28s %10.1f ns\n", label, time_ns(run_tanh));
+    }
+
+    // Block recurrence, per sample: register kernel vs one m->recur each
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        char label[40];
+
+        esn_set_activation(tiers[t]);
+        snprintf(label, sizeof(label), "recur_block %s",
+                 esn_activation_name(tiers[t]));
+        printf("  %-28s %10.1f ns\n", label,
+               time_ns(run_recur_block) / BENCH_BLOCK);
+        snprintf(label, sizeof(label), "recur per sample %s",
+                 esn_activation_name(tiers[t]));
+        printf("  %-28s %10.1f ns\n", label,
+               time_ns(run_recur_per_sample) / BENCH_BLOCK);
+    }
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+
+    for (unsigned t = 0; t < sizeof(trainers) / sizeof(trainers[0]); t++) {
+        char label[40];
+
+        model.trainer = trainers[t];
+        esn_arena_reset();
+        if (rls_configure(&model) != 0) {
+            return 1;
+        }
+        enable_training();
+        snprintf(label, sizeof(label), "%s update", trainer_names[t]);
+        printf("  %-28s %10.1f ns\n", label, time_ns(run_train));
+        disable_training();
+    }
+
+    // Feature-masked RLS: reservoir plus every k-th input (0: none)
+    static const int strides[] = {2, 4, 0};
+
+    model.trainer = ESN_TRAINER_RLS;
+    esn_arena_reset();
+    if (rls_configure(&model) != 0) {
+        return 1;
+    }
+    enable_training();
+    for (unsigned s = 0; s < sizeof(strides) / sizeof(strides[0]); s++) {
+        char label[40];
+
+        rls_set_feature_stride(strides[s]);
+        snprintf(label, sizeof(label), "RLS update, input stride %d",
+                 strides[s]);
+        printf("  %-28s %10.1f ns\n", label, time_ns(run_train));
+    }
+    disable_training();
+    return 0;
+}
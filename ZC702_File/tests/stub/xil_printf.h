@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the Xilinx BSP's xil_printf.h: the firmware sources
+ * only use xil_printf() with printf-compatible formats.
+ */
+#ifndef XIL_PRINTF_H
+#define XIL_PRINTF_H
+
+#include <stdio.h>
+
+#define xil_printf printf
+
+#endif /* XIL_PRINTF_H */
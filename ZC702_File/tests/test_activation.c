@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * File: test_activation.c
+ *
+ *   Description:
+ *     Each tanh tier against tanh() in double precision over a dense grid
+ *     (saturated tails included), checked against the error documented in
+ *     esn_activation.h. Also checks that every tier stays within [-1, 1],
+ *     is odd, and works in place through esn_activate().
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_activation.h"
+
+#define GRID_RANGE 12.0f
+#define GRID_SIZE  (1 << 18)
+
+/* |err| of each tier as documented in esn_activation.h (tanhf: ~2 ulp) */
+static const struct {
+    esn_activation_t tier;
+    double max_err;
+} tiers[] = {
+    { ESN_ACT_TANH_EXACT,    2.5e-7 },
+    { ESN_ACT_TANH_RATIONAL, 4.0e-7 },
+    { ESN_ACT_TANH_LUT,      3.0e-5 },
+};
+
+static float in[GRID_SIZE + 1];
+static float out[GRID_SIZE + 1];
+static float neg_in[GRID_SIZE + 1];
+static float neg_out[GRID_SIZE + 1];
+
+int main(void)
+{
+    for (int i = 0; i <= GRID_SIZE; i++) {
+        in[i] = -GRID_RANGE + (2.0f * GRID_RANGE * i) / GRID_SIZE;
+        neg_in[i] = -in[i];
+    }
+
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        const char *name = esn_activation_name(tiers[t].tier);
+        double worst = 0.0;
+        float worst_x = 0.0f;
+        int bounded = 1;
+        int odd = 1;
+
+        esn_set_activation(tiers[t].tier);
+        esn_activate(in, out, GRID_SIZE + 1);
+        esn_activate(neg_in, neg_out, GRID_SIZE + 1);
+        for (int i = 0; i <= GRID_SIZE; i++) {
+            double err = fabs((double)out[i] - tanh((double)in[i]));
+            if (err > worst) {
+                worst = err;
+                worst_x = in[i];
+            }
+            bounded &= (out[i] >= -1.0f && out[i] <= 1.0f);
+            odd &= (fabsf(out[i] + neg_out[i]) <= 2.0f * tiers[t].max_err);
+        }
+        printf("%-8s max |err| %.3g at x = %g\n", name, worst, worst_x);
+        CHECK(worst <= tiers[t].max_err, "%s: max |err| %g at %g, limit %g",
+              name, worst, worst_x, tiers[t].max_err);
+        CHECK(bounded, "%s: output outside [-1, 1]", name);
+        CHECK(odd, "%s: f(-x) != -f(x)", name);
+
+        // In place (update_state_sparse relies on it)
+        memcpy(neg_out, in, sizeof(in));
+        esn_activate(neg_out, neg_out, GRID_SIZE + 1);
+        CHECK(memcmp(neg_out, out, sizeof(out)) == 0,
+              "%s: in-place result differs", name);
+    }
+    return test_report("test_activation");
+}
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * File: test_common.h
+ *
+ *   Description:
+ *     Shared helpers for the host-side regression tests: a failure counter
+ *     with a CHECK macro, a repeatable random generator, and the error
+ *     measures the tests compare the optimized paths with.
+ *
+ ******************************************************************************/
+
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+/* Count and report a failed condition, then keep going */
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);                 \
+            fprintf(stderr, __VA_ARGS__);                                   \
+            fprintf(stderr, "\n");                                          \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+/* xorshift32: the same sequence on every host */
+static uint32_t test_rand_state = 0x12345678u;
+
+static inline void test_seed(uint32_t seed)
+{
+    test_rand_state = seed ? seed : 1u;
+}
+
+/* Uniform in [-1, 1) */
+static inline float test_randf(void)
+{
+    uint32_t x = test_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test_rand_state = x;
+    return (float)(x >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static inline void test_fill(float *x, int n, float scale)
+{
+    for (int i = 0; i < n; i++) {
+        x[i] = scale * test_randf();
+    }
+}
+
+/* max_i |a[i] - b[i]| */
+static inline double test_max_abs_diff(const float *a, const float *b, int n)
+{
+    double worst = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        double d = fabs((double)a[i] - (double)b[i]);
+        worst = (d > worst) ? d : worst;
+    }
+    return worst;
+}
+
+/* ||a - b|| / ||b|| (Frobenius), 0 when both are zero */
+static inline double test_rel_diff(const float *a, const float *b, int n)
+{
+    double num = 0.0;
+    double den = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        double d = (double)a[i] - (double)b[i];
+        num += d * d;
+        den += (double)b[i] * (double)b[i];
+    }
+    return (den > 0.0) ? sqrt(num / den) : sqrt(num);
+}
+
+/* Print the verdict; the return value is the process exit status */
+static inline int test_report(const char *name)
+{
+    printf("%s: %s (%d failure(s))\n", name,
+           test_failures ? "FAIL" : "ok", test_failures);
+    return test_failures ? 1 : 0;
+}
+
+#endif /* TEST_COMMON_H */
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * File: test_fixed.c
+ *
+ *   Description:
+ *     The Q15/Q31 inference path in esn_fixed.c against the float esn_step()
+ *     over a run of samples, with the reservoir state kept in Q15 inside
+ *     esn_fixed.c the whole time, and the state hand-over to and from the
+ *     float path.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_fixed.h"
+#include "esn_model.h"
+
+#define N_IN     40
+#define N        16
+#define N_OUT    4
+#define SAMPLES  300
+
+static float W_in[N * N_IN];
+static float W_x[N * N];
+static float W_out[N_OUT * (N + N_IN)];
+static float data_in[SAMPLES * N_IN];
+
+/* Fixed-point run of SAMPLES steps tracks the float run */
+static void test_fixed_vs_float(void)
+{
+    esn_model_t m;
+    float state_pre[N] = {0};
+    float state[N];
+    float out[N_OUT];
+    float out_fixed[N_OUT];
+    float state_fixed[N];
+    int32_t out_q[N_OUT];
+    double out_err = 0.0;
+    double out_mag = 0.0;
+    double state_err = 0.0;
+
+    esn_model_defaults(&m);
+    m.num_inputs = N_IN;
+    m.num_neurons = N;
+    m.num_outputs = N_OUT;
+    m.extended_size = N + N_IN;
+    esn_select_kernels(&m);
+    esn_model_set(&m);
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+
+    test_fill(W_in, N * N_IN, 0.2f);
+    test_fill(W_x, N * N, 0.2f);
+    test_fill(W_out, N_OUT * (N + N_IN), 0.5f);
+    test_fill(data_in, SAMPLES * N_IN, 1.0f);
+
+    esn_arena_reset();
+    CHECK(esn_fixed_configure(esn_model_get()) == 0,
+          "esn_fixed_configure failed");
+    esn_fixed_load_w_in(W_in);
+    esn_fixed_load_w_x(W_x);
+    esn_fixed_load_w_out(W_out);
+
+    const int in_exp = esn_fixed_exponent(data_in, SAMPLES * N_IN);
+    esn_fixed_set_state(state_pre);
+    for (int s = 0; s < SAMPLES; s++) {
+        const float *x = &data_in[s * N_IN];
+
+        esn_step(&m, W_in, W_x, W_out, x, state_pre, state, out);
+        memcpy(state_pre, state, sizeof(state));
+
+        esn_fixed_step(x, in_exp, out_q);
+        for (int k = 0; k < N_OUT; k++) {
+            out_fixed[k] = (float)out_q[k] * (1.0f / 65536.0f);
+            out_err += (double)(out_fixed[k] - out[k]) * (out_fixed[k] - out[k]);
+            out_mag += (double)out[k] * out[k];
+        }
+    }
+    esn_fixed_get_state(state_fixed);
+    state_err = test_max_abs_diff(state_fixed, state, N);
+
+    const double out_db = 10.0 * log10(out_err / out_mag);
+    printf("fixed point, %d samples: state off by %.3g, output error %.1f dB\n",
+           SAMPLES, state_err, out_db);
+    CHECK(state_err < 2e-3, "Q15 state off by %g after %d samples",
+          state_err, SAMPLES);
+    CHECK(out_db < -60.0, "fixed-point output error %.1f dB (limit -60 dB)",
+          out_db);
+
+    // The state survives a round trip through the float path
+    esn_fixed_set_state(state);
+    esn_fixed_get_state(state_fixed);
+    CHECK(test_max_abs_diff(state_fixed, state, N) <= 1.0f / 32768.0f,
+          "set/get state round trip off by %g",
+          test_max_abs_diff(state_fixed, state, N));
+}
+
+int main(void)
+{
+    test_fixed_vs_float();
+    return test_report("test_fixed");
+}
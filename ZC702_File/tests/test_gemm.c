@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * File: test_gemm.c
+ *
+ *   Description:
+ *     esn_gemm() (chunk input projection and the batched output layer)
+ *     against esn_gemv_ref() on each sample, for sample counts around the
+ *     ESN_GEMM_PANEL boundary and strided B / C columns, and
+ *     esn_gemm_half() against esn_gemm() on the widened fp16/bf16 matrix.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_core.h"
+
+#define MAX_ROWS    128
+#define MAX_COLS    136
+#define MAX_SAMPLES 70
+#define PAD         5
+
+static float A[MAX_ROWS * (MAX_COLS + PAD)];
+static float B[MAX_SAMPLES * (MAX_COLS + PAD)];
+static float C[MAX_SAMPLES * (MAX_ROWS + PAD)];
+static float c_ref[MAX_ROWS];
+static uint16_t A_half[MAX_ROWS * (MAX_COLS + PAD)];
+static float C_half[MAX_SAMPLES * (MAX_ROWS + PAD)];
+
+static void check_gemm(int rows, int cols, int n, int pad)
+{
+    const int lda = cols + pad;
+    const int ldb = cols + pad;
+    const int ldc = rows + pad;
+
+    test_fill(A, rows * lda, 1.0f);
+    test_fill(B, n * ldb, 1.0f);
+    memset(C, 0, sizeof(C));
+    esn_gemm(A, lda, B, ldb, rows, cols, n, C, ldc);
+
+    for (int s = 0; s < n; s++) {
+        esn_gemv_ref(A, lda, &B[s * ldb], rows, cols, c_ref);
+        for (int i = 0; i < rows; i++) {
+            double mag = 0.0;
+            for (int j = 0; j < cols; j++) {
+                mag += fabs((double)A[i * lda + j] * B[s * ldb + j]);
+            }
+            // reordering bound, as in test_gemv.c
+            double bound = 2.0 * cols * FLT_EPSILON * mag + 1e-30;
+            if (fabs((double)C[s * ldc + i] - c_ref[i]) > bound) {
+                CHECK(0, "esn_gemm %d x %d, %d samples (pad %d): "
+                      "C(%d, %d) = %g, reference %g",
+                      rows, cols, n, pad, i, s, C[s * ldc + i], c_ref[i]);
+                return;
+            }
+        }
+    }
+}
+
+/* fp16/bf16 A: the same sums as esn_gemm() on A widened back to fp32 */
+static void check_gemm_half(esn_weight_format_t fmt, int rows, int cols,
+                            int n, int pad)
+{
+    const int lda = cols + pad;
+    const int ldb = cols + pad;
+    const int ldc = rows + pad;
+
+    test_fill(A, rows * lda, 1.0f);
+    test_fill(B, n * ldb, 1.0f);
+    esn_convert_weights(A, rows * lda, fmt, A_half);
+    for (int i = 0; i < rows * lda; i++) {
+        A[i] = (fmt == ESN_WEIGHTS_FP16) ? esn_fp16_to_float(A_half[i])
+                                         : esn_bf16_to_float(A_half[i]);
+    }
+    memset(C, 0, sizeof(C));
+    memset(C_half, 0, sizeof(C_half));
+    esn_gemm(A, lda, B, ldb, rows, cols, n, C, ldc);
+    esn_gemm_half(fmt, A_half, lda, B, ldb, rows, cols, n, C_half, ldc);
+
+    // Same kernels and summation order, only the loads differ
+    CHECK(memcmp(C, C_half, sizeof(float) * n * ldc) == 0,
+          "esn_gemm_half %s %d x %d, %d samples (pad %d) differs from "
+          "esn_gemm", esn_weight_format_name(fmt), rows, cols, n, pad);
+}
+
+int main(void)
+{
+    static const int samples[] = {1, 2, 3, 31, 32, 33, 64, 70};
+    static const int shapes[][2] = {
+        /* rows, cols */
+        {  8, 128},   // input projection, default model
+        {128, 136},   // batched output layer, default model
+        {  8,  40}, {  4,  48}, { 13,  17}, {  1,   1}, { 64, 128},
+    };
+
+    for (unsigned k = 0; k < sizeof(shapes) / sizeof(shapes[0]); k++) {
+        for (unsigned s = 0; s < sizeof(samples) / sizeof(samples[0]); s++) {
+            check_gemm(shapes[k][0], shapes[k][1], samples[s], 0);
+            check_gemm(shapes[k][0], shapes[k][1], samples[s], PAD);
+            check_gemm_half(ESN_WEIGHTS_FP16, shapes[k][0], shapes[k][1],
+                            samples[s], PAD);
+            check_gemm_half(ESN_WEIGHTS_BF16, shapes[k][0], shapes[k][1],
+                            samples[s], 0);
+        }
+    }
+    return test_report("test_gemm");
+}
@@ -0,0 +1,397 @@
+/*******************************************************************************
+ * File: test_gemv.c
+ *
+ *   Description:
+ *     The vector GEMV kernels (esn_gemv, esn_gemv_split) and the
+ *     size-specialized esn_step() kernels against the scalar reference
+ *     esn_gemv_ref(), over sizes that hit every vector tail and row
+ *     remainder, and the block recurrence against one sample at a time.
+ *     The fp16/bf16 kernels are checked against the fp32 ones run on the
+ *     same weights widened back to fp32.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_core.h"
+#include "esn_model.h"
+
+#define MAX_ROWS 136
+#define MAX_COLS 200
+#define LDA_PAD  3
+
+static float A[MAX_ROWS * (MAX_COLS + LDA_PAD)];
+static float x[MAX_COLS];
+static float y[MAX_ROWS];
+static float y_ref[MAX_ROWS];
+
+/*
+ * Reordering the sum of cols products changes the result by at most about
+ * cols * eps * sum_j |A(i,j) x(j)|; allow twice that.
+ */
+static int gemv_within_bound(const float *A_, int lda, const float *x_,
+                             int rows, int cols, const float *got,
+                             const float *ref)
+{
+    for (int i = 0; i < rows; i++) {
+        double mag = 0.0;
+        for (int j = 0; j < cols; j++) {
+            mag += fabs((double)A_[i * lda + j] * x_[j]);
+        }
+        double bound = 2.0 * cols * FLT_EPSILON * mag + 1e-30;
+        if (fabs((double)got[i] - ref[i]) > bound) {
+            fprintf(stderr, "  row %d: %g vs %g (bound %g)\n",
+                    i, got[i], ref[i], bound);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_gemv_sizes(void)
+{
+    static const int sizes[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17,
+                                33, 40, 64, 128, 136, 200};
+    const int count = (int)(sizeof(sizes) / sizeof(sizes[0]));
+
+    for (int r = 0; r < count; r++) {
+        for (int c = 0; c < count; c++) {
+            const int rows = (sizes[r] < MAX_ROWS) ? sizes[r] : MAX_ROWS;
+            const int cols = sizes[c];
+            const int lda = cols + LDA_PAD;
+
+            test_fill(A, rows * lda, 1.0f);
+            test_fill(x, cols, 1.0f);
+            esn_gemv_ref(A, lda, x, rows, cols, y_ref);
+            esn_gemv(A, lda, x, rows, cols, y);
+            CHECK(gemv_within_bound(A, lda, x, rows, cols, y, y_ref),
+                  "esn_gemv %d x %d (lda %d) differs from esn_gemv_ref",
+                  rows, cols, lda);
+        }
+    }
+}
+
+/* esn_gemv_split(A, [x0; x1]) == esn_gemv_ref(A, concatenation) */
+static void test_gemv_split(void)
+{
+    static const int splits[][2] = {{8, 128}, {8, 40}, {3, 5}, {16, 1},
+                                    {1, 16}, {0, 12}, {12, 0}, {64, 128}};
+    const int count = (int)(sizeof(splits) / sizeof(splits[0]));
+
+    for (int s = 0; s < count; s++) {
+        const int n0 = splits[s][0];
+        const int n1 = splits[s][1];
+        const int cols = n0 + n1;
+        const int rows = 37;
+
+        test_fill(A, rows * cols, 1.0f);
+        test_fill(x, cols, 1.0f);
+        esn_gemv_ref(A, cols, x, rows, cols, y_ref);
+        esn_gemv_split(A, cols, x, n0, &x[n0], n1, rows, y);
+        CHECK(gemv_within_bound(A, cols, x, rows, cols, y, y_ref),
+              "esn_gemv_split %d + %d differs from esn_gemv_ref", n0, n1);
+    }
+}
+
+/* Reference ESN step: scalar GEMVs and tanhf */
+static void step_ref(const esn_model_t *m, const float *W_in,
+                     const float *W_x, const float *W_out,
+                     const float *data_in, const float *state_pre,
+                     float *state, float *data_out)
+{
+    const int n = m->num_neurons;
+    const int n_in = m->num_inputs;
+    float proj[64];
+    float recur[64];
+    float z[64 + 128];
+
+    esn_gemv_ref(W_in, n_in, data_in, n, n_in, proj);
+    esn_gemv_ref(W_x, n, state_pre, n, n, recur);
+    for (int i = 0; i < n; i++) {
+        state[i] = tanhf(proj[i] + recur[i]);
+    }
+    memcpy(z, state, sizeof(float) * n);
+    memcpy(&z[n], data_in, sizeof(float) * n_in);
+    esn_gemv_ref(W_out, m->extended_size, z, m->num_outputs,
+                 m->extended_size, data_out);
+}
+
+static void test_step_kernels(void)
+{
+    static const int dims[][3] = {
+        /* neurons, inputs, outputs */
+        { 8,  40,   4}, { 8, 128, 128}, {16,  40,  4}, {16, 128, 8},
+        {32,  40,   4}, {32, 128,   4}, {64,  40,  4}, {64, 128, 4},
+        {12,  40,   4}, { 8,  33,   5}, { 5,   3,  2},
+    };
+    static float W_in[64 * 128];
+    static float W_x[64 * 64];
+    static float W_out[128 * (64 + 128)];
+    float data_in[128];
+    float state_pre[64];
+    float state[64], state_r[64];
+    float out[128], out_r[128];
+
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+    for (unsigned d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+        esn_model_t m;
+
+        esn_model_defaults(&m);
+        m.num_neurons = dims[d][0];
+        m.num_inputs = dims[d][1];
+        m.num_outputs = dims[d][2];
+        m.extended_size = m.num_neurons + m.num_inputs;
+        esn_select_kernels(&m);
+
+        test_fill(W_in, m.num_neurons * m.num_inputs, 0.2f);
+        test_fill(W_x, m.num_neurons * m.num_neurons, 0.2f);
+        test_fill(W_out, m.num_outputs * m.extended_size, 0.5f);
+        test_fill(data_in, m.num_inputs, 1.0f);
+        test_fill(state_pre, m.num_neurons, 0.9f);
+
+        esn_step(&m, W_in, W_x, W_out, data_in, state_pre, state, out);
+        step_ref(&m, W_in, W_x, W_out, data_in, state_pre, state_r, out_r);
+
+        CHECK(test_max_abs_diff(state, state_r, m.num_neurons) < 1e-5,
+              "esn_step %s (%dx%d): state off by %g", m.kernel_variant,
+              m.num_neurons, m.num_inputs,
+              test_max_abs_diff(state, state_r, m.num_neurons));
+        CHECK(test_rel_diff(out, out_r, m.num_outputs) < 1e-5,
+              "esn_step %s (%dx%d): output off by %g (relative)",
+              m.kernel_variant, m.num_neurons, m.num_inputs,
+              test_rel_diff(out, out_r, m.num_outputs));
+    }
+}
+
+/* update_state_block() == update_state_projected() sample by sample */
+static void test_recur_block(void)
+{
+    static const int sizes[] = {4, 8, 12, 16};
+    static const esn_activation_t tiers[] = {
+        ESN_ACT_TANH_RATIONAL, ESN_ACT_TANH_EXACT, ESN_ACT_TANH_LUT
+    };
+    enum { COUNT = 37 };
+    static float W_x[16 * 16];
+    static float proj[COUNT * 16];
+    static float states[COUNT * 16];
+    static float states_r[COUNT * 16];
+    float state_pre[16];
+
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        esn_set_activation(tiers[t]);
+        for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+            const int n = sizes[k];
+            esn_model_t m;
+
+            esn_model_defaults(&m);
+            m.num_neurons = n;
+            m.extended_size = n + m.num_inputs;
+            esn_select_kernels(&m);
+
+            test_fill(W_x, n * n, 0.4f);
+            test_fill(proj, COUNT * n, 1.5f);
+            test_fill(state_pre, n, 0.9f);
+
+            update_state_block(&m, proj, W_x, state_pre, COUNT, states);
+            const float *prev = state_pre;
+            for (int s = 0; s < COUNT; s++) {
+                update_state_projected(&m, &proj[s * n], W_x, prev,
+                                       &states_r[s * n]);
+                prev = &states_r[s * n];
+            }
+            CHECK(test_max_abs_diff(states, states_r, COUNT * n) < 1e-5,
+                  "update_state_block %d neurons (%s): states off by %g", n,
+                  esn_activation_name(tiers[t]),
+                  test_max_abs_diff(states, states_r, COUNT * n));
+        }
+    }
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+}
+
+/*
+ * The block kernel's inlined tanh tiers: with W_x = 0 each state is the
+ * activation of its projection, swept over [-10, 10], against
+ * esn_activate() (libm tanhf() for the exact tier).
+ */
+static void test_recur_block_tiers(void)
+{
+    static const struct {
+        esn_activation_t tier;
+        float tol;
+    } tiers[] = {
+        { ESN_ACT_TANH_EXACT,    2.5e-7f },
+        { ESN_ACT_TANH_RATIONAL, 4.0e-7f },
+        { ESN_ACT_TANH_LUT,      1.0e-6f },
+    };
+    static const int sizes[] = {4, 8, 16};
+    enum { COUNT = 1000 };
+    static float W_x[16 * 16];
+    static float proj[COUNT * 16];
+    static float states[COUNT * 16];
+    static float act[COUNT * 16];
+    float state_pre[16] = {0};
+
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        esn_set_activation(tiers[t].tier);
+        for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+            const int n = sizes[k];
+            esn_model_t m;
+
+            esn_model_defaults(&m);
+            m.num_neurons = n;
+            m.extended_size = n + m.num_inputs;
+            esn_select_kernels(&m);
+
+            for (int i = 0; i < COUNT * n; i++) {
+                proj[i] = -10.0f + 20.0f * (float)i / (float)(COUNT * n - 1);
+            }
+            update_state_block(&m, proj, W_x, state_pre, COUNT, states);
+            esn_activate(proj, act, COUNT * n);
+            CHECK(test_max_abs_diff(states, act, COUNT * n) <= tiers[t].tol,
+                  "update_state_block %d neurons: %s tanh off by %g", n,
+                  esn_activation_name(tiers[t].tier),
+                  test_max_abs_diff(states, act, COUNT * n));
+        }
+    }
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+}
+
+/* fp16/bf16 weights, and the same values widened back to fp32 */
+static void to_half(const float *src, int n, esn_weight_format_t fmt,
+                    uint16_t *half, float *widened)
+{
+    esn_convert_weights(src, n, fmt, half);
+    for (int i = 0; i < n; i++) {
+        widened[i] = (fmt == ESN_WEIGHTS_FP16) ? esn_fp16_to_float(half[i])
+                                               : esn_bf16_to_float(half[i]);
+    }
+}
+
+/* esn_step_half() == esn_step() on the widened weights, for every size */
+static void test_step_half(void)
+{
+    static const int dims[][3] = {
+        /* neurons, inputs, outputs */
+        { 8,  40,   4}, { 8, 128, 128}, {16, 128, 8}, {64,  40,  4},
+        {12,  40,   4}, { 5,   3,  2},
+    };
+    static const esn_weight_format_t fmts[] = {
+        ESN_WEIGHTS_FP16, ESN_WEIGHTS_BF16
+    };
+    static float W_in[64 * 128], W_in_w[64 * 128];
+    static float W_x[64 * 64], W_x_w[64 * 64];
+    static float W_out[128 * (64 + 128)], W_out_w[128 * (64 + 128)];
+    static uint16_t W_in_h[64 * 128];
+    static uint16_t W_x_h[64 * 64];
+    static uint16_t W_out_h[128 * (64 + 128)];
+    float data_in[128];
+    float state_pre[64];
+    float state[64], state_r[64];
+    float out[128], out_r[128];
+
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+    for (unsigned f = 0; f < sizeof(fmts) / sizeof(fmts[0]); f++) {
+        for (unsigned d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+            esn_model_t m;
+
+            esn_model_defaults(&m);
+            m.num_neurons = dims[d][0];
+            m.num_inputs = dims[d][1];
+            m.num_outputs = dims[d][2];
+            m.extended_size = m.num_neurons + m.num_inputs;
+            esn_select_kernels(&m);
+
+            const int n_wout = m.num_outputs * m.extended_size;
+            test_fill(W_in, m.num_neurons * m.num_inputs, 0.2f);
+            test_fill(W_x, m.num_neurons * m.num_neurons, 0.2f);
+            test_fill(W_out, n_wout, 0.5f);
+            test_fill(data_in, m.num_inputs, 1.0f);
+            test_fill(state_pre, m.num_neurons, 0.9f);
+            to_half(W_in, m.num_neurons * m.num_inputs, fmts[f], W_in_h,
+                    W_in_w);
+            to_half(W_x, m.num_neurons * m.num_neurons, fmts[f], W_x_h,
+                    W_x_w);
+            to_half(W_out, n_wout, fmts[f], W_out_h, W_out_w);
+
+            // W_out in the same format, then W_out in fp32 (training)
+            for (int out32 = 0; out32 < 2; out32++) {
+                esn_step_half(&m, fmts[f], W_in_h, W_x_h,
+                              out32 ? NULL : W_out_h, W_out, data_in,
+                              state_pre, state, out);
+                esn_step(&m, W_in_w, W_x_w, out32 ? W_out : W_out_w,
+                         data_in, state_pre, state_r, out_r);
+
+                CHECK(test_max_abs_diff(state, state_r, m.num_neurons) < 1e-5,
+                      "esn_step_half %s %s: state off by %g",
+                      esn_weight_format_name(fmts[f]), m.kernel_variant,
+                      test_max_abs_diff(state, state_r, m.num_neurons));
+                CHECK(test_rel_diff(out, out_r, m.num_outputs) < 1e-5,
+                      "esn_step_half %s %s (fp32 W_out %d): output off by %g",
+                      esn_weight_format_name(fmts[f]), m.kernel_variant,
+                      out32, test_rel_diff(out, out_r, m.num_outputs));
+            }
+        }
+    }
+}
+
+/* update_state_block_half() == update_state_block() on the widened W_x */
+static void test_recur_block_half(void)
+{
+    static const int sizes[] = {4, 8, 12, 16};
+    static const esn_activation_t tiers[] = {
+        ESN_ACT_TANH_RATIONAL, ESN_ACT_TANH_EXACT, ESN_ACT_TANH_LUT
+    };
+    static const esn_weight_format_t fmts[] = {
+        ESN_WEIGHTS_FP16, ESN_WEIGHTS_BF16
+    };
+    enum { COUNT = 37 };
+    static float W_x[16 * 16], W_x_w[16 * 16];
+    static uint16_t W_x_h[16 * 16];
+    static float proj[COUNT * 16];
+    static float states[COUNT * 16];
+    static float states_r[COUNT * 16];
+    float state_pre[16];
+
+    for (unsigned t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        esn_set_activation(tiers[t]);
+        for (unsigned f = 0; f < sizeof(fmts) / sizeof(fmts[0]); f++) {
+            for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+                const int n = sizes[k];
+                esn_model_t m;
+
+                esn_model_defaults(&m);
+                m.num_neurons = n;
+                m.extended_size = n + m.num_inputs;
+                esn_select_kernels(&m);
+
+                test_fill(W_x, n * n, 0.4f);
+                test_fill(proj, COUNT * n, 1.5f);
+                test_fill(state_pre, n, 0.9f);
+                to_half(W_x, n * n, fmts[f], W_x_h, W_x_w);
+
+                update_state_block_half(&m, fmts[f], proj, W_x_h, state_pre,
+                                        COUNT, states);
+                update_state_block(&m, proj, W_x_w, state_pre, COUNT,
+                                   states_r);
+                CHECK(test_max_abs_diff(states, states_r, COUNT * n) < 1e-5,
+                      "update_state_block_half %s %d neurons (%s): "
+                      "states off by %g", esn_weight_format_name(fmts[f]), n,
+                      esn_activation_name(tiers[t]),
+                      test_max_abs_diff(states, states_r, COUNT * n));
+            }
+        }
+    }
+    esn_set_activation(ESN_ACT_TANH_EXACT);
+}
+
+int main(void)
+{
+    printf("GEMV kernel: %s\n", esn_kernel_name());
+    test_gemv_sizes();
+    test_gemv_split();
+    test_step_kernels();
+    test_recur_block();
+    test_recur_block_tiers();
+    test_step_half();
+    test_recur_block_half();
+    return test_report("test_gemv");
+}
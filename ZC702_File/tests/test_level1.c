@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * File: test_level1.c
+ *
+ *   Description:
+ *     The vector level-1 routines behind the RLS updates (esn_axpy,
+ *     esn_axpy_multi(_from), esn_dot_axpy, esn_dot, esn_rotate) against
+ *     plain loops in double precision, for every length up to a few
+ *     vectors past the widest VEC_WIDTH and with unaligned starts.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_core.h"
+
+#define MAX_N   70
+#define MAX_K   5
+#define OFFSET  1            /* odd start: unaligned vector loads */
+#define TOL     (8.0 * FLT_EPSILON)
+
+static float xs[MAX_K * MAX_N + OFFSET];
+static float ys[MAX_N + OFFSET];
+static float ps[MAX_N + OFFSET];
+static double ref[MAX_N];
+static double ref2[MAX_N];
+
+static void test_axpy(int n)
+{
+    float *x = &xs[OFFSET];
+    float *y = &ys[OFFSET];
+    const float a = 0.75f;
+
+    test_fill(x, n, 1.0f);
+    test_fill(y, n, 1.0f);
+    for (int j = 0; j < n; j++) {
+        ref[j] = y[j] + (double)a * x[j];
+    }
+    esn_axpy(n, a, x, y);
+    for (int j = 0; j < n; j++) {
+        CHECK(fabs(y[j] - ref[j]) <= TOL, "esn_axpy n=%d: y[%d] = %g, want %g",
+              n, j, y[j], ref[j]);
+    }
+}
+
+static void test_axpy_multi(int n, int k)
+{
+    float *x = &xs[OFFSET];
+    float *y = &ys[OFFSET];
+    float a[MAX_K];
+    const int ldx = n + 3;
+
+    test_fill(a, k, 1.0f);
+    test_fill(x, k * ldx < MAX_K * MAX_N ? k * ldx : MAX_K * MAX_N, 1.0f);
+    test_fill(y, n, 1.0f);
+    for (int j = 0; j < n; j++) {
+        ref[j] = y[j];
+        for (int c = 0; c < k; c++) {
+            ref[j] += (double)a[c] * x[c * ldx + j];
+        }
+    }
+    // Out of place first: y must come through unchanged
+    float *p = &ps[OFFSET];
+    esn_axpy_multi_from(n, k, a, x, ldx, y, p);
+    for (int j = 0; j < n; j++) {
+        CHECK(fabs(p[j] - ref[j]) <= k * TOL,
+              "esn_axpy_multi_from n=%d k=%d: y[%d] = %g, want %g",
+              n, k, j, p[j], ref[j]);
+    }
+    esn_axpy_multi(n, k, a, x, ldx, y);
+    for (int j = 0; j < n; j++) {
+        CHECK(fabs(y[j] - ref[j]) <= k * TOL,
+              "esn_axpy_multi n=%d k=%d: y[%d] = %g, want %g",
+              n, k, j, y[j], ref[j]);
+    }
+}
+
+static void test_dot_axpy(int n)
+{
+    float *row = &xs[OFFSET];
+    float *z = &ys[OFFSET];
+    float *p = &ps[OFFSET];
+    const float a = -1.25f;
+    double dot = 0.0;
+    double mag = 0.0;
+
+    test_fill(row, n, 1.0f);
+    test_fill(z, n, 1.0f);
+    test_fill(p, n, 1.0f);
+    for (int j = 0; j < n; j++) {
+        ref[j] = p[j] + (double)a * row[j];
+        dot += (double)row[j] * z[j];
+        mag += fabs((double)row[j] * z[j]);
+    }
+    float got = esn_dot_axpy(n, row, z, a, p);
+    CHECK(fabs(got - dot) <= n * TOL * mag + 1e-30,
+          "esn_dot_axpy n=%d: dot %g, want %g", n, got, dot);
+    for (int j = 0; j < n; j++) {
+        CHECK(fabs(p[j] - ref[j]) <= TOL, "esn_dot_axpy n=%d: p[%d] = %g, "
+              "want %g", n, j, p[j], ref[j]);
+    }
+
+    got = esn_dot(n, row, z);
+    CHECK(fabs(got - dot) <= n * TOL * mag + 1e-30,
+          "esn_dot n=%d: %g, want %g", n, got, dot);
+}
+
+static void test_rotate(int n)
+{
+    float *x = &xs[OFFSET];
+    float *y = &ys[OFFSET];
+    const float a = 0.6f, b = 0.8f, c = -0.8f, d = 0.6f;
+
+    test_fill(x, n, 1.0f);
+    test_fill(y, n, 1.0f);
+    for (int j = 0; j < n; j++) {
+        ref[j] = (double)a * x[j] + (double)b * y[j];
+        ref2[j] = (double)c * x[j] + (double)d * y[j];
+    }
+    esn_rotate(n, a, b, c, d, x, y);
+    for (int j = 0; j < n; j++) {
+        CHECK(fabs(x[j] - ref[j]) <= TOL && fabs(y[j] - ref2[j]) <= TOL,
+              "esn_rotate n=%d: (%g, %g) at %d, want (%g, %g)",
+              n, x[j], y[j], j, ref[j], ref2[j]);
+    }
+}
+
+int main(void)
+{
+    for (int n = 0; n <= MAX_N - 3; n++) {
+        test_axpy(n);
+        test_dot_axpy(n);
+        test_rotate(n);
+        for (int k = 0; k <= MAX_K; k++) {
+            test_axpy_multi(n, k);
+        }
+    }
+    return test_report("test_level1");
+}
@@ -0,0 +1,136 @@
+/*******************************************************************************
+ * File: test_model.c
+ *
+ *   Description:
+ *     MODEL___ descriptor parsing and validation (esn_model_from_floats),
+ *     kernel selection for the loaded sizes, and the model arena.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_model.h"
+#include <stdint.h>
+
+/* A descriptor with the given sizes and otherwise valid fields */
+static int load(esn_model_t *m, float n_in, float n, float n_out,
+                float act, float nnz, float trainer)
+{
+    const float v[ESN_MODEL_FIELDS] = {n_in, n, n_out, act, 0.999f, 1.0f,
+                                       nnz, trainer, 1};
+    return esn_model_from_floats(v, ESN_MODEL_FIELDS, m);
+}
+
+static void test_descriptor(void)
+{
+    esn_model_t m;
+    const float short_v[ESN_MODEL_MIN_FIELDS] = {40, 16, 4, 1, 0.99f, 10.0f};
+    const float bad_lambda[ESN_MODEL_MIN_FIELDS] = {40, 16, 4, 0, 1.5f, 1.0f};
+    const float bad_psi[ESN_MODEL_MIN_FIELDS] = {40, 16, 4, 0, 0.99f, 0.0f};
+
+    // The optional fields default to dense and RLS
+    CHECK(esn_model_from_floats(short_v, ESN_MODEL_MIN_FIELDS, &m) == 0,
+          "minimal descriptor rejected");
+    CHECK(m.num_inputs == 40 && m.num_neurons == 16 && m.num_outputs == 4 &&
+          m.extended_size == 56, "sizes not taken from the descriptor");
+    CHECK(m.activation == ESN_ACT_TANH_RATIONAL, "activation not loaded");
+    CHECK(m.forgetting_factor == 0.99f && m.psi_init == 10.0f,
+          "RLS settings not loaded");
+    CHECK(m.max_row_nnz == 0 && m.trainer == ESN_TRAINER_RLS &&
+          m.feature_stride == 1,
+          "optional fields do not default to dense RLS on all features");
+    CHECK(strcmp(m.kernel_variant, "16x40") == 0,
+          "16x40 model got kernel %s", m.kernel_variant);
+
+    CHECK(esn_model_from_floats(short_v, ESN_MODEL_MIN_FIELDS - 1, &m) != 0,
+          "truncated descriptor accepted");
+    CHECK(esn_model_from_floats(bad_lambda, ESN_MODEL_MIN_FIELDS, &m) != 0,
+          "forgetting factor > 1 accepted");
+    CHECK(esn_model_from_floats(bad_psi, ESN_MODEL_MIN_FIELDS, &m) != 0,
+          "psi_init = 0 accepted");
+
+    CHECK(load(&m, 12, 20, 3, 2, 0, 2) == 0, "12x20x3 QR-RLS rejected");
+    CHECK(m.trainer == ESN_TRAINER_QR_RLS && m.activation == ESN_ACT_TANH_LUT,
+          "trainer or activation not loaded");
+    CHECK(strcmp(m.kernel_variant, "generic") == 0,
+          "12x20 model got kernel %s", m.kernel_variant);
+
+    // Size limits: dense reservoirs stop at ESN_MAX_DENSE_NEURONS
+    CHECK(load(&m, ESN_MAX_INPUTS, ESN_MAX_DENSE_NEURONS, ESN_MAX_OUTPUTS,
+               0, 0, 0) == 0, "largest dense model rejected");
+    CHECK(load(&m, 40, ESN_MAX_DENSE_NEURONS + 1, 4, 0, 0, 0) != 0,
+          "oversized dense model accepted");
+    CHECK(load(&m, 40, ESN_MAX_NEURONS, 4, 0, 10, 0) == 0,
+          "largest sparse model rejected");
+    CHECK(load(&m, 40, ESN_MAX_NEURONS + 1, 4, 0, 10, 0) != 0,
+          "oversized sparse model accepted");
+    CHECK(load(&m, ESN_MAX_INPUTS + 1, 8, 4, 0, 0, 0) != 0,
+          "too many inputs accepted");
+    CHECK(load(&m, 40, 8, 0, 0, 0, 0) != 0, "zero outputs accepted");
+    CHECK(load(&m, 40, 8, 4, 0, -1, 0) != 0, "negative max_row_nnz accepted");
+
+    // Enum fields out of range on either side
+    CHECK(load(&m, 40, 8, 4, -1, 0, 0) != 0, "activation -1 accepted");
+    CHECK(load(&m, 40, 8, 4, 3, 0, 0) != 0, "activation 3 accepted");
+    CHECK(load(&m, 40, 8, 4, 0, 0, -1) != 0, "trainer -1 accepted");
+    CHECK(load(&m, 40, 8, 4, 0, 0, 3) != 0, "trainer 3 accepted");
+
+    // RLS feature stride: 0 (reservoir only) .. num_inputs
+    float strided[ESN_MODEL_FIELDS] = {40, 8, 4, 0, 0.999f, 1.0f, 0, 0, 4};
+    CHECK(esn_model_from_floats(strided, ESN_MODEL_FIELDS, &m) == 0 &&
+          m.feature_stride == 4, "feature stride 4 not loaded");
+    strided[8] = 41;
+    CHECK(esn_model_from_floats(strided, ESN_MODEL_FIELDS, &m) != 0,
+          "feature stride 41 accepted for 40 inputs");
+    strided[8] = -1;
+    CHECK(esn_model_from_floats(strided, ESN_MODEL_FIELDS, &m) != 0,
+          "feature stride -1 accepted");
+
+    // Integer fields must be whole, finite and in range before any cast
+    static const struct { int field; float value; } bad[] = {
+        {0, 40.5f}, {1, NAN}, {1, 1e10f}, {2, -INFINITY}, {3, 1.5f},
+        {3, 3.0f}, {6, INFINITY}, {6, 4096.0f}, {7, -1.0f}, {7, 0.25f},
+        {8, 2.5f}, {5, INFINITY},
+    };
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        float v[ESN_MODEL_FIELDS] = {40, 8, 4, 0, 0.999f, 1.0f, 0, 0, 1};
+        v[bad[i].field] = bad[i].value;
+        CHECK(esn_model_from_floats(v, ESN_MODEL_FIELDS, &m) != 0,
+              "field %d = %g accepted", bad[i].field, bad[i].value);
+    }
+}
+
+static void test_arena(void)
+{
+    size_t free_bytes;
+    unsigned char *a, *b, *c;
+
+    esn_arena_reset();
+    a = esn_arena_alloc(3);
+    b = esn_arena_alloc(100);
+    CHECK(a != NULL && b != NULL, "small allocations failed");
+    CHECK(((uintptr_t)a & 15) == 0 && ((uintptr_t)b & 15) == 0,
+          "allocations not 16-byte aligned");
+    CHECK(b - a == 16, "3-byte block not rounded up to 16");
+
+    memset(b, 0xA5, 100);
+    esn_arena_reset();
+    c = esn_arena_alloc(200);
+    CHECK(c == a, "reset did not free the arena");
+    CHECK(c[16] == 0 && c[115] == 0, "reused block not zeroed");
+
+    esn_arena_scratch(&free_bytes);
+    CHECK(free_bytes == ESN_ARENA_BYTES - 208, "scratch size %u wrong",
+          (unsigned)free_bytes);
+    CHECK(esn_arena_alloc(free_bytes + 1) == NULL,
+          "allocation past the end succeeded");
+    CHECK(esn_arena_alloc(free_bytes) != NULL,
+          "allocation of exactly the rest failed");
+    esn_arena_reset();
+}
+
+int main(void)
+{
+    test_descriptor();
+    test_arena();
+    return test_report("test_model");
+}
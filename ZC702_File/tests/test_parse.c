@@ -0,0 +1,226 @@
+/*******************************************************************************
+ * File: test_parse.c
+ *
+ *   Description:
+ *     esn_parse_float() against the C library's strtof(): the same float
+ *     (bit for bit) and the same end pointer for random doubles, random
+ *     floats, random digit strings, exact float midpoints and their
+ *     neighbours, and special forms. Then the stream decoder: a payload
+ *     fed in pieces of every size decodes to the same values as in one
+ *     piece, for ASCII and float32 payloads.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_parse.h"
+
+#define RANDOM_CASES   1000000
+#define MIDPOINT_CASES 1000000
+
+static uint64_t rng64 = 88172645463325252ULL;
+
+static uint64_t rnd64(void)
+{
+    rng64 ^= rng64 << 13;
+    rng64 ^= rng64 >> 7;
+    rng64 ^= rng64 << 17;
+    return rng64;
+}
+
+static long checked = 0;
+static long mismatched = 0;
+
+static void check_one(const char *text)
+{
+    char *end_ref;
+    char *end_fast;
+    float ref = strtof(text, &end_ref);
+    float fast = esn_parse_float(text, &end_fast);
+
+    checked++;
+    if (memcmp(&ref, &fast, sizeof(float)) != 0 || end_ref != end_fast) {
+        if (mismatched++ < 10) {
+            fprintf(stderr, "  '%s': strtof %a (%d chars), "
+                    "esn_parse_float %a (%d chars)\n", text, ref,
+                    (int)(end_ref - text), fast, (int)(end_fast - text));
+        }
+    }
+}
+
+/* Random doubles, floats, fractions and digit strings */
+static void test_random(void)
+{
+    char buf[128];
+
+    for (long i = 0; i < RANDOM_CASES; i++) {
+        uint64_t r = rnd64();
+        double d;
+
+        memcpy(&d, &r, sizeof(d));
+        if (isnan(d) || isinf(d)) {
+            continue;
+        }
+        switch (i % 6) {
+        case 0:
+            snprintf(buf, sizeof(buf), "%.17g", d);
+            break;
+        case 1: {
+            uint32_t u = (uint32_t)r;
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            if (isnan(f) || isinf(f)) {
+                f = 1.0f;
+            }
+            snprintf(buf, sizeof(buf), "%.9g", f);
+            break;
+        }
+        case 2:
+            snprintf(buf, sizeof(buf), "%.17g",
+                     ((rnd64() & 1) ? -1.0 : 1.0) *
+                     (double)(rnd64() % 1000000000) /
+                     (double)(1 + rnd64() % 100000));
+            break;
+        case 3: {
+            // The generator's own format: "-1.2345678901234567"
+            double v = (double)(int64_t)(rnd64() % 20000000000000000ULL) *
+                       1e-16 - 1.0;
+            snprintf(buf, sizeof(buf), "%.16f", v);
+            break;
+        }
+        case 4: {
+            int j = 0;
+            int digits = 1 + (int)(rnd64() % 25);
+            int dot = (int)(rnd64() % (digits + 1));
+
+            if (rnd64() & 1) {
+                buf[j++] = '-';
+            }
+            for (int t = 0; t < digits; t++) {
+                if (t == dot) {
+                    buf[j++] = '.';
+                }
+                buf[j++] = (char)('0' + rnd64() % 10);
+            }
+            if (rnd64() % 3 == 0) {
+                j += sprintf(&buf[j], "e%d", (int)(rnd64() % 90) - 45);
+            }
+            buf[j] = '\0';
+            break;
+        }
+        default:
+            snprintf(buf, sizeof(buf), "%.6e", d * 1e-300);
+            break;
+        }
+        check_one(buf);
+    }
+}
+
+/*
+ * Halfway between two adjacent floats and a few doubles either side:
+ * the inputs where a fast path is most likely to round the wrong way.
+ */
+static void test_midpoints(void)
+{
+    static const char *const formats[] = {"%.16g", "%.17g", "%.18g",
+                                          "%.19g", "%.20g", "%.25g"};
+    char buf[128];
+
+    for (long i = 0; i < MIDPOINT_CASES; i++) {
+        uint32_t u = 0x00800000u +
+                     (uint32_t)(rnd64() % (0x7f000000u - 0x00800000u));
+        float f;
+
+        memcpy(&f, &u, sizeof(f));
+        double m = ((double)f + (double)nextafterf(f, INFINITY)) / 2.0;
+        int steps = (int)(rnd64() % 9) - 4;
+        for (int j = 0; j < abs(steps); j++) {
+            m = nextafter(m, (steps > 0) ? INFINITY : -INFINITY);
+        }
+        snprintf(buf, sizeof(buf), formats[rnd64() % 6],
+                 (rnd64() & 1) ? m : -m);
+        check_one(buf);
+    }
+}
+
+static void test_special(void)
+{
+    static const char *const cases[] = {
+        "0", "-0", "+1", "1e", "1e+", "0x1p3", "inf", "-nan", "abc", ".",
+        "-.5", ".5e1", "1.", "00012.50", "1e400", "1e-50", "3.4028235e38",
+        "3.4028236e38", "1.17549435e-38", "1.1754942e-38", "1.4e-45",
+        "7e-46", "123456789012345678901234567890",
+        "0.000000000000000000000000001", " 1.5", "\t-2.25\n",
+    };
+
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check_one(cases[i]);
+    }
+}
+
+/* Decoding in pieces of any size gives the values of a single piece */
+static void test_stream_splits(void)
+{
+    static const char text[] =
+        "-1.2345678901234567\n 0.5\r\n3e2  -7.25e-3\t42\n"
+        "0.0000001\n-0\n6.02214076e23\n1.17549435e-38\n";
+    float whole[32];
+    float split[32];
+    float raw[8] = {1.5f, -2.0f, 3.25e-5f, 0.0f, -0.0f, 1e30f, -7.0f, 9.0f};
+    float raw_out[8];
+    esn_float_stream_t s;
+    const unsigned int len = sizeof(text) - 1;
+
+    esn_stream_begin(&s, PAYLOAD_ASCII, whole, 32);
+    esn_stream_feed(&s, text, len);
+    unsigned int count = esn_stream_end(&s);
+    CHECK(count == 9, "ASCII payload decoded to %u values, want 9", count);
+
+    for (unsigned int piece = 1; piece <= len; piece++) {
+        memset(split, 0, sizeof(split));
+        esn_stream_begin(&s, PAYLOAD_ASCII, split, 32);
+        for (unsigned int off = 0; off < len; off += piece) {
+            unsigned int n = (len - off < piece) ? len - off : piece;
+            esn_stream_feed(&s, &text[off], n);
+        }
+        unsigned int got = esn_stream_end(&s);
+        CHECK(got == count && memcmp(split, whole, sizeof(float) * count) == 0,
+              "ASCII payload in %u-byte pieces: %u values, or values differ",
+              piece, got);
+    }
+
+    // Too many values: the extra ones are dropped, not written
+    esn_stream_begin(&s, PAYLOAD_ASCII, split, 4);
+    split[4] = 99.0f;
+    esn_stream_feed(&s, text, len);
+    count = esn_stream_end(&s);
+    CHECK(count == 4 && split[4] == 99.0f,
+          "max_count 4: %u values kept, or wrote past the end", count);
+
+    for (unsigned int piece = 1; piece <= sizeof(raw); piece++) {
+        const char *bytes = (const char *)raw;
+
+        memset(raw_out, 0, sizeof(raw_out));
+        esn_stream_begin(&s, PAYLOAD_F32, raw_out, 8);
+        for (unsigned int off = 0; off < sizeof(raw); off += piece) {
+            unsigned int n = (sizeof(raw) - off < piece) ? sizeof(raw) - off
+                                                          : piece;
+            esn_stream_feed(&s, &bytes[off], n);
+        }
+        count = esn_stream_end(&s);
+        CHECK(count == 8 && memcmp(raw_out, raw, sizeof(raw)) == 0,
+              "float32 payload in %u-byte pieces decoded wrong", piece);
+    }
+}
+
+int main(void)
+{
+    test_special();
+    test_random();
+    test_midpoints();
+    printf("esn_parse_float: %ld strings checked, %ld differ from strtof\n",
+           checked, mismatched);
+    CHECK(mismatched == 0, "%ld of %ld strings differ from strtof",
+          mismatched, checked);
+    test_stream_splits();
+    return test_report("test_parse");
+}
@@ -0,0 +1,179 @@
+/*******************************************************************************
+ * File: test_ridge.c
+ *
+ *   Description:
+ *     The ridge-regression trainer in ridge_training.c against the same
+ *     normal equations (R + beta I) W_out^T = P^T solved in double
+ *     precision, and its diagonal loading on a rank-deficient R.
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_model.h"
+#include "rls_training.h"
+#include "ridge_training.h"
+
+#define MAX_EXT 48
+#define MAX_OUT 4
+#define MAX_SAMPLES 400
+
+static esn_model_t model;
+static float z_all[MAX_SAMPLES * MAX_EXT];
+static float y_all[MAX_SAMPLES * MAX_OUT];
+
+static void setup(int n_in, int n, int n_out)
+{
+    esn_model_defaults(&model);
+    model.num_inputs = n_in;
+    model.num_neurons = n;
+    model.num_outputs = n_out;
+    model.extended_size = n + n_in;
+    esn_select_kernels(&model);
+
+    esn_arena_reset();
+    if (rls_configure(&model) != 0) {
+        fprintf(stderr, "rls_configure failed\n");
+        exit(1);
+    }
+    ridge_configure(&model);
+    ridge_enable();
+    test_seed(4242);
+}
+
+/* count samples z ~ U(-1, 1), y = W_true z + noise, into ridge and z_all */
+static void accumulate(int count)
+{
+    const int ext = model.extended_size;
+    const int n_out = model.num_outputs;
+    float w_true[MAX_OUT * MAX_EXT];
+
+    test_fill(w_true, n_out * ext, 1.0f);
+    for (int s = 0; s < count; s++) {
+        float *z = &z_all[s * ext];
+        float *y = &y_all[s * n_out];
+
+        test_fill(z, ext, 1.0f);
+        for (int o = 0; o < n_out; o++) {
+            double acc = 0.0;
+            for (int j = 0; j < ext; j++) {
+                acc += (double)w_true[o * ext + j] * z[j];
+            }
+            y[o] = (float)acc + 0.01f * test_randf();
+        }
+        ridge_accumulate(z, y);
+    }
+}
+
+/* W_out from (R + beta I) W^T = P^T in double (Gaussian elimination) */
+static void ref_solve(int count, double beta, float *w_ref)
+{
+    const int ext = model.extended_size;
+    const int n_out = model.num_outputs;
+    static double A[MAX_EXT * MAX_EXT];
+    static double b[MAX_OUT * MAX_EXT];
+
+    for (int i = 0; i < ext; i++) {
+        for (int j = 0; j < ext; j++) {
+            double acc = (i == j) ? beta : 0.0;
+            for (int s = 0; s < count; s++) {
+                acc += (double)z_all[s * ext + i] * z_all[s * ext + j];
+            }
+            A[i * ext + j] = acc;
+        }
+        for (int o = 0; o < n_out; o++) {
+            double acc = 0.0;
+            for (int s = 0; s < count; s++) {
+                acc += (double)y_all[s * n_out + o] * z_all[s * ext + i];
+            }
+            b[o * ext + i] = acc;
+        }
+    }
+    for (int k = 0; k < ext; k++) {
+        for (int i = k + 1; i < ext; i++) {
+            const double f = A[i * ext + k] / A[k * ext + k];
+            for (int j = k; j < ext; j++) {
+                A[i * ext + j] -= f * A[k * ext + j];
+            }
+            for (int o = 0; o < n_out; o++) {
+                b[o * ext + i] -= f * b[o * ext + k];
+            }
+        }
+    }
+    for (int o = 0; o < n_out; o++) {
+        for (int i = ext - 1; i >= 0; i--) {
+            double acc = b[o * ext + i];
+            for (int j = i + 1; j < ext; j++) {
+                acc -= A[i * ext + j] * w_ref[o * ext + j];
+            }
+            w_ref[o * ext + i] = (float)(acc / A[i * ext + i]);
+        }
+    }
+}
+
+/* Well-posed problems: the packed Cholesky solve matches the reference */
+static void test_solve(void)
+{
+    static const int dims[][4] = {
+        /* inputs, neurons, outputs, samples */
+        {12, 8, 3, 400}, {40, 8, 4, 300}, {5, 3, 1, 37},
+    };
+    float w_ref[MAX_OUT * MAX_EXT];
+
+    for (unsigned d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+        setup(dims[d][0], dims[d][1], dims[d][2]);
+        accumulate(dims[d][3]);
+        ref_solve(dims[d][3], 0.1, w_ref);
+
+        CHECK(ridge_solve(0.1f) == 0, "ridge_solve failed");
+        const float *w = rls_w_out_acquire();
+        double err = test_rel_diff(w, w_ref,
+                                   model.num_outputs * model.extended_size);
+        rls_w_out_release(w);
+        printf("ridge %dx%dx%d, %d samples: relative W_out error %.3g\n",
+               dims[d][0], dims[d][1], dims[d][2], dims[d][3], err);
+        CHECK(err < 1e-4, "ridge %dx%dx%d: W_out off by %g (relative)",
+              dims[d][0], dims[d][1], dims[d][2], err);
+    }
+}
+
+/*
+ * Fewer samples than features and beta = 0: R is singular, and in float
+ * the pivots after the sixth are rounding noise of either sign. The solve
+ * must load the diagonal instead of failing, and still fit the samples.
+ */
+static void test_diagonal_loading(void)
+{
+    const int count = 6;
+    float y[MAX_OUT];
+    double res = 0.0;
+    double mag = 0.0;
+
+    setup(16, 8, 2);
+    accumulate(count);
+    CHECK(ridge_solve(0.0f) == 0, "ridge_solve gave up on a singular R");
+
+    const float *w = rls_w_out_acquire();
+    for (int s = 0; s < count; s++) {
+        esn_gemv_ref(w, model.extended_size,
+                     &z_all[s * model.extended_size], model.num_outputs,
+                     model.extended_size, y);
+        for (int o = 0; o < model.num_outputs; o++) {
+            double e = y[o] - y_all[s * model.num_outputs + o];
+            res += e * e;
+            mag += (double)y_all[s * model.num_outputs + o] *
+                   y_all[s * model.num_outputs + o];
+        }
+    }
+    rls_w_out_release(w);
+    printf("ridge on %d samples of %d features, beta 0: relative fit "
+           "residual %.3g\n", count, model.extended_size, sqrt(res / mag));
+    CHECK(sqrt(res / mag) < 1e-2, "loaded ridge solve fits its samples "
+          "with relative residual %g", sqrt(res / mag));
+}
+
+int main(void)
+{
+    test_solve();
+    test_diagonal_loading();
+    return test_report("test_ridge");
+}
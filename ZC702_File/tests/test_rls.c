@@ -0,0 +1,445 @@
+/*******************************************************************************
+ * File: test_rls.c
+ *
+ *   Description:
+ *     The online W_out trainers in rls_training.c against a textbook RLS
+ *     in double precision with a full (unpacked) Psi:
+ *       k = Psi z / (lambda + z^T Psi z)
+ *       W_out += e k^T
+ *       Psi = (Psi - k z^T Psi) / lambda
+ *     Samples are z ~ U(-1, 1) with targets y = W_true z + noise. With an
+ *     error bound the reference is set-membership RLS: samples in bound
+ *     are skipped and the others weighted, d = max(lambda + G, G / mu).
+ *     With a feature mask the gain is computed from z with the unselected
+ *     features zeroed (the error still from all of z).
+ *
+ ******************************************************************************/
+
+#include "test_common.h"
+#include "esn_model.h"
+#include "rls_training.h"
+
+#define MAX_EXT 48
+#define MAX_OUT 4
+
+static esn_model_t model;
+
+/* Reference trainer state */
+static double ref_psi[MAX_EXT * MAX_EXT];
+static double ref_w[MAX_OUT * MAX_EXT];
+static double ref_bound = 0.0;     // set-membership RMS bound, 0: off
+static int ref_skipped = 0;
+static int ref_weighted = 0;       // steps smaller than plain RLS
+static float ref_mask[MAX_EXT];    // 1: feature trained, 0: masked out
+
+/* Sample generator */
+static float w_true[MAX_OUT * MAX_EXT];
+
+static void setup_strided(int n_in, int n, int n_out, float lambda,
+                          esn_trainer_t trainer, int stride)
+{
+    const int ext = n + n_in;
+
+    esn_model_defaults(&model);
+    model.num_inputs = n_in;
+    model.num_neurons = n;
+    model.num_outputs = n_out;
+    model.extended_size = ext;
+    model.forgetting_factor = lambda;
+    model.psi_init = 1.0f;
+    model.trainer = trainer;
+    model.feature_stride = stride;
+    esn_select_kernels(&model);
+
+    esn_arena_reset();
+    if (rls_configure(&model) != 0) {
+        fprintf(stderr, "rls_configure failed\n");
+        exit(1);
+    }
+    enable_training();
+
+    memset(ref_w, 0, sizeof(ref_w));
+    memset(ref_psi, 0, sizeof(ref_psi));
+    ref_bound = 0.0;
+    ref_skipped = 0;
+    ref_weighted = 0;
+    for (int i = 0; i < ext; i++) {
+        ref_psi[i * ext + i] = model.psi_init;
+        ref_mask[i] = 1.0f;
+    }
+    test_seed(12345);
+    test_fill(w_true, n_out * ext, 1.0f);
+}
+
+static void setup(int n_in, int n, int n_out, float lambda,
+                  esn_trainer_t trainer)
+{
+    setup_strided(n_in, n, n_out, lambda, trainer, 1);
+}
+
+static void next_sample(float *z, float *y)
+{
+    const int ext = model.extended_size;
+
+    test_fill(z, ext, 1.0f);
+    for (int i = 0; i < model.num_outputs; i++) {
+        double acc = 0.0;
+        for (int j = 0; j < ext; j++) {
+            acc += (double)w_true[i * ext + j] * z[j];
+        }
+        y[i] = (float)acc + 0.01f * test_randf();
+    }
+}
+
+static void ref_update(const float *z, const float *y)
+{
+    const int ext = model.extended_size;
+    const int n_out = model.num_outputs;
+    const double lambda = model.forgetting_factor;
+    double p[MAX_EXT];
+    double e[MAX_OUT];
+    double zm[MAX_EXT];
+    double G = 0.0;
+    double e2 = 0.0;
+
+    for (int o = 0; o < n_out; o++) {
+        e[o] = y[o];
+        for (int j = 0; j < ext; j++) {
+            e[o] -= ref_w[o * ext + j] * z[j];
+        }
+        e2 += e[o] * e[o];
+    }
+    const double rms = sqrt(e2 / n_out);
+    if (ref_bound > 0.0 && rms <= ref_bound) {
+        ref_skipped++;
+        return;
+    }
+
+    for (int j = 0; j < ext; j++) {
+        zm[j] = ref_mask[j] * z[j];
+    }
+    for (int i = 0; i < ext; i++) {
+        double acc = 0.0;
+        for (int j = 0; j < ext; j++) {
+            acc += ref_psi[i * ext + j] * zm[j];
+        }
+        p[i] = acc;
+        G += zm[i] * acc;
+    }
+    double d = lambda + G;
+    if (ref_bound > 0.0 && G / (1.0 - ref_bound / rms) > d) {
+        d = G / (1.0 - ref_bound / rms);
+        ref_weighted++;
+    }
+    for (int o = 0; o < n_out; o++) {
+        for (int j = 0; j < ext; j++) {
+            ref_w[o * ext + j] += e[o] * p[j] / d;
+        }
+    }
+    for (int i = 0; i < ext; i++) {
+        for (int j = 0; j < ext; j++) {
+            ref_psi[i * ext + j] = (ref_psi[i * ext + j] - p[i] * p[j] / d) /
+                                   lambda;
+        }
+    }
+}
+
+/* ||W_out - W_ref|| / ||W_ref|| */
+static double w_out_error(void)
+{
+    const int count = model.num_outputs * model.extended_size;
+    const float *w = rls_w_out_acquire();
+    float ref[MAX_OUT * MAX_EXT];
+
+    for (int i = 0; i < count; i++) {
+        ref[i] = (float)ref_w[i];
+    }
+    double err = test_rel_diff(w, ref, count);
+    rls_w_out_release(w);
+    return err;
+}
+
+/* Train both on count samples, one update_training_rls() call each */
+static double run_sequential(int count)
+{
+    float z[MAX_EXT];
+    float y[MAX_OUT];
+
+    for (int s = 0; s < count; s++) {
+        next_sample(z, y);
+        update_training_rls(z, y);
+        ref_update(z, y);
+    }
+    return w_out_error();
+}
+
+/*
+ * Train on count samples in blocks of k: each sample is queued with its
+ * prediction from the W_out at the start of its block, as batched
+ * inference does, and the last partial block is flushed. The reference
+ * still updates one sample at a time.
+ */
+static double run_blocked(int count, int k)
+{
+    const int ext = model.extended_size;
+    float z[MAX_EXT];
+    float y[MAX_OUT];
+    float y_pred[MAX_OUT];
+
+    rls_set_block_size(k);
+    for (int s = 0; s < count; s++) {
+        next_sample(z, y);
+        const float *w = rls_w_out_acquire();
+        esn_gemv_ref(w, ext, z, model.num_outputs, ext, y_pred);
+        rls_w_out_release(w);
+        rls_block_push(z, y, y_pred);
+        ref_update(z, y);
+    }
+    rls_block_flush();
+    rls_set_block_size(1);
+    return w_out_error();
+}
+
+/* Packed upper-triangle Psi gives the same W_out as a full Psi */
+static void test_packed_psi(void)
+{
+    static const int dims[][3] = {
+        /* inputs, neurons, outputs */
+        {12, 8, 3}, {5, 3, 1}, {40, 8, 4}, {1, 1, 2},
+    };
+
+    for (unsigned d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+        setup(dims[d][0], dims[d][1], dims[d][2], 0.999f, ESN_TRAINER_RLS);
+        double err = run_sequential(300);
+        printf("packed RLS %dx%dx%d: relative W_out error %.3g\n",
+               dims[d][0], dims[d][1], dims[d][2], err);
+        CHECK(err < 1e-5, "packed RLS %dx%dx%d: W_out off by %g (relative)",
+              dims[d][0], dims[d][1], dims[d][2], err);
+    }
+}
+
+/*
+ * Lazy 1/lambda: at lambda = 0.98 psi_scale passes RLS_PSI_SCALE_LIMIT
+ * every ~550 samples, so 4000 samples fold it back into Psi several times.
+ */
+static void test_lazy_scaling(void)
+{
+    static const float lambdas[] = {0.98f, 0.995f, 1.0f};
+
+    for (unsigned l = 0; l < sizeof(lambdas) / sizeof(lambdas[0]); l++) {
+        setup(12, 8, 3, lambdas[l], ESN_TRAINER_RLS);
+        double err = run_sequential(4000);
+        printf("lazy-scaled RLS, lambda %g: relative W_out error %.3g\n",
+               lambdas[l], err);
+        CHECK(err < 1e-5, "lambda %g: W_out off by %g after 4000 samples",
+              lambdas[l], err);
+    }
+}
+
+/* Inverse QR-RLS propagates a factor of Psi, but the W_out is the same */
+static void test_qr_rls(void)
+{
+    static const float lambdas[] = {0.98f, 0.999f};
+
+    for (unsigned l = 0; l < sizeof(lambdas) / sizeof(lambdas[0]); l++) {
+        setup(12, 8, 3, lambdas[l], ESN_TRAINER_QR_RLS);
+        double err = run_sequential(2000);
+        printf("QR-RLS, lambda %g: relative W_out error %.3g\n",
+               lambdas[l], err);
+        CHECK(err < 1e-5, "QR-RLS lambda %g: W_out off by %g",
+              lambdas[l], err);
+    }
+}
+
+/* Woodbury rank-K block update == K sequential rank-1 updates */
+static void test_block_rls(void)
+{
+    static const int sizes[] = {2, 3, 8, RLS_BLOCK_MAX};
+    static const float lambdas[] = {0.98f, 0.999f};
+
+    for (unsigned l = 0; l < sizeof(lambdas) / sizeof(lambdas[0]); l++) {
+        for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+            setup(12, 8, 3, lambdas[l], ESN_TRAINER_RLS);
+            // 1000 is not a multiple of 3, 8 or 32: ends on a partial block
+            double err = run_blocked(1000, sizes[k]);
+            printf("block RLS K=%d, lambda %g: relative W_out error %.3g\n",
+                   sizes[k], lambdas[l], err);
+            CHECK(err < 1e-5, "block RLS K=%d lambda %g: W_out off by %g",
+                  sizes[k], lambdas[l], err);
+        }
+    }
+}
+
+/*
+ * Set-membership RLS and QR-RLS against the weighted reference. The noise
+ * is U(-0.01, 0.01) per output, RMS 0.0058; a bound of 0.0062 leaves
+ * samples skipped, weighted and (early on) given plain RLS steps.
+ */
+static void test_set_membership(void)
+{
+    static const esn_trainer_t trainers[] = {
+        ESN_TRAINER_RLS, ESN_TRAINER_QR_RLS
+    };
+    const float bound = 0.0062f;
+
+    for (unsigned t = 0; t < sizeof(trainers) / sizeof(trainers[0]); t++) {
+        setup(12, 8, 3, 0.999f, trainers[t]);
+        rls_set_error_bound(bound);
+        ref_bound = bound;
+
+        float z[MAX_EXT];
+        float y[MAX_OUT];
+        float y_pred[MAX_OUT];
+        for (int s = 0; s < 2000; s++) {
+            next_sample(z, y);
+            const float *w = rls_w_out_acquire();
+            esn_gemv_ref(w, model.extended_size, z,
+                         model.num_outputs, model.extended_size, y_pred);
+            rls_w_out_release(w);
+            update_training_rls_fused(z, y, y_pred);
+            ref_update(z, y);
+        }
+        double err = w_out_error();
+        printf("set-membership %s: %d skipped, %d weighted of 2000, "
+               "relative W_out error %.3g\n",
+               (t == 0) ? "RLS" : "QR-RLS", ref_skipped, ref_weighted, err);
+        CHECK(ref_skipped > 0 && ref_weighted > 0,
+              "bound %g: %d skipped, %d weighted; test does not cover both",
+              bound, ref_skipped, ref_weighted);
+        CHECK(err < 1e-5, "set-membership trainer %d: W_out off by %g",
+              (int)trainers[t], err);
+    }
+    rls_set_error_bound(0.0f);
+}
+
+/*
+ * Feature-masked RLS against the masked reference. W_out starts nonzero,
+ * so the untrained columns must keep their values while they still count
+ * in the prediction. Psi comes sized to the model's stride and grows when
+ * a larger selection is asked for at run time.
+ */
+static void test_feature_mask(void)
+{
+    static const struct {
+        int model_stride;   // MODEL___ feature_stride (sizes Psi)
+        int stride;         // rls_set_feature_stride() before training
+        esn_trainer_t trainer;
+        int k;              // block size
+    } cases[] = {
+        {2, 2, ESN_TRAINER_RLS, 1},
+        {3, 3, ESN_TRAINER_RLS, 8},
+        {0, 0, ESN_TRAINER_RLS, 1},
+        {0, 5, ESN_TRAINER_RLS, 3},     // grows Psi from 8 to 11 features
+        {1, 2, ESN_TRAINER_RLS, 1},     // shrinks within the full Psi
+        {3, 3, ESN_TRAINER_QR_RLS, 1},
+        {12, 12, ESN_TRAINER_RLS, 1},   // one input: still a prefix of z
+    };
+    const int n_in = 12;
+    const int n = 8;
+    const int n_out = 3;
+    const int ext = n + n_in;
+    float w_init[MAX_OUT * MAX_EXT];
+    size_t free_full;
+    size_t free_masked;
+
+    setup(40, n, n_out, 0.999f, ESN_TRAINER_RLS);
+    esn_arena_scratch(&free_full);
+    setup_strided(40, n, n_out, 0.999f, ESN_TRAINER_RLS, 3);
+    esn_arena_scratch(&free_masked);
+    CHECK(free_masked > free_full,
+          "40-input model takes as much arena at input stride 3 as at 1");
+
+    for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const int stride = cases[c].stride;
+
+        setup_strided(n_in, n, n_out, 0.999f, cases[c].trainer,
+                      cases[c].model_stride);
+        CHECK(rls_set_feature_stride(stride) == 0,
+              "stride %d refused", stride);
+        for (int j = n; j < ext; j++) {
+            ref_mask[j] = (stride > 0 && (j - n) % stride == 0) ? 1.0f : 0.0f;
+        }
+        test_fill(w_init, n_out * ext, 0.5f);
+        set_W_out(w_init);
+        for (int i = 0; i < n_out * ext; i++) {
+            ref_w[i] = w_init[i];
+        }
+
+        double err = (cases[c].k > 1) ? run_blocked(1000, cases[c].k)
+                                      : run_sequential(1000);
+        printf("masked %s, input stride %d (model %d), K=%d: "
+               "relative W_out error %.3g\n",
+               (cases[c].trainer == ESN_TRAINER_QR_RLS) ? "QR-RLS" : "RLS",
+               stride, cases[c].model_stride, cases[c].k, err);
+        CHECK(err < 1e-5, "masked trainer %d stride %d: W_out off by %g",
+              (int)cases[c].trainer, stride, err);
+    }
+    CHECK(rls_set_feature_stride(n_in + 1) != 0, "stride %d accepted",
+          n_in + 1);
+}
+
+/*
+ * W_out readers: every update is published in the other buffer; a pinned
+ * snapshot stays as it was while training publishes the next copy, and
+ * an update that would overwrite a pinned snapshot is dropped after
+ * RLS_PIN_SPIN_LIMIT polls instead of waiting for ever.
+ */
+static void test_w_out_pinning(void)
+{
+    float z[MAX_EXT];
+    float y[MAX_OUT];
+    float before[MAX_OUT * MAX_EXT];
+
+    setup(12, 8, 3, 0.999f, ESN_TRAINER_RLS);
+    const size_t bytes = sizeof(float) * model.num_outputs *
+                         model.extended_size;
+    run_sequential(50);
+
+    const float *front = rls_w_out_acquire();
+    rls_w_out_release(front);
+    next_sample(z, y);
+    update_training_rls(z, y);
+    ref_update(z, y);
+    const float *flipped = rls_w_out_acquire();
+    rls_w_out_release(flipped);
+    CHECK(flipped != front, "update not published in the other buffer");
+
+    const float *pinned = rls_w_out_acquire();
+    memcpy(before, pinned, bytes);
+    next_sample(z, y);
+    update_training_rls(z, y);
+    ref_update(z, y);
+    CHECK(memcmp(pinned, before, bytes) == 0, "pinned W_out was written");
+    const float *current = rls_w_out_acquire();
+    rls_w_out_release(current);
+    CHECK(current != pinned, "update with W_out pinned not published");
+    CHECK(w_out_error() < 1e-5, "update with W_out pinned off by %g",
+          w_out_error());
+
+    // The back buffer is the pinned snapshot now
+    memcpy(before, current, bytes);
+    next_sample(z, y);
+    update_training_rls(z, y);   // dropped: the reference skips it too
+    const float *after = rls_w_out_acquire();
+    CHECK(after == current && memcmp(current, before, bytes) == 0,
+          "update over a pinned snapshot not dropped");
+    rls_w_out_release(after);
+    rls_w_out_release(pinned);
+
+    double err = run_sequential(200);
+    printf("W_out pinning: relative W_out error %.3g after a dropped update\n",
+           err);
+    CHECK(err < 1e-5, "training after a dropped update off by %g", err);
+}
+
+int main(void)
+{
+    test_packed_psi();
+    test_lazy_scaling();
+    test_qr_rls();
+    test_block_rls();
+    test_set_membership();
+    test_feature_mask();
+    test_w_out_pinning();
+    return test_report("test_rls");
+}
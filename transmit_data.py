@@ -1,8 +1,8 @@
 #!/usr/bin/env python3
 import socket
 import struct
-import time
 import os
+import math
 
 # Get the directory of this script
 SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
@@ -14,106 +14,190 @@ print("Using FILE_PATH:", FILE_PATH)
 
 HEADER_FORMAT = "8sI4s"
 HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
-EOF_MARKER = b"<EOF>\n"
 NUM_INPUTS = 128 # change this if needed
+SNR_LEVELS = [0, 4, 8, 12, 16, 20]  # data_in_test_SNR_<n>.txt files
 
-def send_file_tcp(ip, port, filename, file_id):
-    """Send a file over TCP with a header and EOF marker."""
-    # Construct the full path to the file.
-    full_path = os.path.join(FILE_PATH, filename)
-    
-    # Attempt to open file
-    while True:
-        try:
-            with open(full_path, "r") as f:
-                file_data = f.read()
-            break
-        except Exception as e:
-            print(f"Error reading '{full_path}': {e}")
-            full_path = input("Please enter a valid full path filename: ").strip()
+# Payload encoding, sent in the header's format byte, then the magic
+PAYLOAD_ASCII = 0
+PAYLOAD_F32 = 1
+HEADER_MAGIC = b"ESN"
+binary_payload = False  # toggled from the main menu
 
-    file_bytes = file_data.encode('ascii')
-    file_size = len(file_bytes)
+def encode_payload(text):
+    """Return (payload bytes, payload format) for one-float-per-line text,
+       as raw little-endian float32 values when binary_payload is set."""
+    if binary_payload:
+        values = [float(v) for v in text.split()]
+        return struct.pack("<%df" % len(values), *values), PAYLOAD_F32
+    return text.encode('ascii'), PAYLOAD_ASCII
 
-    # Prepare the header
-    header = struct.pack(HEADER_FORMAT,
-                         file_id.encode('ascii').ljust(8, b'_'), 
-                         file_size,
-                         b'\x00' * 4)
+class Session:
+    """One connection to the file port carrying any number of messages
+       (16-byte header + payload) back to back. The board frames them by
+       file_size, so no end marker or pauses are needed; commands travel
+       in the same stream as CMD_____ messages and run in order. The board
+       serves one session at a time and closes its end once it has run
+       everything, which close() waits for, so sessions run in order too."""
 
-    # Create a TCP socket, connect to the board
-    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+    def __init__(self, ip, port):
         print(f"Connecting to {ip}:{port}...")
-        s.connect((ip, port))
-        print("Connected. Sending header, file data, and EOF marker.")
-        s.sendall(header)
-        time.sleep(0.1)
-        s.sendall(file_bytes)
-        time.sleep(0.1)
-        s.sendall(EOF_MARKER)
-        time.sleep(0.1)
+        self.sock = socket.create_connection((ip, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        try:
+            self.sock.shutdown(socket.SHUT_WR)
+            while self.sock.recv(4096):
+                pass
+        except OSError as e:
+            print(f"Session ended with an error: {e}")
+        self.sock.close()
+
+    def send_message(self, file_id, payload, fmt=PAYLOAD_ASCII):
+        header = struct.pack(HEADER_FORMAT,
+                             file_id.encode('ascii').ljust(8, b'_'),
+                             len(payload),
+                             bytes([fmt]) + HEADER_MAGIC)
+        self.sock.sendall(header + payload)
+
+    def send_text(self, file_id, text):
+        """Send one-float-per-line text in the current payload format."""
+        file_bytes, fmt = encode_payload(text)
+        self.send_message(file_id, file_bytes, fmt)
+        return len(file_bytes)
+
+    def send_file(self, filename, file_id):
+        """Send a file over the session."""
+        # Construct the full path to the file.
+        full_path = os.path.join(FILE_PATH, filename)
+
+        # Attempt to open file
+        while True:
+            try:
+                with open(full_path, "r") as f:
+                    file_data = f.read()
+                break
+            except Exception as e:
+                print(f"Error reading '{full_path}': {e}")
+                full_path = input("Please enter a valid full path filename: ").strip()
+
+        file_size = self.send_text(file_id, file_data)
+        print(f"Sent '{filename}' with ID '{file_id}', size {file_size} bytes.")
+
+    def send_data_in_chunks(self, filename, samples_per_chunk=10):
+        """Reads a large DATAIN file and sends it in chunks.
+           Each chunk consists of (samples_per_chunk * NUM_INPUTS) floats.
+           Assumes one float per line.
+        """
+        full_path = os.path.join(FILE_PATH, filename)
+        with open(full_path, "r") as f:
+            lines = f.readlines()
+
+        chunk_size = samples_per_chunk * NUM_INPUTS
+
+        total_lines = len(lines)
+        num_chunks = (total_lines + chunk_size - 1) // chunk_size
+
+        print(f"File contains {total_lines} floats; sending in {num_chunks} chunk(s) of {samples_per_chunk} samples each.")
+
+        for i in range(num_chunks):
+            start = i * chunk_size
+            end = min(start + chunk_size, total_lines)
+            self.send_text("DATAIN__", "".join(lines[start:end]))
+
+    def send_command(self, cmd):
+        """Run a board command in stream order."""
+        self.send_message("CMD_____", cmd.encode('ascii'))
+        print(f"Sent command: {cmd}")
 
-    print(f"Sent '{filename}' with ID '{file_id}', size {file_size} bytes.\n")
+def send_file_tcp(ip, port, filename, file_id):
+    """Send a file over TCP with a header."""
+    with Session(ip, port) as s:
+        s.send_file(filename, file_id)
+    print()
+
+def read_model_num_inputs(filename):
+    """Return num_inputs (first value) from a MODEL___ descriptor file."""
+    with open(os.path.join(FILE_PATH, filename), "r") as f:
+        return int(float(f.readline()))
 
 def send_chunk(ip, port, chunk_data, file_id):
-    """Send a chunk of data (chunk_data is a string) as a DATAIN file over TCP."""
-    file_bytes = chunk_data.encode('ascii')
-    file_size = len(file_bytes)
-    header = struct.pack(HEADER_FORMAT, file_id.encode('ascii').ljust(8, b'_'),
-                         file_size, b'\x00' * 4)
-    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-        print(f"Connecting to {ip}:{port} to send a data chunk...")
-        s.connect((ip, port))
-        s.sendall(header)
-        time.sleep(0.05)
-        s.sendall(file_bytes)
-        time.sleep(0.05)
-        s.sendall(EOF_MARKER)
-        time.sleep(0.05)
+    """Send a chunk of data (chunk_data is a string) as a file over TCP."""
+    with Session(ip, port) as s:
+        file_size = s.send_text(file_id, chunk_data)
     print(f"Sent data chunk of size {file_size} bytes.")
 
-def send_data_in_file_in_chunks(ip, port, filename, samples_per_chunk=10):
-    """Reads a large DATAIN file and sends it in chunks.
-       Each chunk consists of (samples_per_chunk * NUM_INPUTS) floats.
-       Assumes one float per line.
-    """
+def send_sparse_file_tcp(ip, port, filename, file_id, cols=None):
+    """Send a dense matrix file as sparse (row, col, value) triplets, one
+       value per line, skipping zeros. cols defaults to a square matrix."""
     full_path = os.path.join(FILE_PATH, filename)
     with open(full_path, "r") as f:
-        lines = f.readlines()
-    
-    chunk_size = samples_per_chunk * NUM_INPUTS
-    
-    total_lines = len(lines)
-    num_chunks = (total_lines + chunk_size - 1) // chunk_size
-    
-    print(f"File contains {total_lines} floats; sending in {num_chunks} chunk(s) of {samples_per_chunk} samples each.")
-    
-    for i in range(num_chunks):
-        start = i * chunk_size
-        end = min(start + chunk_size, total_lines)
-        chunk_data = "".join(lines[start:end])
-        send_chunk(ip, port, chunk_data, "DATAIN__")
-        time.sleep(0.5)
+        values = [float(line) for line in f if line.strip()]
+    if cols is None:
+        cols = math.isqrt(len(values))
+
+    lines = []
+    for i, v in enumerate(values):
+        if v != 0.0:
+            lines += [str(i // cols), str(i % cols), repr(v)]
+    print(f"'{filename}': {len(lines) // 3} of {len(values)} entries nonzero.")
+    send_chunk(ip, port, "\n".join(lines) + "\n", file_id)
+
+def send_data_in_file_in_chunks(ip, port, filename, samples_per_chunk=10):
+    """Send a large DATAIN file in chunks over one connection."""
+    with Session(ip, port) as s:
+        s.send_data_in_chunks(filename, samples_per_chunk)
+
+def run_full_session(ip, port, samples_per_chunk=10):
+    """Train W_out online on data_in_train and score every SNR test file,
+       all over one connection (weights, golden outputs, commands, data)."""
+    with Session(ip, port) as s:
+        s.send_command("RESET")
+        s.send_file("w_in.dat", "WIN_____")
+        s.send_file("w_x.dat", "WX______")
+        s.send_file("golden_out_train.txt", "DATAOUT_")
+        s.send_command("TRN_ON")
+        s.send_data_in_chunks("data_in_train.txt", samples_per_chunk)
+        s.send_command("TRN_OFF")
+        s.send_file("golden_out_test.txt", "DATAOUT_")
+        for snr in SNR_LEVELS:
+            s.send_command("RDI")
+            s.send_data_in_chunks("data_in_test_SNR_%d.txt" % snr,
+                                  samples_per_chunk)
+    print("Session sent; results are on the board's serial console.")
 
 def send_command(ip, port, cmd):
-    """Sends a command over TCP."""
-    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-        s.connect((ip, port))
-        s.sendall(cmd.encode('ascii'))
-        time.sleep(0.1)
-    print(f"Sent command: {cmd}")
+    """Run one command in a session of its own on the file port, so it
+       takes effect after everything sent before it and before anything
+       sent after it."""
+    with Session(ip, port) as s:
+        s.send_command(cmd)
 
 def main():
+    global binary_payload
     board_ip = "192.168.1.10"  # IP for board (host)
-    file_port = 5001           # TCP port on the ZC702
-    cmd_port = 5002            # Port for command interactions
+    file_port = 5001           # TCP port on the ZC702 (files and commands)
 
     while True:
         print("\nMain Menu:")
         print("m - Send matrix file(s)")
         print("d - Send golden data_out file")
         print("t - Toggle training (on/off)")
+        print("b - Toggle batched ESN mode (on/off)")
+        print("s - Toggle streaming DATAIN (run samples while the file arrives)")
+        print("a - Select reservoir activation (tanh tier)")
+        print("w - Select weight storage (fp32/fp16/bf16)")
+        print("p - Toggle payload format (currently %s)"
+              % ("float32" if binary_payload else "ASCII"))
+        print("f - Benchmark the board's ASCII float parsers")
         print("e - Run ESN (select data_in)")
+        print("x - Run a full train + SNR test session over one connection")
         print("r - Soft reset board (all or just data)")
         print("q - Quit")
 
@@ -125,7 +209,9 @@ def main():
             print("c - Send w_out.dat")
             print("d - Send w_in and w_x (if training w_out)")
             print("e - Send all three matrix files (w_in, w_x, w_out)")
-            matrix_choice = input("Enter your option (a/b/c/d/e): ").strip().lower()
+            print("f - Send model.dat (model sizes; send first, clears the weights)")
+            print("g - Send w_in and w_x as sparse triplets")
+            matrix_choice = input("Enter your option (a/b/c/d/e/f/g): ").strip().lower()
 
             if matrix_choice == 'a':
                 send_file_tcp(board_ip, file_port, "w_in.dat", "WIN_____")
@@ -140,6 +226,14 @@ def main():
                 send_file_tcp(board_ip, file_port, "w_in.dat", "WIN_____")
                 send_file_tcp(board_ip, file_port, "w_x.dat", "WX______")
                 send_file_tcp(board_ip, file_port, "w_out.dat", "WOUT____")
+            elif matrix_choice == 'f':
+                global NUM_INPUTS
+                send_file_tcp(board_ip, file_port, "model.dat", "MODEL___")
+                NUM_INPUTS = read_model_num_inputs("model.dat")
+                print(f"DATAIN chunks now use {NUM_INPUTS} inputs per sample.")
+            elif matrix_choice == 'g':
+                send_sparse_file_tcp(board_ip, file_port, "w_in.dat", "WIN_COO_", NUM_INPUTS)
+                send_sparse_file_tcp(board_ip, file_port, "w_x.dat", "WX_COO__")
             else:
                 print("Invalid matrix file option. Please try again.")
 
@@ -154,12 +248,109 @@ def main():
             print("\nTraining options:")
             print("1 - Turn training OFF")
             print("2 - Turn training ON")
-            reset_choice = input("Enter your option (1/2): ").strip().lower()
+            print("3 - Set RLS block size (samples per update)")
+            print("4 - Ridge: start accumulating (send training data next)")
+            print("5 - Ridge: solve for W_out")
+            print("6 - Set RLS error bound (skip well-predicted samples)")
+            print("7 - Use RLS trainer")
+            print("8 - Use NLMS trainer (cheap, no Psi)")
+            print("9 - Select RLS features (reservoir + every k-th input)")
+            print("10 - Use QR-RLS trainer (square-root RLS)")
+            reset_choice = input("Enter your option (1-10): ").strip().lower()
 
             if reset_choice == '1':
-                send_command(board_ip, cmd_port, "TRN_OFF")
+                send_command(board_ip, file_port, "TRN_OFF")
             elif reset_choice == '2':
-                send_command(board_ip, cmd_port, "TRN_ON")
+                send_command(board_ip, file_port, "TRN_ON")
+            elif reset_choice == '3':
+                block = input("Block size K (1 = every sample, max 32): ").strip()
+                if block.isdigit():
+                    send_command(board_ip, file_port, "TRN_BLOCK " + block)
+                else:
+                    print("Invalid block size.")
+            elif reset_choice == '4':
+                send_command(board_ip, file_port, "RIDGE_ON")
+            elif reset_choice == '5':
+                beta = input("Regularization beta (blank = 1.0): ").strip()
+                send_command(board_ip, file_port, ("TRN_SOLVE " + beta).strip())
+            elif reset_choice == '6':
+                bound = input("RMS error bound (0 = update every sample): ").strip()
+                send_command(board_ip, file_port, "TRN_BOUND " + (bound or "0"))
+            elif reset_choice == '7':
+                send_command(board_ip, file_port, "TRN_RLS")
+            elif reset_choice == '8':
+                mu = input("NLMS step size mu (blank = 0.5): ").strip()
+                send_command(board_ip, file_port, ("TRN_NLMS " + mu).strip())
+            elif reset_choice == '9':
+                stride = input("Input stride k (0 = reservoir only, 1 = all): ").strip()
+                if stride.isdigit():
+                    send_command(board_ip, file_port, "TRN_FEAT " + stride)
+                else:
+                    print("Invalid stride.")
+            elif reset_choice == '10':
+                send_command(board_ip, file_port, "TRN_QR")
+
+        elif choice == 'b':
+            print("\nBatched mode options:")
+            print("1 - Turn batched mode OFF")
+            print("2 - Turn batched mode ON")
+            batch_choice = input("Enter your option (1/2): ").strip().lower()
+
+            if batch_choice == '1':
+                send_command(board_ip, file_port, "BATCH_OFF")
+            elif batch_choice == '2':
+                send_command(board_ip, file_port, "BATCH_ON")
+
+        elif choice == 's':
+            print("\nStreaming DATAIN options:")
+            print("1 - Turn streaming OFF")
+            print("2 - Turn streaming ON")
+            stream_choice = input("Enter your option (1/2): ").strip().lower()
+
+            if stream_choice == '1':
+                send_command(board_ip, file_port, "STREAM_OFF")
+            elif stream_choice == '2':
+                send_command(board_ip, file_port, "STREAM_ON")
+
+        elif choice == 'a':
+            print("\nActivation options:")
+            print("1 - Exact tanhf")
+            print("2 - Rational approximation")
+            print("3 - Lookup table")
+            act_choice = input("Enter your option (1/2/3): ").strip().lower()
+
+            if act_choice == '1':
+                send_command(board_ip, file_port, "ACT_EXACT")
+            elif act_choice == '2':
+                send_command(board_ip, file_port, "ACT_RAT")
+            elif act_choice == '3':
+                send_command(board_ip, file_port, "ACT_LUT")
+
+        elif choice == 'w':
+            print("\nWeight storage options:")
+            print("1 - fp32 (default)")
+            print("2 - fp16 (IEEE half)")
+            print("3 - bf16 (bfloat16)")
+            fmt_choice = input("Enter your option (1/2/3): ").strip().lower()
+
+            if fmt_choice == '1':
+                send_command(board_ip, file_port, "WFMT_F32")
+            elif fmt_choice == '2':
+                send_command(board_ip, file_port, "WFMT_F16")
+            elif fmt_choice == '3':
+                send_command(board_ip, file_port, "WFMT_BF16")
+
+        elif choice == 'p':
+            binary_payload = not binary_payload
+            print("Files are now sent as %s."
+                  % ("raw float32" if binary_payload else "ASCII text"))
+
+        elif choice == 'f':
+            count = input("Values to parse (blank = one golden file's worth): ").strip()
+            if count == "" or count.isdigit():
+                send_command(board_ip, file_port, ("PARSE_BENCH " + count).strip())
+            else:
+                print("Invalid count.")
 
         elif choice == 'e':
             print("\nESN options:")
@@ -180,6 +371,9 @@ def main():
                     data_filename = input("Please enter a valid DATAIN filename: ").strip()
                 send_data_in_file_in_chunks(board_ip, file_port, data_filename, samples_per_chunk=10)
 
+        elif choice == 'x':
+            run_full_session(board_ip, file_port)
+
         elif choice == 'r':
             print("\nReset options:")
             print("1 - Reset everything")
@@ -187,9 +381,9 @@ def main():
             reset_choice = input("Enter your option (1/2): ").strip().lower()
 
             if reset_choice == '1':
-                send_command(board_ip, cmd_port, "RESET")
+                send_command(board_ip, file_port, "RESET")
             elif reset_choice == '2':
-                send_command(board_ip, cmd_port, "RDI")
+                send_command(board_ip, file_port, "RDI")
 
         elif choice == 'q':
             print("Exiting.")